@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * String arena and fixed size slab allocator.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "debug.h"
+
+/* String arena block */
+struct sa_block {
+	struct sa_block *next;
+	size_t size;
+	size_t used;
+	char data[1];
+};
+
+/* Slab page header; slots follow */
+struct slab_page {
+	struct slab_page *next;
+	double align; /* aligns slots that follow */
+};
+
+/* Default string arena block size */
+#define SA_BLOCK_SIZE	16384
+
+/* Preferred slab page size, unless a slot is larger */
+#define SP_PAGE_SIZE	(1024 * 1024)
+
+/* Slot alignment */
+#define SP_ALIGN	16
+
+void sa_init(struct str_arena *sa)
+{
+	sa->head = NULL;
+}
+
+char* sa_strdup(struct str_arena *sa, const char *sz)
+{
+	size_t len = strlen(sz) + 1;
+	char *ptr;
+
+	if(!sa->head || (sa->head->size - sa->head->used) < len) {
+		struct sa_block *blk;
+		size_t size = (len > SA_BLOCK_SIZE) ? len : SA_BLOCK_SIZE;
+
+		blk = malloc(sizeof(struct sa_block) + size);
+		if(!blk) return NULL;
+		blk->size = size;
+		blk->used = 0;
+		blk->next = sa->head;
+		sa->head = blk;
+	}
+
+	ptr = sa->head->data + sa->head->used;
+	memcpy(ptr, sz, len);
+	sa->head->used += len;
+	return ptr;
+}
+
+void sa_merge(struct str_arena *dest, struct str_arena *src)
+{
+	struct sa_block *tail;
+
+	if(!src->head) return;
+
+	/* keep dest's partially filled head block in front */
+	for(tail = src->head; tail->next; tail = tail->next);
+
+	if(dest->head) {
+		tail->next = dest->head->next;
+		dest->head->next = src->head;
+	} else {
+		dest->head = src->head;
+	}
+	src->head = NULL;
+}
+
+void sa_free(struct str_arena *sa)
+{
+	while(sa->head) {
+		struct sa_block *next = sa->head->next;
+
+		free(sa->head);
+		sa->head = next;
+	}
+}
+
+void sp_init(struct slab_pool *pool, size_t slot_size)
+{
+	memset(pool, 0, sizeof(struct slab_pool));
+
+	/* released slots hold a free list link */
+	if(slot_size < sizeof(void*)) slot_size = sizeof(void*);
+	pool->slot_size = (slot_size + (SP_ALIGN - 1)) & ~(SP_ALIGN - 1);
+	pool->slots_per_page = SP_PAGE_SIZE / pool->slot_size;
+	if(!pool->slots_per_page) pool->slots_per_page = 1;
+}
+
+void* sp_alloc(struct slab_pool *pool)
+{
+	void *ptr;
+
+	dassert(pool->slot_size);
+
+	if(pool->free_list) {
+		ptr = pool->free_list;
+		pool->free_list = *((void**)ptr);
+		return ptr;
+	}
+
+	if(!pool->nfresh) {
+		struct slab_page *page;
+
+		page = malloc(sizeof(struct slab_page) +
+			pool->slot_size * pool->slots_per_page);
+		if(!page) return NULL;
+		page->next = pool->pages;
+		pool->pages = page;
+		pool->nfresh = pool->slots_per_page;
+	}
+
+	ptr = (char*)(pool->pages + 1) + pool->slot_size *
+		(pool->slots_per_page - pool->nfresh);
+	pool->nfresh--;
+	return ptr;
+}
+
+void sp_release(struct slab_pool *pool, void *ptr)
+{
+	*((void**)ptr) = pool->free_list;
+	pool->free_list = ptr;
+}
+
+void sp_free(struct slab_pool *pool)
+{
+	while(pool->pages) {
+		struct slab_page *next = pool->pages->next;
+
+		free(pool->pages);
+		pool->pages = next;
+	}
+	memset(pool, 0, sizeof(struct slab_pool));
+}
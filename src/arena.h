@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * String arena and fixed size slab allocator type definitions and prototypes.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * String arena. Strings are packed into large blocks and released all
+ * at once, so there's no per-string allocation overhead.
+ */
+struct sa_block;
+
+struct str_arena {
+	struct sa_block *head;
+};
+
+/* Fixed size slab allocator */
+struct slab_page;
+
+struct slab_pool {
+	size_t slot_size;	/* zero if uninitialized */
+	unsigned int slots_per_page;
+	struct slab_page *pages;
+	void *free_list;	/* released slots */
+	unsigned int nfresh;	/* never used slots left in the first page */
+};
+
+void sa_init(struct str_arena *sa);
+
+/*
+ * Copy 'sz' into the arena.
+ * Returns a pointer to the copy, or NULL on allocation failure.
+ */
+char* sa_strdup(struct str_arena *sa, const char *sz);
+
+/* Move all strings from 'src' into 'dest'; 'src' is left empty */
+void sa_merge(struct str_arena *dest, struct str_arena *src);
+
+/* Free all strings in the arena */
+void sa_free(struct str_arena *sa);
+
+/*
+ * Initialize 'pool' for allocating slots of 'slot_size' bytes.
+ */
+void sp_init(struct slab_pool *pool, size_t slot_size);
+
+/*
+ * Allocate a slot. Returns a valid pointer, or NULL on failure.
+ */
+void* sp_alloc(struct slab_pool *pool);
+
+/* Return a slot allocated by sp_alloc to the pool */
+void sp_release(struct slab_pool *pool, void *ptr);
+
+/* Free all pages and reset the pool to uninitialized state */
+void sp_free(struct slab_pool *pool);
+
+#endif /* ARENA_H */
@@ -0,0 +1,998 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Headless batch processing. Images are decoded through the same
+ * img_open/pixconv/img_blt pipeline the GUI uses, into client side
+ * XImages of a synthetic 24 bit TrueColor visual, so no X connection
+ * is required.
+ * Contact sheets are laid out like the browser's tile grid, and written
+ * one row of tiles at a time, so only a few rows are ever kept in memory.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include "common.h"
+#include "const.h"
+#include "strings.h"
+#include "imgfile.h"
+#include "imgblt.h"
+#include "pixconv.h"
+#include "thumbcache.h"
+#include "decoder.h"
+#include "ldrproto.h"
+#include "browserp.h"
+#include "guiutil.h"
+#include "lblfont.h"
+#include "bswap.h"
+#include "batch.h"
+#include "debug.h"
+
+/* List of files to process */
+struct file_list {
+	char **names;
+	size_t count;
+	size_t size;
+};
+
+/* Shared batch job state */
+struct batch_job {
+	struct file_list files;
+	size_t next;			/* next file to be processed */
+	unsigned long ndone;	/* thumbnails generated */
+	unsigned long nskipped;	/* up to date in cache */
+	unsigned long nfailed;
+	unsigned long long nbytes;	/* size of files decoded */
+	int nactive;			/* workers running */
+	Boolean quiet;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+/* Contact sheet tile */
+struct sheet_tile {
+	uint8_t *pixels;	/* R,G,B byte triplets, NULL if failed */
+	unsigned int width;
+	unsigned int height;
+	Boolean done;
+};
+
+/* Shared contact sheet state */
+struct contact_sheet {
+	struct file_list files;
+	struct sheet_tile *tiles;
+	unsigned int thumb_width;	/* area available to the thumbnail */
+	unsigned int thumb_height;
+	size_t next;			/* next tile to be rendered */
+	size_t limit;			/* tiles past this one must wait for output */
+	unsigned long nfailed;
+	int nactive;
+	Boolean quit;			/* workers must exit */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;		/* signaled when a tile is done */
+	pthread_cond_t limit_cond;	/* signaled when limit is raised */
+};
+
+/* Contact sheet output file */
+struct sheet_writer {
+	FILE *file;			/* PAM output */
+	void *png;			/* PNG writer handle */
+	unsigned long width;
+};
+
+/* Progress report interval in seconds */
+#define PROGRESS_INT	5
+
+/* Contact sheet defaults and layout */
+#define SHEET_TILE_SIZE		120
+#define SHEET_COLUMNS		8
+#define SHEET_ASR_X			4	/* tile aspect ratio */
+#define SHEET_ASR_Y			3
+#define SHEET_BORDER		1
+#define SHEET_LOOKAHEAD		2	/* rows rendered ahead of output */
+#define SHEET_LABEL_HEIGHT	(LBLFONT_HEIGHT + 2)
+#define SHEET_CHAR_ADVANCE	(LBLFONT_WIDTH + 1)
+
+/* Contact sheet colors */
+#define SHEET_BG_PIXEL		0xC0C0C0
+#define SHEET_TS_PIXEL		0xF0F0F0
+#define SHEET_BS_PIXEL		0x707070
+#define SHEET_FG_PIXEL		0x000000
+
+/* Local prototypes */
+static void init_headless_visual(void);
+static int collect_files(struct file_list*, const char*, Boolean);
+static void* worker_thread(void*);
+static double elapsed_time(const struct timespec*);
+static void print_report(struct batch_job*, double, Boolean);
+static int thumbnail_batch(const char*, int, Boolean, const char*, Boolean);
+static int contact_sheet(const char*, char**, int, unsigned int,
+	unsigned int, int, Boolean, const char*, Boolean);
+static int collect_inputs(struct file_list*, char**, int, Boolean);
+static int add_file(struct file_list*, char*);
+static int name_compare(const void*, const void*);
+static void* sheet_thread(void*);
+static int render_tile(struct decoder*, const char*,
+	unsigned int, unsigned int, struct sheet_tile*);
+static void compose_band(struct contact_sheet*, size_t, unsigned int,
+	unsigned int, unsigned int, uint8_t*, unsigned long);
+static void fill_rect(uint8_t*, unsigned long, int, int,
+	unsigned int, unsigned int, unsigned long);
+static void draw_label(uint8_t*, unsigned long, int, int,
+	unsigned int, const char*);
+static int sheet_open(struct sheet_writer*, const char*,
+	unsigned long, unsigned long);
+static int sheet_write(struct sheet_writer*, const uint8_t*, unsigned long);
+static int sheet_close(struct sheet_writer*, Boolean);
+static void interrupt_handler(int);
+
+/* Set by SIGINT/SIGTERM; workers finish files in progress and exit */
+static volatile sig_atomic_t interrupted = 0;
+
+Boolean batch_requested(int argc, char **argv)
+{
+	int i;
+
+	for(i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-thumbnail-dir") ||
+			!strcmp(argv[i], "-contact-sheet")) return True;
+	}
+	return False;
+}
+
+int batch_main(int argc, char **argv)
+{
+	char *thumb_dir = NULL;
+	char *sheet_name = NULL;
+	char *cache_dir = NULL;
+	char **inputs;
+	Boolean recursive = False;
+	Boolean quiet = False;
+	int tile_size = SHEET_TILE_SIZE;
+	int columns = SHEET_COLUMNS;
+	int njobs = 0;
+	int ninputs = 0;
+	int i, res;
+
+	if(!(inputs = malloc(sizeof(char*) * argc))) {
+		fprintf(stderr, "%s: %s\n", BASE_NAME, strerror(ENOMEM));
+		return EXIT_FAILURE;
+	}
+
+	for(i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-recursive")) {
+			recursive = True;
+		} else if(!strcmp(argv[i], "-quiet")) {
+			quiet = True;
+		} else if(!strcmp(argv[i], "-thumbnail-dir") ||
+			!strcmp(argv[i], "-contact-sheet") ||
+			!strcmp(argv[i], "-cache-dir") || !strcmp(argv[i], "-j") ||
+			!strcmp(argv[i], "-tile-size") || !strcmp(argv[i], "-columns")) {
+			if(i + 1 == argc) {
+				fprintf(stderr, "%s: %s\n", argv[i],
+					nlstr(APP_MSGSET, SID_ENOARG, "Argument expected."));
+				free(inputs);
+				return EXIT_FAILURE;
+			}
+			if(!strcmp(argv[i], "-thumbnail-dir"))
+				thumb_dir = argv[++i];
+			else if(!strcmp(argv[i], "-contact-sheet"))
+				sheet_name = argv[++i];
+			else if(!strcmp(argv[i], "-cache-dir"))
+				cache_dir = argv[++i];
+			else if(!strcmp(argv[i], "-tile-size"))
+				tile_size = atoi(argv[++i]);
+			else if(!strcmp(argv[i], "-columns"))
+				columns = atoi(argv[++i]);
+			else
+				njobs = atoi(argv[++i]);
+		} else if(sheet_name && argv[i][0] != '-') {
+			inputs[ninputs++] = argv[i];
+		} else {
+			fprintf(stderr, "%s: %s\n", argv[i],
+				nlstr(APP_MSGSET, SID_EARG, "Ignoring redundant arguments."));
+		}
+	}
+
+	init_app_res.quiet = quiet;
+
+	if(njobs <= 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		njobs = (ncpu > 0) ? ncpu : 1;
+	}
+
+	/* tiles must have room for the bevel and at least one pixel */
+	if(tile_size < (TILE_PADDING + SHEET_BORDER) * 2 * SHEET_ASR_X)
+		tile_size = SHEET_TILE_SIZE;
+	if(columns <= 0) columns = SHEET_COLUMNS;
+
+	if(sheet_name) {
+		res = contact_sheet(sheet_name, inputs, ninputs, tile_size,
+			columns, njobs, recursive, cache_dir, quiet);
+	} else {
+		res = thumbnail_batch(thumb_dir, njobs, recursive, cache_dir, quiet);
+	}
+	free(inputs);
+	return res;
+}
+
+/*
+ * Generate cached thumbnails for image files in 'path', using 'njobs'
+ * parallel workers. Files already up to date in the cache are skipped,
+ * so an interrupted run may be resumed simply by running it again.
+ */
+static int thumbnail_batch(const char *path, int njobs,
+	Boolean recursive, const char *cache_dir, Boolean quiet)
+{
+	struct batch_job job;
+	struct timespec start;
+	pthread_t tid;
+	pthread_attr_t attr;
+	char *real_path;
+	int i, res;
+
+	if(!(real_path = realpath(path, NULL))) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if( (res = tc_init(cache_dir)) ) {
+		fprintf(stderr, "%s: %s\n", BASE_NAME, strerror(res));
+		return EXIT_FAILURE;
+	}
+
+	init_headless_visual();
+
+	memset(&job, 0, sizeof(struct batch_job));
+	job.quiet = quiet;
+
+	if( (res = collect_files(&job.files, real_path, recursive)) ) {
+		fprintf(stderr, "%s: %s\n", real_path, strerror(res));
+		return EXIT_FAILURE;
+	}
+	free(real_path);
+
+	if(!job.files.count) {
+		fprintf(stderr, "%s: %s\n", path,
+			nlstr(APP_MSGSET, SID_ENOFILE,
+			"No image files in current directory."));
+		return EXIT_SUCCESS;
+	}
+
+	rsignal(SIGINT, interrupt_handler);
+	rsignal(SIGTERM, interrupt_handler);
+
+	pthread_mutex_init(&job.mutex, NULL);
+	pthread_cond_init(&job.cond, NULL);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pthread_mutex_lock(&job.mutex);
+	for(i = 0; i < njobs && i < job.files.count; i++) {
+		if(pthread_create(&tid, &attr, worker_thread, &job)) break;
+		job.nactive++;
+	}
+	pthread_attr_destroy(&attr);
+
+	if(!job.nactive) {
+		pthread_mutex_unlock(&job.mutex);
+		fprintf(stderr, "%s: %s\n", BASE_NAME, strerror(EAGAIN));
+		return EXIT_FAILURE;
+	}
+
+	while(job.nactive) {
+		struct timespec ts;
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += PROGRESS_INT;
+
+		if(pthread_cond_timedwait(&job.cond, &job.mutex, &ts) == ETIMEDOUT
+			&& !quiet) print_report(&job, elapsed_time(&start), False);
+	}
+	pthread_mutex_unlock(&job.mutex);
+
+	if(!quiet) print_report(&job, elapsed_time(&start), True);
+
+	for(i = 0; i < job.files.count; i++) free(job.files.names[i]);
+	free(job.files.names);
+
+	return interrupted ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * Batch worker thread entry point.
+ */
+static void* worker_thread(void *data)
+{
+	struct batch_job *job = (struct batch_job*)data;
+	struct decoder dec;
+
+	dec_init(&dec, &interrupted);
+
+	pthread_mutex_lock(&job->mutex);
+	while(job->next < job->files.count && !interrupted) {
+		char *name = job->files.names[job->next++];
+		struct stat st;
+		Boolean cached = False;
+		int res;
+
+		pthread_mutex_unlock(&job->mutex);
+
+		if(stat(name, &st)) {
+			res = errno;
+		} else if(!tc_lookup(name, &st, NULL)) {
+			cached = True;
+			res = 0;
+		} else {
+			res = dec_make_thumbnail(&dec, name, &st);
+		}
+
+		pthread_mutex_lock(&job->mutex);
+		if(cached) {
+			job->nskipped++;
+		} else if(res == 0) {
+			job->ndone++;
+			job->nbytes += st.st_size;
+		} else if(!interrupted) {
+			job->nfailed++;
+			warning_msg("%s: %s\n", name, (res < 0) ?
+				img_strerror(res) : strerror(res));
+		}
+	}
+	job->nactive--;
+	pthread_cond_signal(&job->cond);
+	pthread_mutex_unlock(&job->mutex);
+
+	dec_free(&dec);
+	return NULL;
+}
+
+/*
+ * Set up app_inst visual info to describe a 24 bit TrueColor visual,
+ * since the blitter and pixel conversion routines depend on it.
+ */
+static void init_headless_visual(void)
+{
+	memset(&app_inst.visual_info, 0, sizeof(XVisualInfo));
+	app_inst.visual_info.class = TrueColor;
+	app_inst.visual_info.depth = 24;
+	app_inst.visual_info.red_mask = 0x00FF0000;
+	app_inst.visual_info.green_mask = 0x0000FF00;
+	app_inst.visual_info.blue_mask = 0x000000FF;
+	app_inst.visual_info.bits_per_rgb = 8;
+	app_inst.pixel_size = 32;
+}
+
+/*
+ * Add image files in 'path' (and its subdirectories if 'recursive' is True)
+ * to 'list'. Symbolic links to directories are not followed.
+ * Returns zero on success, errno otherwise.
+ */
+static int collect_files(struct file_list *list,
+	const char *path, Boolean recursive)
+{
+	DIR *dir;
+	struct dirent *ent;
+	struct stat st;
+	char *buf;
+	int res = 0;
+
+	if(!(dir = opendir(path))) return errno;
+
+	while((ent = readdir(dir))) {
+		if(!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+
+		buf = malloc(strlen(path) + strlen(ent->d_name) + 2);
+		if(!buf) {
+			res = ENOMEM;
+			break;
+		}
+		sprintf(buf, "%s/%s", path, ent->d_name);
+
+		if(lstat(buf, &st)) {
+			free(buf);
+			continue;
+		}
+
+		if(S_ISDIR(st.st_mode)) {
+			if(recursive) res = collect_files(list, buf, True);
+			free(buf);
+			if(res == ENOMEM) break;
+			res = 0;
+			continue;
+		}
+
+		if((S_ISLNK(st.st_mode) && (stat(buf, &st) || !S_ISREG(st.st_mode)))
+			|| (!S_ISLNK(st.st_mode) && !S_ISREG(st.st_mode)) ||
+			img_ident(buf, NULL, NULL)) {
+			free(buf);
+			continue;
+		}
+
+		if( (res = add_file(list, buf)) ) {
+			free(buf);
+			break;
+		}
+	}
+	closedir(dir);
+	return res;
+}
+
+/*
+ * Append 'name' (allocated by the caller) to 'list'.
+ * Returns zero on success, ENOMEM otherwise.
+ */
+static int add_file(struct file_list *list, char *name)
+{
+	if(list->count == list->size) {
+		char **new_ptr;
+
+		new_ptr = realloc(list->names,
+			sizeof(char*) * (list->size + FILE_LIST_GROWBY));
+		if(!new_ptr) return ENOMEM;
+		list->names = new_ptr;
+		list->size += FILE_LIST_GROWBY;
+	}
+	list->names[list->count++] = name;
+	return 0;
+}
+
+/*
+ * Write a contact sheet of 'ninputs' files, or image files within
+ * directories, to 'out_name'. Thumbnails are rendered by 'njobs' workers,
+ * using (and updating) the thumbnail cache if it can be initialized.
+ */
+static int contact_sheet(const char *out_name, char **inputs, int ninputs,
+	unsigned int tile_size, unsigned int columns, int njobs,
+	Boolean recursive, const char *cache_dir, Boolean quiet)
+{
+	struct contact_sheet cs;
+	struct sheet_writer wr;
+	struct timespec start;
+	pthread_t tid;
+	pthread_attr_t attr;
+	unsigned int tile_width, tile_height, band_height;
+	unsigned long width, height, nrows, row;
+	size_t lookahead;
+	uint8_t *band;
+	int i, res;
+
+	if(!ninputs) {
+		fprintf(stderr, "%s: %s\n", out_name,
+			nlstr(APP_MSGSET, SID_ENOARG, "Argument expected."));
+		return EXIT_FAILURE;
+	}
+
+	if( (res = tc_init(cache_dir)) )
+		fprintf(stderr, "%s: %s\n", BASE_NAME, strerror(res));
+
+	init_headless_visual();
+
+	memset(&cs, 0, sizeof(struct contact_sheet));
+
+	if( (res = collect_inputs(&cs.files, inputs, ninputs, recursive)) ) {
+		fprintf(stderr, "%s: %s\n", BASE_NAME, strerror(res));
+		return EXIT_FAILURE;
+	}
+
+	if(!cs.files.count) {
+		fprintf(stderr, "%s: %s\n", out_name,
+			nlstr(APP_MSGSET, SID_ENOFILE,
+			"No image files in current directory."));
+		return EXIT_FAILURE;
+	}
+
+	/* same geometry as the browser's tile grid */
+	tile_width = tile_size;
+	tile_height = (tile_size / SHEET_ASR_X) * SHEET_ASR_Y;
+	cs.thumb_width = tile_width - (TILE_PADDING + SHEET_BORDER) * 2;
+	cs.thumb_height = tile_height - (TILE_PADDING + SHEET_BORDER) * 2;
+	band_height = tile_height + LABEL_MARGIN +
+		SHEET_LABEL_HEIGHT + TILE_YMARGIN;
+
+	if(columns > cs.files.count) columns = cs.files.count;
+	nrows = (cs.files.count + columns - 1) / columns;
+	width = TILE_XMARGIN + columns * (tile_width + TILE_XMARGIN);
+	height = TILE_YMARGIN + nrows * band_height;
+
+	cs.tiles = calloc(cs.files.count, sizeof(struct sheet_tile));
+	band = malloc(width * band_height * 3);
+	if(!cs.tiles || !band) {
+		fprintf(stderr, "%s: %s\n", BASE_NAME, strerror(ENOMEM));
+		return EXIT_FAILURE;
+	}
+
+	if( (res = sheet_open(&wr, out_name, width, height)) ) {
+		fprintf(stderr, "%s: %s\n", out_name, (res < 0) ?
+			img_strerror(res) : strerror(res));
+		return EXIT_FAILURE;
+	}
+
+	/* top margin */
+	fill_rect(band, width, 0, 0, width, TILE_YMARGIN, SHEET_BG_PIXEL);
+	res = sheet_write(&wr, band, TILE_YMARGIN);
+
+	rsignal(SIGINT, interrupt_handler);
+	rsignal(SIGTERM, interrupt_handler);
+
+	/* keep enough tiles ahead of output to keep all workers busy */
+	lookahead = columns * SHEET_LOOKAHEAD;
+	if(lookahead < njobs * 2) lookahead = njobs * 2;
+	cs.limit = columns + lookahead;
+	if(cs.limit > cs.files.count) cs.limit = cs.files.count;
+
+	pthread_mutex_init(&cs.mutex, NULL);
+	pthread_cond_init(&cs.cond, NULL);
+	pthread_cond_init(&cs.limit_cond, NULL);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pthread_mutex_lock(&cs.mutex);
+	for(i = 0; i < njobs && i < cs.files.count; i++) {
+		if(pthread_create(&tid, &attr, sheet_thread, &cs)) break;
+		cs.nactive++;
+	}
+	pthread_attr_destroy(&attr);
+
+	if(!cs.nactive) res = EAGAIN;
+
+	for(row = 0; row < nrows && !res && !interrupted; row++) {
+		size_t first = row * columns;
+		size_t last = first + columns;
+		size_t n;
+
+		if(last > cs.files.count) last = cs.files.count;
+
+		/* wait for the row to be rendered */
+		for(n = first; n < last && !interrupted; ) {
+			struct timespec ts;
+
+			if(cs.tiles[n].done) {
+				n++;
+				continue;
+			}
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += PROGRESS_INT;
+
+			if(pthread_cond_timedwait(&cs.cond, &cs.mutex, &ts) ==
+				ETIMEDOUT && !quiet) {
+				printf("%lu/%lu rows written...\n", row, nrows);
+				fflush(stdout);
+			}
+		}
+		if(interrupted) break;
+		pthread_mutex_unlock(&cs.mutex);
+
+		compose_band(&cs, first, columns, tile_width, tile_height,
+			band, width);
+		res = sheet_write(&wr, band, band_height);
+
+		for(n = first; n < last; n++) {
+			if(cs.tiles[n].pixels) free(cs.tiles[n].pixels);
+			cs.tiles[n].pixels = NULL;
+		}
+
+		pthread_mutex_lock(&cs.mutex);
+		cs.limit = last + lookahead;
+		if(cs.limit > cs.files.count) cs.limit = cs.files.count;
+		pthread_cond_broadcast(&cs.limit_cond);
+	}
+
+	/* wait for workers to exit, since they reference 'cs' */
+	cs.quit = True;
+	pthread_cond_broadcast(&cs.limit_cond);
+	while(cs.nactive) pthread_cond_wait(&cs.cond, &cs.mutex);
+	pthread_mutex_unlock(&cs.mutex);
+
+	if(row < nrows && !res) res = EINTR;
+	if(sheet_close(&wr, res ? True : False) && !res) res = IMG_EIO;
+
+	if(res) {
+		fprintf(stderr, "%s: %s\n", out_name, (res < 0) ?
+			img_strerror(res) : strerror(res));
+		unlink(out_name);
+	} else if(!quiet) {
+		printf("%lu files, %lux%lu pixels, %.1f s\n",
+			(unsigned long)cs.files.count, width, height,
+			elapsed_time(&start));
+	}
+
+	for(i = 0; i < cs.files.count; i++) {
+		if(cs.tiles[i].pixels) free(cs.tiles[i].pixels);
+		free(cs.files.names[i]);
+	}
+	free(cs.files.names);
+	free(cs.tiles);
+	free(band);
+
+	return (res || cs.nfailed) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * Build the contact sheet file list from command line arguments.
+ * Directory contents are sorted by name, files are added in given order.
+ * Returns zero on success, errno otherwise.
+ */
+static int collect_inputs(struct file_list *list, char **inputs,
+	int ninputs, Boolean recursive)
+{
+	struct stat st;
+	char *name;
+	size_t first;
+	int i, res;
+
+	for(i = 0; i < ninputs; i++) {
+		if(stat(inputs[i], &st)) {
+			fprintf(stderr, "%s: %s\n", inputs[i], strerror(errno));
+			continue;
+		}
+
+		if(!(name = realpath(inputs[i], NULL))) return errno;
+
+		if(S_ISDIR(st.st_mode)) {
+			first = list->count;
+			res = collect_files(list, name, recursive);
+			free(name);
+			if(res) return res;
+			qsort(&list->names[first], list->count - first,
+				sizeof(char*), name_compare);
+		} else if(img_ident(name, NULL, NULL)) {
+			fprintf(stderr, "%s: %s\n", inputs[i],
+				img_strerror(IMG_EUNSUP));
+			free(name);
+		} else if( (res = add_file(list, name)) ) {
+			free(name);
+			return res;
+		}
+	}
+	return 0;
+}
+
+static int name_compare(const void *a, const void *b)
+{
+	return strcmp(*(char**)a, *(char**)b);
+}
+
+/*
+ * Contact sheet worker thread entry point.
+ */
+static void* sheet_thread(void *data)
+{
+	struct contact_sheet *cs = (struct contact_sheet*)data;
+	struct decoder dec;
+
+	dec_init(&dec, &interrupted);
+
+	pthread_mutex_lock(&cs->mutex);
+	for(;;) {
+		struct sheet_tile tile;
+		char *name;
+		size_t i;
+		int res;
+
+		while(cs->next >= cs->limit && cs->next < cs->files.count &&
+			!cs->quit && !interrupted)
+			pthread_cond_wait(&cs->limit_cond, &cs->mutex);
+
+		if(cs->next >= cs->files.count || cs->quit || interrupted) break;
+
+		i = cs->next++;
+		name = cs->files.names[i];
+		pthread_mutex_unlock(&cs->mutex);
+
+		memset(&tile, 0, sizeof(struct sheet_tile));
+		res = render_tile(&dec, name, cs->thumb_width,
+			cs->thumb_height, &tile);
+
+		pthread_mutex_lock(&cs->mutex);
+		if(res && !interrupted) {
+			cs->nfailed++;
+			warning_msg("%s: %s\n", name, (res < 0) ?
+				img_strerror(res) : strerror(res));
+		}
+		cs->tiles[i] = tile;
+		cs->tiles[i].done = True;
+		pthread_cond_signal(&cs->cond);
+	}
+	cs->nactive--;
+	pthread_cond_signal(&cs->cond);
+	pthread_mutex_unlock(&cs->mutex);
+
+	dec_free(&dec);
+	return NULL;
+}
+
+/*
+ * Render a thumbnail of 'name' fitting a 'width' x 'height' area into 'tile'.
+ * Cached thumbnails are used if large enough, otherwise the image is decoded
+ * and the cache updated. Returns zero on success, IMG_* or errno otherwise.
+ */
+static int render_tile(struct decoder *dec, const char *name,
+	unsigned int width, unsigned int height, struct sheet_tile *tile)
+{
+	struct tc_entry ent;
+	struct pixel_format rgb_pf;
+	struct stat st;
+	XImage thumb;
+	float xs, ys, scale;
+	unsigned int y, width_disp, height_disp;
+	int res;
+
+	if(stat(name, &st)) return errno;
+
+	memset(&ent, 0, sizeof(struct tc_entry));
+	if(!tc_lookup(name, &st, &ent) && tc_entry_fits(&ent, width, height)) {
+		res = dec_load_entry(dec, &ent);
+		tc_free_entry(&ent);
+	} else {
+		tc_free_entry(&ent);
+		res = dec_decode(dec, name, &ent);
+		if(!res && tc_enabled() &&
+			!tc_make_entry(&dec->image, &dec->display_pf, &ent)) {
+			tc_store(name, &st, &ent);
+			tc_free_entry(&ent);
+		}
+	}
+	if(res) return res;
+
+	/* oriented as displayed, see img_orientation_tform */
+	if(ent.tform & IMGT_ROTATE) {
+		width_disp = dec->image.height;
+		height_disp = dec->image.width;
+	} else {
+		width_disp = dec->image.width;
+		height_disp = dec->image.height;
+	}
+	xs = (float)width / width_disp;
+	ys = (float)height / height_disp;
+	scale = (xs < ys) ? xs : ys;
+	if(scale > 1.0) scale = 1.0;
+
+	if(dec_init_image(&thumb, width_disp * scale,
+		height_disp * scale, NULL)) return EINVAL;
+	if(!thumb.width || !thumb.height) return 0;
+
+	thumb.data = malloc(thumb.bytes_per_line * thumb.height);
+	tile->pixels = malloc(thumb.width * thumb.height * 3);
+	if(!thumb.data || !tile->pixels) {
+		if(thumb.data) free(thumb.data);
+		if(tile->pixels) free(tile->pixels);
+		tile->pixels = NULL;
+		return ENOMEM;
+	}
+
+	if(scale < 1.0 || ent.tform) {
+		img_blt(&dec->image, 0, 0, dec->image.width, dec->image.height,
+			&thumb, scale, ent.tform, BLTF_INTERPOLATE);
+	} else {
+		memcpy(thumb.data, dec->image.data,
+			thumb.bytes_per_line * thumb.height);
+	}
+
+	tc_init_pixel_format(&rgb_pf);
+	for(y = 0; y < thumb.height; y++) {
+		convert_rgb_pixels(tile->pixels + (y * thumb.width * 3), &rgb_pf,
+			(uint8_t*)thumb.data + (y * thumb.bytes_per_line),
+			&dec->display_pf, thumb.width);
+	}
+	free(thumb.data);
+
+	tile->width = thumb.width;
+	tile->height = thumb.height;
+	return 0;
+}
+
+/*
+ * Draw a row of 'columns' tiles starting at 'first' into 'band',
+ * which is 'width' pixels wide.
+ */
+static void compose_band(struct contact_sheet *cs, size_t first,
+	unsigned int columns, unsigned int tile_width, unsigned int tile_height,
+	uint8_t *band, unsigned long width)
+{
+	unsigned int band_height = tile_height + LABEL_MARGIN +
+		SHEET_LABEL_HEIGHT + TILE_YMARGIN;
+	unsigned int j, y;
+
+	fill_rect(band, width, 0, 0, width, band_height, SHEET_BG_PIXEL);
+
+	for(j = 0; j < columns && (first + j) < cs->files.count; j++) {
+		struct sheet_tile *tile = &cs->tiles[first + j];
+		int xpos = TILE_XMARGIN + j * (tile_width + TILE_XMARGIN);
+		const char *name;
+
+		fill_rect(band, width, xpos, 0, tile_width,
+			SHEET_BORDER, SHEET_TS_PIXEL);
+		fill_rect(band, width, xpos, 0, SHEET_BORDER,
+			tile_height, SHEET_TS_PIXEL);
+		fill_rect(band, width, xpos, tile_height - SHEET_BORDER,
+			tile_width, SHEET_BORDER, SHEET_BS_PIXEL);
+		fill_rect(band, width, xpos + tile_width - SHEET_BORDER, 0,
+			SHEET_BORDER, tile_height, SHEET_BS_PIXEL);
+
+		if(tile->pixels) {
+			int tx = xpos + (tile_width - tile->width) / 2;
+			int ty = (tile_height - tile->height) / 2;
+
+			for(y = 0; y < tile->height; y++) {
+				memcpy(band + ((ty + y) * width + tx) * 3,
+					tile->pixels + (y * tile->width * 3), tile->width * 3);
+			}
+		}
+
+		name = strrchr(cs->files.names[first + j], '/');
+		name = name ? name + 1 : cs->files.names[first + j];
+		draw_label(band, width, xpos, tile_height + LABEL_MARGIN + 1,
+			tile_width, name);
+	}
+}
+
+/* Fill a rectangle in an RGB buffer 'stride' pixels wide with 'pixel' */
+static void fill_rect(uint8_t *buf, unsigned long stride, int x, int y,
+	unsigned int width, unsigned int height, unsigned long pixel)
+{
+	unsigned int i, j;
+
+	for(i = 0; i < height; i++) {
+		uint8_t *ptr = buf + ((y + i) * stride + x) * 3;
+
+		for(j = 0; j < width; j++) {
+			*ptr++ = (pixel >> 16) & 0xFF;
+			*ptr++ = (pixel >> 8) & 0xFF;
+			*ptr++ = pixel & 0xFF;
+		}
+	}
+}
+
+/*
+ * Draw 'label' centered in a 'width' pixels wide area at 'x', 'y',
+ * shortened to fit if necessary. Characters not covered by the
+ * built-in font are drawn as question marks.
+ */
+static void draw_label(uint8_t *buf, unsigned long stride, int x, int y,
+	unsigned int width, const char *label)
+{
+	char *sz;
+	size_t i, nbytes, nchrs = 0;
+	int n, xpos;
+
+	if(!(sz = shorten_mb_string(label, width / SHEET_CHAR_ADVANCE, False)))
+		return;
+
+	nbytes = strlen(sz);
+	mblen(NULL, 0);
+	for(i = 0; i < nbytes; i += n, nchrs++) {
+		if((n = mblen(sz + i, nbytes - i)) <= 0) n = 1;
+	}
+
+	xpos = x + (width - (nchrs * SHEET_CHAR_ADVANCE - 1)) / 2;
+
+	mblen(NULL, 0);
+	for(i = 0; i < nbytes; i += n, xpos += SHEET_CHAR_ADVANCE) {
+		int c = (unsigned char)sz[i];
+		int col, row;
+
+		if((n = mblen(sz + i, nbytes - i)) <= 0) n = 1;
+		if(n > 1 || c < LBLFONT_FIRST || c > LBLFONT_LAST) c = '?';
+
+		for(col = 0; col < LBLFONT_WIDTH; col++) {
+			unsigned char bits = lblfont_bits[c - LBLFONT_FIRST][col];
+
+			for(row = 0; row < LBLFONT_HEIGHT; row++) {
+				if(bits & (1 << row)) {
+					fill_rect(buf, stride, xpos + col, y + row,
+						1, 1, SHEET_FG_PIXEL);
+				}
+			}
+		}
+	}
+	free(sz);
+}
+
+/*
+ * Create the contact sheet output file. PNG is written if the name
+ * ends with .png (and PNG support is available), PAM otherwise.
+ * Returns zero on success, IMG_* or errno code otherwise.
+ */
+static int sheet_open(struct sheet_writer *wr, const char *name,
+	unsigned long width, unsigned long height)
+{
+	const char *ext = strrchr(name, '.');
+
+	memset(wr, 0, sizeof(struct sheet_writer));
+	wr->width = width;
+
+	if(ext && !strcasecmp(ext, ".png")) {
+		#ifdef ENABLE_PNG
+		return img_png_wopen(name, width, height, &wr->png);
+		#else
+		return IMG_EUNSUP;
+		#endif
+	}
+
+	if(!(wr->file = fopen(name, "w"))) return errno;
+
+	if(fprintf(wr->file, "P7\nWIDTH %lu\nHEIGHT %lu\nDEPTH 3\n"
+		"MAXVAL 255\nTUPLTYPE RGB\nENDHDR\n", width, height) < 0) {
+		fclose(wr->file);
+		return IMG_EIO;
+	}
+	return 0;
+}
+
+/* Write 'nrows' rows of R,G,B triplets */
+static int sheet_write(struct sheet_writer *wr,
+	const uint8_t *data, unsigned long nrows)
+{
+	#ifdef ENABLE_PNG
+	if(wr->png) return img_png_write(wr->png, data, wr->width, nrows);
+	#endif
+
+	if(fwrite(data, wr->width * 3, nrows, wr->file) != nrows)
+		return IMG_EIO;
+	return 0;
+}
+
+/* Close the output file; if 'discard' is True output is incomplete */
+static int sheet_close(struct sheet_writer *wr, Boolean discard)
+{
+	#ifdef ENABLE_PNG
+	if(wr->png) return img_png_wclose(wr->png, discard);
+	#endif
+
+	return fclose(wr->file) ? IMG_EIO : 0;
+}
+
+/* Returns time in seconds elapsed since 'start' */
+static double elapsed_time(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start->tv_sec) +
+		(double)(now.tv_nsec - start->tv_nsec) / 1.0e9;
+}
+
+/*
+ * Print progress and throughput. Must be called with job->mutex locked.
+ */
+static void print_report(struct batch_job *job, double secs, Boolean final)
+{
+	unsigned long nproc = job->ndone + job->nskipped + job->nfailed;
+
+	if(secs <= 0) secs = 0.001;
+
+	printf("%s%lu/%lu files: %lu generated, %lu up to date, %lu failed; "
+		"%.1f files/s, %.2f MB/s%s\n",
+		(final && interrupted) ? "Interrupted. " : "",
+		nproc, (unsigned long)job->files.count,
+		job->ndone, job->nskipped, job->nfailed,
+		(double)job->ndone / secs,
+		(double)job->nbytes / (1024.0 * 1024.0) / secs,
+		final ? "" : "...");
+	fflush(stdout);
+}
+
+static void interrupt_handler(int sig)
+{
+	interrupted = 1;
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Headless (no X connection) batch processing.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <X11/Intrinsic.h>
+
+/* Returns True if the command line requests a batch operation */
+Boolean batch_requested(int argc, char **argv);
+
+/*
+ * Parse batch options and run the requested operation.
+ * Returns the exit status for the process.
+ */
+int batch_main(int argc, char **argv);
+
+#endif /* BATCH_H */
@@ -54,6 +54,9 @@
 #include "pathw.h"
 #include "bswap.h"
 #include "ioutil.h"
+#include "thumbcache.h"
+#include "imghash.h"
+#include "indexer.h"
 #include "debug.h"
 #include "bitmaps/wmiconb.bm"
 #include "bitmaps/wmiconb_m.bm"
@@ -78,9 +81,16 @@ static void close_cb(Widget,XtPointer,XtPointer);
 static void create_browser_menubar(struct browser_data *bd);
 static void create_tile_popup(struct browser_data *bd);
 static int read_directory(struct browser_data*);
+static void free_change_data(struct tmsg_change_data*);
+static void free_tile_image(struct browser_data*,XImage*);
 static XmString create_file_label(struct browser_data*,const char*);
 static int scanline_read_cb(unsigned long,const uint8_t*,void*);
-static float compute_scaling_factor(XImage *src, XImage *dest);
+static float compute_scaling_factor(unsigned int width,
+	unsigned int height, XImage *dest);
+static int size_buffer_image(struct loader_cb_data*,
+	unsigned long,unsigned long);
+static int load_cache_entry(struct loader_cb_data*,const struct tc_entry*);
+static void blit_thumbnail(struct loader_cb_data*,long,short);
 static void clear_selection(struct browser_data *bd);
 static void set_selection(struct browser_data*,long,long,Boolean);
 static void toggle_selection(struct browser_data*,long);
@@ -123,6 +133,12 @@ static void show_dotfiles_cb(Widget,XtPointer,XtPointer);
 static void pin_window_cb(Widget,XtPointer,XtPointer);
 static void new_window_cb(Widget,XtPointer,XtPointer);
 static void select_pattern_cb(Widget,XtPointer,XtPointer);
+static void select_similar_cb(Widget,XtPointer,XtPointer);
+static void select_duplicates_cb(Widget,XtPointer,XtPointer);
+static int build_hash_tree(struct browser_data*,struct bk_tree*);
+static void select_marked(struct browser_data*,const char*);
+static int mark_hash_cb(long,unsigned int,void*);
+static int find_hash_cb(long,unsigned int,void*);
 static void path_change_cb(Widget, void*, void*);
 static void dir_up_cb(Widget,XtPointer,XtPointer);
 static void about_cb(Widget,XtPointer,XtPointer);
@@ -438,18 +454,98 @@ static int scanline_read_cb(unsigned long iscl,
 }
 
 /*
- * Compute the scaling factor for src > dest
+ * Compute the scaling factor for a 'width' x 'height' image > dest
  */
-static float compute_scaling_factor(XImage *src, XImage *dest)
+static float compute_scaling_factor(unsigned int width,
+	unsigned int height, XImage *dest)
 {
 	float xs, ys;
-	xs=(float)dest->width/(float)src->width;
-	ys=(float)dest->height/(float)src->height;
+	xs=(float)dest->width/(float)width;
+	ys=(float)dest->height/(float)height;
 	xs=(xs>=1.0)?1.0:xs;
 	ys=(ys>=1.0)?1.0:ys;
 	return (xs<ys)?xs:ys;
 }
 
+/*
+ * Resize the intermediate buffer image, growing its storage if necessary.
+ * Returns zero on success, ENOMEM otherwise.
+ */
+static int size_buffer_image(struct loader_cb_data *cbd,
+	unsigned long width, unsigned long height)
+{
+	size_t data_size=(width*height)*app_inst.pixel_size;
+
+	if(data_size>cbd->buf_size){
+		char *new_ptr;
+		new_ptr=realloc(cbd->buf,data_size);
+		if(!new_ptr) return ENOMEM;
+		cbd->buf=new_ptr;
+		cbd->buf_size=data_size;
+	}
+	cbd->buf_image->width=width;
+	cbd->buf_image->height=height;
+	cbd->buf_image->bytes_per_line=0;
+	cbd->buf_image->data=cbd->buf;
+	XInitImage(cbd->buf_image);
+	return 0;
+}
+
+/*
+ * Convert cache entry pixels into the intermediate buffer image.
+ * Returns zero on success, ENOMEM otherwise.
+ */
+static int load_cache_entry(struct loader_cb_data *cbd,
+	const struct tc_entry *ent)
+{
+	struct pixel_format tc_pf;
+	unsigned int y;
+
+	if(size_buffer_image(cbd,ent->width,ent->height)) return ENOMEM;
+	
+	tc_init_pixel_format(&tc_pf);
+	for(y=0; y<ent->height; y++){
+		uint8_t *ptr=(uint8_t*)&cbd->buf_image->data[y*
+			cbd->buf_image->bytes_per_line];
+		const uint8_t *src=&ent->data[y*ent->width*3];
+		
+		if(app_inst.visual_info.class==PseudoColor)
+			rgb_pixels_to_clut(ptr,src,&tc_pf,ent->width);
+		else
+			convert_rgb_pixels(ptr,&cbd->display_pf,src,&tc_pf,ent->width);
+	}
+	return 0;
+}
+
+/*
+ * Scale the intermediate buffer image down to the tile image of file 'i'.
+ */
+static void blit_thumbnail(struct loader_cb_data *cbd, long i, short transform)
+{
+	struct browser_file *file=&cbd->bd->files[i];
+	unsigned int width=cbd->buf_image->width;
+	unsigned int height=cbd->buf_image->height;
+	float scale;
+	
+	/* fit it as displayed */
+	if(transform&IMGT_ROTATE){
+		width=cbd->buf_image->height;
+		height=cbd->buf_image->width;
+	}
+	scale=compute_scaling_factor(width,height,file->image);
+	file->image->width = width * scale;
+	file->image->height = height * scale;
+
+	if(!file->image->width) file->image->width = 1;
+	if(!file->image->height) file->image->height = 1;
+	file->image->bytes_per_line=0;
+	XInitImage(file->image);
+	
+	img_blt(cbd->buf_image,0,0,cbd->buf_image->width,
+		cbd->buf_image->height,file->image,
+		scale,transform,BLTF_INTERPOLATE);
+}
+
 /*
  * Image loader thread entry point.
  * Load images for tiles whose FS_PENDING state is true.
@@ -463,14 +559,17 @@ static void* loader_thread(void *data)
 	unsigned int tile_height;
 	struct loader_cb_data cbd;
 	struct thread_msg tmsg;
-	char *tmp_buf=NULL;
-	size_t tmp_buf_size=0;
+	struct tc_entry tc_ent;
 	char *path_buf;
 	short transform;
-	float scale;
 	int result=0;
 	
 	cbd.bd=bd;
+	cbd.buf=NULL;
+	cbd.buf_size=0;
+	
+	/* background indexing yields to loaders */
+	idx_suspend();
 
 	if(app_inst.visual_info.depth>8){
 		init_pixel_format(&cbd.display_pf,app_inst.pixel_size,
@@ -499,33 +598,36 @@ static void* loader_thread(void *data)
 
 	for(i=0; i<bd->nfiles && !(bd->state&BSF_LCANCEL); result=0, i++){
 		struct stat st;
-		size_t cur_data_size;
+		Boolean have_stat;
 		if(bd->files[i].state == FS_VIEWABLE) continue;
 		
 		tmsg.update_data.index=i;
 		
 		if(!bd->files[i].image){
-			char *pdata;
-			pdata=malloc(app_inst.pixel_size*(tile_width*tile_height));
+			XImage *img;
 			
-			bd->files[i].image=XCreateImage(app_inst.display,
+			img=XCreateImage(app_inst.display,
 				app_inst.visual_info.visual,
 				app_inst.visual_info.depth,ZPixmap,0,NULL,
 				tile_width,tile_height,app_inst.pixel_size,0);
-			if(bd->files[i].image && pdata){
-				bd->files[i].image->data=pdata;
-				
-				bd->files[i].image->bitmap_bit_order=
-					bd->files[i].image->byte_order=
-					(is_big_endian())?MSBFirst:LSBFirst;
-				_XInitImageFuncPtrs(bd->files[i].image);
-			
-			}else{
-				if(pdata) free(pdata);
-				if(bd->files[i].image) XDestroyImage(bd->files[i].image);
+			if(!img){
 				result=ENOMEM;
 				break;
 			}
+			/* all tiles are the same size, so pixel data comes from
+			 * fixed size slots in page sized blocks */
+			if(!bd->tile_pool.slot_size)
+				sp_init(&bd->tile_pool,img->bytes_per_line*img->height);
+			img->data=sp_alloc(&bd->tile_pool);
+			if(!img->data){
+				XDestroyImage(img);
+				result=ENOMEM;
+				break;
+			}
+			img->bitmap_bit_order=img->byte_order=
+				(is_big_endian())?MSBFirst:LSBFirst;
+			_XInitImageFuncPtrs(img);
+			bd->files[i].image=img;
 		} else {
 			bd->files[i].image->width = tile_width;
 			bd->files[i].image->height = tile_height;
@@ -533,9 +635,31 @@ static void* loader_thread(void *data)
 
 		snprintf(path_buf,bd->path_max,"%s/%s",bd->path,bd->files[i].name);
 
-		if(!stat(path_buf, &st))
-			bd->files[i].file_size = st.st_size;
+		have_stat=!stat(path_buf, &st);
+		if(have_stat) bd->files[i].file_size = st.st_size;
+
+		/* see if there's a usable thumbnail in the persistent cache */
+		if(have_stat && !tc_lookup(path_buf,&st,&tc_ent)){
+			if(tc_entry_fits(&tc_ent,
+				bd->files[i].image->width,bd->files[i].image->height) &&
+				!load_cache_entry(&cbd,&tc_ent)){
+				bd->files[i].xres=tc_ent.xres;
+				bd->files[i].yres=tc_ent.yres;
+				bd->files[i].bpp=tc_ent.bpp;
+				bd->files[i].time=tc_ent.cr_time;
+				bd->files[i].dhash=tc_ent.dhash;
+				bd->files[i].has_hash=True;
+				blit_thumbnail(&cbd,i,tc_ent.tform);
+				tc_free_entry(&tc_ent);
+				bd->files[i].state=FS_VIEWABLE;
+				bd->files[i].loader_result=0;
+				writen(bd->tnfd[TNFD_OUT], &tmsg, sizeof(struct thread_msg));
+				continue;
+			}
+			tc_free_entry(&tc_ent);
+		}
 
+		bd->files[i].has_hash=False;
 		result = img_open(path_buf, NULL, &cbd.img_file, 0);
 
 		if(result){
@@ -561,24 +685,11 @@ static void* loader_thread(void *data)
 			continue;
 		}
 			
-		cur_data_size=((cbd.img_file.width*cbd.img_file.height)*
-			app_inst.pixel_size);
-		if(cur_data_size>tmp_buf_size){
-			char *new_ptr;
-			new_ptr=realloc(tmp_buf,cur_data_size);
-			if(!new_ptr){
-				img_close(&cbd.img_file);
-				result=ENOMEM;
-				break;
-			}
-			tmp_buf=new_ptr;
-			tmp_buf_size=cur_data_size;
+		if(size_buffer_image(&cbd,cbd.img_file.width,cbd.img_file.height)){
+			img_close(&cbd.img_file);
+			result=ENOMEM;
+			break;
 		}
-		cbd.buf_image->width=cbd.img_file.width;
-		cbd.buf_image->height=cbd.img_file.height;
-		cbd.buf_image->bytes_per_line=0;
-		cbd.buf_image->data=tmp_buf;
-		XInitImage(cbd.buf_image);
 
 		bd->files[i].xres=cbd.img_file.width;
 		bd->files[i].yres=cbd.img_file.height;
@@ -598,20 +709,34 @@ static void* loader_thread(void *data)
 		result=img_read_scanlines(&cbd.img_file,scanline_read_cb,(void*)&cbd);
 		transform=cbd.img_file.tform;
 		
-		scale=compute_scaling_factor(cbd.buf_image,bd->files[i].image);
-		bd->files[i].image->width = cbd.img_file.width * scale;
-		bd->files[i].image->height = cbd.img_file.height * scale;
-
-		if(!bd->files[i].image->width) bd->files[i].image->width = 1;
-		if(!bd->files[i].image->height) bd->files[i].image->height = 1;
-		bd->files[i].image->bytes_per_line=0;
-		XInitImage(bd->files[i].image);
-		
 		img_close(&cbd.img_file);
 		if(result==0){
-			img_blt(cbd.buf_image,0,0,cbd.buf_image->width,
-				cbd.buf_image->height,bd->files[i].image,
-				scale,transform,BLTF_INTERPOLATE);
+			/* make a cache entry (RGB visuals only) with the perceptual
+			 * hash, store it in the persistent cache, and scale the tile
+			 * down from it if it's large enough */
+			if(have_stat && tc_enabled() &&
+				app_inst.visual_info.class!=PseudoColor &&
+				!tc_make_entry(cbd.buf_image,&cbd.display_pf,&tc_ent)){
+				tc_ent.xres=bd->files[i].xres;
+				tc_ent.yres=bd->files[i].yres;
+				tc_ent.bpp=bd->files[i].bpp;
+				tc_ent.cr_time=bd->files[i].time;
+				tc_ent.tform=transform;
+				bd->files[i].dhash=tc_ent.dhash;
+				bd->files[i].has_hash=True;
+				tc_store(path_buf,&st,&tc_ent);
+				if(tc_entry_fits(&tc_ent,
+					bd->files[i].image->width,bd->files[i].image->height))
+					load_cache_entry(&cbd,&tc_ent);
+				tc_free_entry(&tc_ent);
+			}
+			blit_thumbnail(&cbd,i,transform);
+			
+			/* without the cache, hash the tile, which is small already */
+			if(!bd->files[i].has_hash &&
+				app_inst.visual_info.class!=PseudoColor &&
+				!tc_image_hash(bd->files[i].image,&cbd.display_pf,
+					&bd->files[i].dhash)) bd->files[i].has_hash=True;
 			bd->files[i].state=FS_VIEWABLE;
 		}else{
 			dtrace("%s: read_scanlines failed with %d\n",
@@ -632,14 +757,21 @@ static void* loader_thread(void *data)
 	
 	pthread_mutex_unlock(&bd->data_mutex);
 	
-	if(cbd.buf_image) XDestroyImage(cbd.buf_image);
+	if(cbd.buf_image) {
+		cbd.buf_image->data=NULL;
+		XDestroyImage(cbd.buf_image);
+	}
+	if(cbd.buf) free(cbd.buf);
 	if(path_buf) free(path_buf);
 
 	pthread_mutex_lock(&bd->ldr_cond_mutex);
-	if(bd->state&BSF_LCANCEL)
+	if(bd->state&BSF_LCANCEL){
 		tmsg.code=TMSG_CANCELLED;
-	else
+	}else{
 		tmsg.code=TMSG_FINISHED;
+		if(!result && bd->idx_depth) idx_request(bd->path,bd->idx_depth);
+	}
+	idx_resume();
 	tmsg.notify_data.status=result;
 	bd->state&=(~(BSF_LOADING|BSF_LCANCEL));
 	pthread_cond_signal(&bd->ldr_cond);
@@ -663,6 +795,32 @@ static long find_file_entry(const struct browser_data *bd, const char *name)
 	return -1;
 }
 
+/*
+ * Free TMSG_ADD/REMOVE message data
+ */
+static void free_change_data(struct tmsg_change_data *cd)
+{
+	if(cd->files) free(cd->files);
+	if(cd->dirs) free(cd->dirs);
+	if(cd->names) {
+		sa_free(cd->names);
+		free(cd->names);
+	}
+	cd->files = cd->dirs = NULL;
+	cd->names = NULL;
+}
+
+/*
+ * Destroy a tile image, returning its pixel data to the tile pool
+ */
+static void free_tile_image(struct browser_data *bd, XImage *img)
+{
+	if(!img) return;
+	sp_release(&bd->tile_pool,img->data);
+	img->data=NULL;
+	XDestroyImage(img);
+}
+
 /*
  * Reads the current directory and puts/updates entries in 'bd'.
  * This routine is invoked by loader threads, so no GUI related
@@ -681,13 +839,21 @@ static int read_directory(struct browser_data *bd)
 	char **new_dirs = NULL;
 	long new_dirs_size = 0;
 	long n_new_dirs = 0;
+	struct str_arena *names;
 	struct stat st;
 	struct thread_msg tmsg;
 	time_t latest_mt=bd->latest_file_mt;
 	int res = 0;
-		
+	
+	if(!(names = malloc(sizeof(struct str_arena)))) return ENOMEM;
+	sa_init(names);
+	
 	dir=opendir(bd->path);
-	if(!dir) return errno;
+	if(!dir) {
+		res = errno;
+		free(names);
+		return res;
+	}
 
 	while((dir_ent = readdir(dir)) && !(bd->state & BSF_RCANCEL)){
 		
@@ -734,7 +900,7 @@ static int read_directory(struct browser_data *bd)
 				new_dirs = ptr;
 				new_dirs_size += FILE_LIST_GROWBY;
 			}
-			new_dirs[n_new_dirs] = strdup(dir_ent->d_name);
+			new_dirs[n_new_dirs] = sa_strdup(names, dir_ent->d_name);
 			if(!new_dirs[n_new_dirs]) {
 				res = ENOMEM;
 				break;
@@ -760,7 +926,7 @@ static int read_directory(struct browser_data *bd)
 				new_files=new_ptr;
 				new_files_size=n_new_files+FILE_LIST_GROWBY;
 			}
-			new_files[n_new_files] = strdup(dir_ent->d_name);
+			new_files[n_new_files] = sa_strdup(names, dir_ent->d_name);
 			if(!new_files[n_new_files]) {
 				res = ENOMEM;
 				break;
@@ -772,22 +938,17 @@ static int read_directory(struct browser_data *bd)
 	closedir(dir);
 	if(path_buf) free(path_buf);
 	
+	tmsg.change_data.files = new_files;
+	tmsg.change_data.nfiles = n_new_files;
+	tmsg.change_data.dirs = new_dirs;
+	tmsg.change_data.ndirs = n_new_dirs;
+	tmsg.change_data.names = names;
+
 	if(res || (bd->state&BSF_RCANCEL)) {
-		if(n_new_files){
-			while(n_new_files--) free(new_files[n_new_files]);
-			free(new_files);
-		}
-		if(n_new_dirs) {
-			while(n_new_dirs--) free(new_dirs[n_new_dirs]);
-			free(new_dirs);
-		}
+		free_change_data(&tmsg.change_data);
 		return res;
 	} else if(n_new_files || n_new_dirs){
 		tmsg.code = TMSG_ADD;
-		tmsg.change_data.files = new_files;
-		tmsg.change_data.nfiles = n_new_files;
-		tmsg.change_data.dirs = new_dirs;
-		tmsg.change_data.ndirs = n_new_dirs;
 		
 		pthread_mutex_lock(&bd->data_mutex);
 		bd->path_max = path_buf_size;
@@ -796,6 +957,8 @@ static int read_directory(struct browser_data *bd)
 
 		/* message data is freed by the handler */
 		writen(bd->tnfd[TNFD_OUT], &tmsg, sizeof(struct thread_msg));
+	} else {
+		free_change_data(&tmsg.change_data);
 	}
 	return 0;
 }
@@ -825,8 +988,18 @@ static void *reader_thread(void *data)
 		char **rem_dirs = NULL;
 		long nrem_dirs = 0;
 		long rem_dirs_size = 0;
+		struct str_arena *names;
 		Boolean modified=False;
+		
+		names=malloc(sizeof(struct str_arena));
 		path_buf=malloc(bd->path_max+1);
+		if(!names || !path_buf){
+			if(names) free(names);
+			if(path_buf) free(path_buf);
+			result=ENOMEM;
+			goto exit_thread;
+		}
+		sa_init(names);
 
 		pthread_mutex_lock(&bd->data_mutex);
 		/* check for files that may have changed */
@@ -836,7 +1009,8 @@ static void *reader_thread(void *data)
 			if(stat(path_buf,&st)!=0){
 				if(nrem_files+1>rem_files_size){
 					char **new_ptr;
-					new_ptr=realloc(rem_files,rem_files_size+FILE_LIST_GROWBY);
+					new_ptr=realloc(rem_files,sizeof(char*)*
+						(rem_files_size+FILE_LIST_GROWBY));
 					if(!new_ptr){
 						result = ENOMEM;
 						break;
@@ -844,7 +1018,7 @@ static void *reader_thread(void *data)
 					rem_files=new_ptr;
 					rem_files_size+=FILE_LIST_GROWBY;
 				}
-				rem_files[nrem_files] = strdup(bd->files[i].name);
+				rem_files[nrem_files] = sa_strdup(names, bd->files[i].name);
 				if(!rem_files[nrem_files]) {
 					result = ENOMEM;
 					break;
@@ -868,8 +1042,8 @@ static void *reader_thread(void *data)
 			if(stat(path_buf, &st) != 0){
 				if((nrem_dirs + 1) > rem_dirs_size){
 					char **new_ptr;
-					new_ptr = realloc(rem_dirs,
-						rem_dirs_size + FILE_LIST_GROWBY);
+					new_ptr = realloc(rem_dirs, sizeof(char*) *
+						(rem_dirs_size + FILE_LIST_GROWBY));
 					if(!new_ptr){
 						result = ENOMEM;
 						break;
@@ -877,7 +1051,7 @@ static void *reader_thread(void *data)
 					rem_dirs = new_ptr;
 					rem_dirs_size += FILE_LIST_GROWBY;
 				}
-				rem_dirs[nrem_dirs] = strdup(bd->subdirs[i]);
+				rem_dirs[nrem_dirs] = sa_strdup(names, bd->subdirs[i]);
 				if(!rem_dirs[nrem_dirs]) {
 					result = ENOMEM;
 					break;
@@ -889,15 +1063,19 @@ static void *reader_thread(void *data)
 		free(path_buf);
 		pthread_mutex_unlock(&bd->data_mutex);
 
+		tmsg.change_data.files = rem_files;
+		tmsg.change_data.nfiles = nrem_files;
+		tmsg.change_data.dirs = rem_dirs;
+		tmsg.change_data.ndirs = nrem_dirs;
+		tmsg.change_data.names = names;
+
 		if(!result && !(bd->state & BSF_RCANCEL)) {		
 			if(nrem_files || nrem_dirs){
 				tmsg.code = TMSG_REMOVE;
-				tmsg.change_data.files = rem_files;
-				tmsg.change_data.nfiles = nrem_files;
-				tmsg.change_data.dirs = rem_dirs;
-				tmsg.change_data.ndirs = nrem_dirs;
 				/* message data storage is freed by the handler */
 				writen(bd->tnfd[TNFD_OUT], &tmsg, sizeof(struct thread_msg));
+			} else {
+				free_change_data(&tmsg.change_data);
 			}
 			if(!stat(bd->path,&st) && difftime(st.st_mtime,bd->dir_modtime)){
 				result = read_directory(bd);
@@ -910,14 +1088,7 @@ static void *reader_thread(void *data)
 				writen(bd->tnfd[TNFD_OUT], &tmsg, sizeof(struct thread_msg));
 			}
 		} else {
-			if(rem_files) {
-				while(nrem_files--) free(rem_files[nrem_files]);
-				free(rem_files);
-			}
-			if(rem_dirs) {
-				while(nrem_dirs--) free(rem_dirs[nrem_dirs]);
-				free(rem_dirs);
-			}
+			free_change_data(&tmsg.change_data);
 		}
 
 	}else{
@@ -956,14 +1127,8 @@ static void thread_callback_proc(XtPointer data, int *pfd, XtInputId *iid)
 
 	/* if cancelled state, discard stale message and return */
 	if(bd->state&BSF_RESET){
-		if(msg.code==TMSG_ADD || msg.code==TMSG_REMOVE){
-			while(msg.change_data.nfiles--)
-				free(msg.change_data.files[msg.change_data.nfiles]);
-			free(msg.change_data.files);
-			while(msg.change_data.ndirs--)
-				free(msg.change_data.dirs[msg.change_data.ndirs]);
-			free(msg.change_data.dirs);
-		}
+		if(msg.code==TMSG_ADD || msg.code==TMSG_REMOVE)
+			free_change_data(&msg.change_data);
 		return;
 	}
 	
@@ -993,18 +1158,7 @@ static void thread_callback_proc(XtPointer data, int *pfd, XtInputId *iid)
 					nlstr(APP_MSGSET,SID_EREADDIR,
 					"Error reading directory."),False);
 
-				if(msg.change_data.nfiles) {
-					i = msg.change_data.nfiles;
-					while(i--) free(msg.change_data.files[i]);
-					free(msg.change_data.files);
-				}
-
-				if(msg.change_data.ndirs) {
-					i = msg.change_data.ndirs;
-					while(i--) free(msg.change_data.dirs[i]);
-					free(msg.change_data.dirs);
-				}
-
+				free_change_data(&msg.change_data);
 				reset_browser(bd);
 				return;
 			}
@@ -1017,15 +1171,13 @@ static void thread_callback_proc(XtPointer data, int *pfd, XtInputId *iid)
 					new_files[di].selected=False;
 					new_files[di].image=NULL;
 					new_files[di].state=FS_PENDING;
-					new_files[di].name=strdup(msg.change_data.files[i]);
+					new_files[di].has_hash=False;
+					new_files[di].name=msg.change_data.files[i];
 					label=create_file_label(bd,new_files[di].name);
 					new_files[di].label_width=XmStringWidth(
 						bd->render_table,label);
 					new_files[di].label=label;
-											
-					free(msg.change_data.files[i]);
 				}
-				free(msg.change_data.files);
 				bd->nfiles+=msg.change_data.nfiles;
 				bd->files=new_files;
 				qsort(bd->files,bd->nfiles,sizeof(struct browser_file),
@@ -1037,7 +1189,6 @@ static void thread_callback_proc(XtPointer data, int *pfd, XtInputId *iid)
 					long di = i + bd->nsubdirs;
 					new_dirs[di] = msg.change_data.dirs[i];
 				}
-				free(msg.change_data.dirs);
 			
 				bd->nsubdirs += msg.change_data.ndirs;
 				bd->subdirs = new_dirs;
@@ -1054,6 +1205,12 @@ static void thread_callback_proc(XtPointer data, int *pfd, XtInputId *iid)
 					XtWindow(bd->wdirlist),	0, 0, 0, 0, True);
 			}
 			
+			/* names now belong to the file list */
+			sa_merge(&bd->names, msg.change_data.names);
+			msg.change_data.nfiles = 0;
+			msg.change_data.ndirs = 0;
+			free_change_data(&msg.change_data);
+			
 			pthread_mutex_unlock(&bd->data_mutex);
 			
 			update_scroll_bar(bd);
@@ -1076,7 +1233,7 @@ static void thread_callback_proc(XtPointer data, int *pfd, XtInputId *iid)
 				if(bd->ifocus==j)
 					set_focus(bd,(j<bd->nfiles-1)?j:(bd->nfiles-2));
 				XmStringFree(bd->files[j].label);
-				XDestroyImage(bd->files[j].image);
+				free_tile_image(bd,bd->files[j].image);
 				if(j<bd->nfiles-1) memmove(&bd->files[j],&bd->files[j+1],
 					sizeof(struct browser_file)*((bd->nfiles-1)-j));
 				
@@ -1096,7 +1253,6 @@ static void thread_callback_proc(XtPointer data, int *pfd, XtInputId *iid)
 			for(i = 0; i < msg.change_data.ndirs; i++) {
 				for(j = 0; j < bd->nsubdirs; j++) {
 					if(!strcmp(bd->subdirs[j], msg.change_data.dirs[i])) {
-						free(bd->subdirs[j]);
 						memmove(&bd->subdirs[j], &bd->subdirs[j + 1],
 							(bd->nsubdirs - j) * sizeof(char*));
 
@@ -1111,13 +1267,7 @@ static void thread_callback_proc(XtPointer data, int *pfd, XtInputId *iid)
 			
 			pthread_mutex_unlock(&bd->data_mutex);
 			
-			for(i=0; i<msg.change_data.nfiles; i++)
-				free(msg.change_data.files[i]);
-			free(msg.change_data.files);
-			
-			for(i = 0; i < msg.change_data.ndirs; i++)
-				free(msg.change_data.dirs[i]);
-			free(msg.change_data.dirs);
+			free_change_data(&msg.change_data);
 			
 			update_scroll_bar(bd);
 			update_status_msg(bd);
@@ -1328,18 +1478,16 @@ static void reset_browser(struct browser_data *bd)
 	
 	if(bd->nfiles){
 		while(bd->nfiles--){
-			free(bd->files[bd->nfiles].name);
 			XmStringFree(bd->files[bd->nfiles].label);
-			if(bd->files[bd->nfiles].image)
-				XDestroyImage(bd->files[bd->nfiles].image);
+			free_tile_image(bd,bd->files[bd->nfiles].image);
 		}
 		free(bd->files);
 	}
 
-	if(bd->nsubdirs) {
-		while(bd->nsubdirs--) free(bd->subdirs[bd->nsubdirs]);
-		free(bd->subdirs);
-	}
+	if(bd->nsubdirs) free(bd->subdirs);
+	
+	sa_free(&bd->names);
+	sp_free(&bd->tile_pool);
 
 	bd->subdirs = NULL;
 	bd->nsubdirs = 0;
@@ -2107,6 +2255,8 @@ static void update_controls(struct browser_data *bd)
 	XtSetSensitive(get_menu_item(bd, "*goUp"), bd->path ? True : False);
 	XtSetSensitive(get_menu_item(bd, "*selectAll"), bd->nfiles);
 	XtSetSensitive(get_menu_item(bd, "*selectPattern"), bd->nfiles);
+	XtSetSensitive(get_menu_item(bd, "*selectSimilar"), bd->nsel_files);
+	XtSetSensitive(get_menu_item(bd, "*selectDuplicates"), bd->nfiles);
 	XtSetSensitive(get_menu_item(bd,"*selectNone"),bd->nsel_files);
 	XtSetSensitive(get_menu_item(bd,"*invertSelection"),bd->nsel_files);
 	XtSetSensitive(get_menu_item(bd,"*copyTo"),bd->nsel_files);
@@ -2261,7 +2411,13 @@ static void invoke_default_action(struct browser_data *bd, long i)
 			free(full_path);
 			break;
 		}
-		display_image(viewer, full_path, NULL, NULL);
+		/* the thumbnail stands in while the image is decoded */
+		if(bd->files[i].state==FS_VIEWABLE && bd->files[i].image){
+			display_image_preview(viewer, full_path, bd->files[i].image,
+				bd->files[i].xres, bd->files[i].yres);
+		}else{
+			display_image(viewer, full_path, NULL, NULL);
+		}
 		free(full_path);
 		break;
 		case FS_BROKEN:
@@ -2301,8 +2457,7 @@ static void set_tile_size(struct browser_data *bd, enum tile_preset preset)
 	
 	pthread_mutex_lock(&bd->data_mutex);
 	for(i=0; i<bd->nfiles; i++){
-		if(bd->files[i].state==FS_VIEWABLE)
-			XDestroyImage(bd->files[i].image);
+		free_tile_image(bd,bd->files[i].image);
 		bd->files[i].state=FS_PENDING;
 		bd->files[i].image=NULL;
 		XmStringFree(bd->files[i].label);
@@ -2310,6 +2465,8 @@ static void set_tile_size(struct browser_data *bd, enum tile_preset preset)
 		bd->files[i].label_width=
 			XmStringWidth(bd->render_table,bd->files[i].label);
 	}
+	/* slot size depends on tile size */
+	sp_free(&bd->tile_pool);
 	pthread_mutex_unlock(&bd->data_mutex);
 	update_scroll_bar(bd);
 	XClearArea(app_inst.display,XtWindow(bd->wview),0,0,0,0,True);
@@ -2368,6 +2525,27 @@ static void parse_res_strings(const struct app_resources *res,
 	}else{
 		bd->refresh_int=res->refresh_int*1000;
 	}
+	
+	if(res->similar_dist < 0 || res->similar_dist > MAX_HASH_DIST){
+		warning_msg("Illegal similarity threshold, using default.");
+		bd->sim_dist=DEF_SIMILAR_DIST;
+	}else{
+		bd->sim_dist=res->similar_dist;
+	}
+	
+	if(res->duplicate_dist < 0 || res->duplicate_dist > MAX_HASH_DIST){
+		warning_msg("Illegal duplicate threshold, using default.");
+		bd->dup_dist=DEF_DUPLICATE_DIST;
+	}else{
+		bd->dup_dist=res->duplicate_dist;
+	}
+	
+	if(res->index_depth < 0 || res->index_depth > IDX_MAX_DEPTH){
+		warning_msg("Illegal indexing depth, indexing disabled.");
+		bd->idx_depth=0;
+	}else{
+		bd->idx_depth=res->index_depth;
+	}
 }
 
 /*
@@ -2524,7 +2702,7 @@ static void file_proc_cb(enum file_proc_id fpid, char *file_name,
 				if(bd->ifocus==i)
 					set_focus(bd,(i<bd->nfiles-1)?i:(bd->nfiles-2));
 				XmStringFree(bd->files[i].label);
-				XDestroyImage(bd->files[i].image);
+				free_tile_image(bd,bd->files[i].image);
 				if(i<bd->nfiles-1) memmove(&bd->files[i],&bd->files[i+1],
 					sizeof(struct browser_file)*((bd->nfiles-1)-i));
 				bd->nfiles--;
@@ -2821,8 +2999,8 @@ static void rename_cb(Widget w, XtPointer client, XtPointer call)
 	}else{
 		if(bd->path_max<strlen(new_name)) bd->path_max=strlen(new_name);
 		pthread_mutex_lock(&bd->data_mutex);
-		free(bd->files[ifile].name);
-		bd->files[ifile].name=strdup(new_title);
+		/* the old name stays in the arena until the list is reset */
+		bd->files[ifile].name=sa_strdup(&bd->names,new_title);
 		XmStringFree(bd->files[ifile].label);
 		bd->files[ifile].label=create_file_label(bd,new_title);
 		bd->files[ifile].label_width=
@@ -3017,6 +3195,10 @@ static void create_browser_menubar(struct browser_data *bd)
 			invert_selection_cb},
 		{IT_PUSH, "selectPattern", "Select _Pattern...", SID_BMSELPAT,
 			select_pattern_cb },
+		{IT_PUSH, "selectSimilar", "Select _Similar", SID_BMSELSIMILAR,
+			select_similar_cb },
+		{IT_PUSH, "selectDuplicates", "Select D_uplicates", SID_BMSELDUPES,
+			select_duplicates_cb },
 		{IT_SEP},
 		{IT_PUSH,"copyTo","_Copy to ...",SID_BMCOPYTO,copy_to_cb},
 		{IT_PUSH,"moveTo","_Move to ...",SID_BMMOVETO,move_to_cb},
@@ -3167,6 +3349,135 @@ static void select_pattern_cb(Widget w, XtPointer client, XtPointer call)
 	update_controls(bd);
 }
 
+/*
+ * Adds files whose perceptual hashes are similar to any of the
+ * currently selected files to the selection.
+ */
+static void select_similar_cb(Widget w, XtPointer client, XtPointer call)
+{
+	struct browser_data *bd = (struct browser_data*)client;
+	struct bk_tree tree;
+	char *marks;
+	long i;
+	int res;
+
+	if(!bd->nsel_files) return;
+
+	if(!(marks = calloc(bd->nfiles, sizeof(char)))) {
+		errno_message_box(bd->wshell, ENOMEM, nlstr(APP_MSGSET,
+			SID_EFAILED, "The action couldn't be completed."), False);
+		return;
+	}
+
+	res = build_hash_tree(bd, &tree);
+
+	for(i = 0; i < bd->nfiles && !res; i++) {
+		if(!bd->files[i].selected || !bd->files[i].has_hash ||
+			bd->files[i].state != FS_VIEWABLE) continue;
+
+		res = bk_search(&tree, bd->files[i].dhash, bd->sim_dist,
+			mark_hash_cb, marks);
+	}
+	bk_free(&tree);
+
+	if(res) {
+		errno_message_box(bd->wshell, res, nlstr(APP_MSGSET,
+			SID_EFAILED, "The action couldn't be completed."), False);
+	} else {
+		select_marked(bd, marks);
+	}
+	free(marks);
+}
+
+/*
+ * Selects files that look the same as another file preceding them
+ * in the list, so that only one file of each group remains unselected.
+ */
+static void select_duplicates_cb(Widget w, XtPointer client, XtPointer call)
+{
+	struct browser_data *bd = (struct browser_data*)client;
+	struct bk_tree tree;
+	char *marks;
+	long i;
+	int res = 0;
+
+	if(!(marks = calloc(bd->nfiles, sizeof(char)))) {
+		errno_message_box(bd->wshell, ENOMEM, nlstr(APP_MSGSET,
+			SID_EFAILED, "The action couldn't be completed."), False);
+		return;
+	}
+
+	bk_init(&tree);
+	for(i = 0; i < bd->nfiles && !res; i++) {
+		Boolean found = False;
+
+		if(!bd->files[i].has_hash ||
+			bd->files[i].state != FS_VIEWABLE) continue;
+
+		res = bk_search(&tree, bd->files[i].dhash, bd->dup_dist,
+			find_hash_cb, &found);
+		if(found)
+			marks[i] = 1;
+		else if(!res)
+			res = bk_insert(&tree, bd->files[i].dhash, i);
+	}
+	bk_free(&tree);
+
+	if(res) {
+		errno_message_box(bd->wshell, res, nlstr(APP_MSGSET,
+			SID_EFAILED, "The action couldn't be completed."), False);
+	} else {
+		clear_selection(bd);
+		select_marked(bd, marks);
+	}
+	free(marks);
+}
+
+/*
+ * Insert perceptual hashes of all loaded files into 'tree'.
+ * Returns zero on success, errno otherwise.
+ */
+static int build_hash_tree(struct browser_data *bd, struct bk_tree *tree)
+{
+	long i;
+	int res = 0;
+
+	bk_init(tree);
+	for(i = 0; i < bd->nfiles && !res; i++) {
+		if(bd->files[i].has_hash && bd->files[i].state == FS_VIEWABLE)
+			res = bk_insert(tree, bd->files[i].dhash, i);
+	}
+	return res;
+}
+
+/* Add files flagged in 'marks' to the selection */
+static void select_marked(struct browser_data *bd, const char *marks)
+{
+	long i;
+
+	for(i = 0; i < bd->nfiles; i++) {
+		if(marks[i] && !bd->files[i].selected) {
+			bd->files[i].selected = True;
+			bd->nsel_files++;
+			redraw_tile(bd, i);
+		}
+	}
+	update_controls(bd);
+}
+
+/* BK-tree search callbacks */
+static int mark_hash_cb(long item, unsigned int dist, void *cdata)
+{
+	((char*)cdata)[item] = 1;
+	return 0;
+}
+
+static int find_hash_cb(long item, unsigned int dist, void *cdata)
+{
+	*((Boolean*)cdata) = True;
+	return 1;
+}
+
 /*
  * Primary selection converter.
  * Returns full path to the focused file, if any, to the requestor.
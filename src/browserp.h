@@ -21,6 +21,7 @@
 #endif /* ENABLE_CDE */
 #include "imgfile.h"
 #include "pixconv.h"
+#include "arena.h"
 
 /* Browser file states */
 enum file_state {
@@ -41,12 +42,14 @@ enum tile_preset{
 
 /* File info container */
 struct browser_file {
-	char *name;
-	XmString label;
-	Dimension label_width;
-	XImage *image;
+	/* fields accessed when scanning the list are kept together */
+	char *name; /* stored in browser_data.names */
 	enum file_state state;
 	Boolean selected;
+	Boolean has_hash;
+	XImage *image; /* pixel data is a browser_data.tile_pool slot */
+	XmString label;
+	Dimension label_width;
 	size_t file_size;
 	
 	/* image metadata */
@@ -55,6 +58,7 @@ struct browser_file {
 	unsigned short bpp;
 	int loader_result;
 	time_t time;
+	uint64_t dhash; /* perceptual hash, valid if has_hash is True */
 };
 
 /* Browser instance data */
@@ -98,6 +102,8 @@ struct browser_data {
 	int border_width; /* tile border width in pixels */
 	struct browser_file *files;
 	long nfiles; /* number of entries in 'files' */
+	struct str_arena names; /* file and subdirectory names */
+	struct slab_pool tile_pool; /* tile image pixel data */
 	char **subdirs; /* subdirectories */
 	long nsubdirs;
 	long nsel_files; /* number of selected files */
@@ -115,6 +121,9 @@ struct browser_data {
 	int yoffset; /* vertical scroll offset */
 	long sel_start; /* selection start index */
 	int refresh_int; /* refresh interval */
+	unsigned int sim_dist; /* max hash distance for 'Select Similar' */
+	unsigned int dup_dist; /* max hash distance for 'Select Duplicates' */
+	int idx_depth; /* background indexing depth, 0 if disabled */
 	XtIntervalId update_timer; /* modification check timer */
 	char *last_dest_dir; /* last move/copy to directory */
 	Boolean show_dot_files;
@@ -168,6 +177,8 @@ struct loader_cb_data {
 	struct img_file img_file; /* image reader handle */
 	uint8_t clut[IMG_CLUT_SIZE]; /* color lookup table for 8bpp images */
 	XImage *buf_image; /* intermediate storage for the full sized image */
+	char *buf; /* buf_image pixel data */
+	size_t buf_size;
 };
 
 /* Directory thread notification message data */
@@ -186,6 +197,7 @@ struct tmsg_change_data {
 	char **dirs;
 	long nfiles;
 	long ndirs;
+	struct str_arena *names; /* storage for 'files' and 'dirs' */
 };
 
 /* TMSG_UPDATE */
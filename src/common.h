@@ -27,6 +27,9 @@ struct app_resources {
 	int refresh_int;	/* browser refresh interval */
 	Boolean fast_pan; /* disable interpolation when panning */
 	Boolean vprog;	/* display the image while it's being loaded */
+	Boolean follow_changes; /* reload images as they're being written */
+	Boolean high_bit_depth; /* retain 16 bit samples for levels adjustment */
+	Boolean server_scaling; /* scale images with XRender if available */
 	Boolean int_up;	/* interpolate when upsampling */
 	Boolean int_down;	/* interpolate on downsampling */
 	Boolean quiet;		/* don't show warning messages */
@@ -40,6 +43,20 @@ struct app_resources {
 	Boolean show_dot_files; /* show files/dirs starting with . */
 	Boolean advance_on_del; /* advance file on delete in the viewer */
 	char *edit_cmd; /* the command to invoke for File/Edit */
+	Boolean thumb_cache; /* keep browser thumbnails in a persistent cache */
+	char *thumb_cache_dir; /* thumbnail cache location */
+	int similar_dist; /* hash distance for 'Select Similar' */
+	int duplicate_dist; /* hash distance for 'Select Duplicates' */
+	int index_depth; /* background subdirectory indexing depth */
+	int prefetch_depth; /* files to decode ahead in the viewer */
+	int prefetch_mem; /* memory cap for decoded-ahead images in MB */
+	Boolean slideshow; /* start viewers in slideshow mode */
+	int slideshow_int; /* slideshow interval in seconds */
+	char *slideshow_order; /* name, reverse or random */
+	int image_cache_size; /* decoded image cache size in MB */
+	int render_cache_size; /* per viewer rendered tile cache size in MB */
+	int large_image_size; /* image size in MB above which it's file backed */
+	char *scratch_dir; /* file backed image storage location */
 };
 
 /* defined in main.c */
@@ -65,6 +65,30 @@
 /* Directory refresh interval in seconds */
 #define DEF_REFRESH_INT 6
 
+/* Perceptual hash distance thresholds (bits out of 64) for
+ * selecting similar and duplicate images in the browser */
+#define DEF_SIMILAR_DIST 10
+#define DEF_DUPLICATE_DIST 3
+#define MAX_HASH_DIST 32
+
+/* Viewer decode-ahead defaults; memory is specified in megabytes */
+#define DEF_PREFETCH_DEPTH 1
+#define MAX_PREFETCH_DEPTH 8
+#define DEF_PREFETCH_MEM 128
+
+/* Viewer slideshow defaults; the interval is specified in seconds */
+#define DEF_SLIDESHOW_INT 5
+#define DEF_SLIDESHOW_ORDER "name"
+
+/* Default decoded image cache size in megabytes */
+#define DEF_IMAGE_CACHE_SIZE 256
+
+/* Default per viewer rendered tile cache size in megabytes */
+#define DEF_RENDER_CACHE_SIZE 32
+
+/* Default image size in megabytes above which its data is file backed */
+#define DEF_LARGE_IMAGE_SIZE 1024
+
 /* Default amount of pixels to scroll with direction keys */
 #define DEF_KEY_PAN_AMOUNT 15
 
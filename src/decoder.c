@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Client side image decoder. Images are decoded through the same
+ * img_open/pixconv pipeline the viewer uses, into XImages of the
+ * current visual's format, which are then scaled with img_blt.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include "common.h"
+#include "decoder.h"
+#include "bswap.h"
+#include "debug.h"
+
+/* Local prototypes */
+static int scanline_cb(unsigned long, const uint8_t*, void*);
+static int size_image(struct decoder*, unsigned long, unsigned long);
+static int read_image(struct decoder*, struct tc_entry*);
+static void close_file(struct decoder*);
+
+void dec_init(struct decoder *dec, volatile sig_atomic_t *cancel)
+{
+	memset(dec, 0, sizeof(struct decoder));
+	init_pixel_format(&dec->display_pf, app_inst.pixel_size,
+		app_inst.visual_info.red_mask, app_inst.visual_info.green_mask,
+		app_inst.visual_info.blue_mask, 0, 0, IMGF_BGCOLOR);
+	dec->cancel = cancel;
+}
+
+void dec_free(struct decoder *dec)
+{
+	close_file(dec);
+	if(dec->buf) free(dec->buf);
+	dec->buf = NULL;
+	dec->buf_size = 0;
+}
+
+int dec_make_thumbnail(struct decoder *dec,
+	const char *name, const struct stat *st)
+{
+	struct tc_entry ent;
+	int res;
+
+	if( (res = dec_decode(dec, name, &ent)) ) return res;
+
+	if( (res = tc_make_entry(&dec->image, &dec->display_pf, &ent)) )
+		return res;
+
+	res = tc_store(name, st, &ent);
+	tc_free_entry(&ent);
+	return res;
+}
+
+int dec_decode(struct decoder *dec, const char *name,
+	struct tc_entry *ent)
+{
+	int res;
+
+	close_file(dec);
+	if( (res = img_open(name, NULL, &dec->img_file, 0)) ) return res;
+
+	res = read_image(dec, ent);
+	img_close(&dec->img_file);
+
+	return res;
+}
+
+int dec_decode_page(struct decoder *dec, const char *name,
+	int page, struct tc_entry *ent)
+{
+	int res;
+
+	if(dec->open_name && strcmp(dec->open_name, name)) close_file(dec);
+
+	if(!dec->open_name) {
+		if( (res = img_open(name, NULL, &dec->img_file, 0)) ) return res;
+		if(!(dec->open_name = strdup(name))) {
+			img_close(&dec->img_file);
+			return ENOMEM;
+		}
+	}
+
+	/* the file may be open at a different page */
+	if(dec->img_file.npages > 1 || page) {
+		res = (page < dec->img_file.npages) ?
+			img_set_page(&dec->img_file, page) : IMG_EINVAL;
+		if(res) {
+			close_file(dec);
+			return res;
+		}
+	}
+
+	return read_image(dec, ent);
+}
+
+/*
+ * Read the current page of dec->img_file into dec->image
+ */
+static int read_image(struct decoder *dec, struct tc_entry *ent)
+{
+	int res;
+
+	res = init_pixel_format(&dec->image_pf, dec->img_file.bpp,
+		dec->img_file.red_mask, dec->img_file.green_mask,
+		dec->img_file.blue_mask, dec->img_file.alpha_mask,
+		dec->img_file.bg_pixel, dec->img_file.flags);
+
+	if(!res) res = size_image(dec, dec->img_file.width, dec->img_file.height);
+
+	if(!res && dec->img_file.format == IMG_PSEUDO)
+		res = img_read_cmap(&dec->img_file, dec->clut);
+
+	if(!res) res = img_read_scanlines(&dec->img_file, scanline_cb, dec);
+
+	ent->xres = dec->img_file.width;
+	ent->yres = dec->img_file.height;
+	ent->bpp = dec->img_file.orig_bpp;
+	ent->tform = dec->img_file.tform;
+	ent->cr_time = dec->img_file.cr_time;
+
+	return res;
+}
+
+/*
+ * Close the file kept open by dec_decode_page, if any
+ */
+static void close_file(struct decoder *dec)
+{
+	if(!dec->open_name) return;
+
+	img_close(&dec->img_file);
+	free(dec->open_name);
+	dec->open_name = NULL;
+}
+
+int dec_load_entry(struct decoder *dec, const struct tc_entry *ent)
+{
+	struct pixel_format tc_pf;
+	unsigned int y;
+
+	if(size_image(dec, ent->width, ent->height)) return ENOMEM;
+
+	tc_init_pixel_format(&tc_pf);
+	for(y = 0; y < ent->height; y++) {
+		convert_rgb_pixels((uint8_t*)&dec->image.data[y *
+			dec->image.bytes_per_line], &dec->display_pf,
+			&ent->data[y * ent->width * 3], &tc_pf, ent->width);
+	}
+	return 0;
+}
+
+XImage* dec_detach_image(struct decoder *dec)
+{
+	XImage *img;
+	char *data;
+	size_t size = dec->image.bytes_per_line * dec->image.height;
+
+	if(!dec->buf || !(img = malloc(sizeof(XImage)))) return NULL;
+
+	/* the buffer may be larger if it was used for a bigger image before */
+	if(size < dec->buf_size && (data = realloc(dec->buf, size)))
+		dec->buf = data;
+
+	memcpy(img, &dec->image, sizeof(XImage));
+	img->data = dec->buf;
+	dec->image.data = NULL;
+	dec->buf = NULL;
+	dec->buf_size = 0;
+	return img;
+}
+
+/*
+ * Scanline read callback
+ */
+static int scanline_cb(unsigned long iscl, const uint8_t *data, void *client)
+{
+	struct decoder *dec = (struct decoder*)client;
+	uint8_t *ptr = (uint8_t*)&dec->image.data[iscl *
+		dec->image.bytes_per_line];
+
+	if(dec->img_file.format == IMG_PSEUDO) {
+		clut_to_rgb_pixels(ptr, &dec->display_pf, data,
+			dec->clut, dec->img_file.width);
+	} else {
+		convert_rgb_pixels(ptr, &dec->display_pf, data,
+			&dec->image_pf, dec->img_file.width);
+	}
+
+	return (dec->cancel && *dec->cancel) ? IMG_READ_CANCEL : IMG_READ_CONT;
+}
+
+/*
+ * Set up decoder's XImage for the specified dimensions.
+ * Returns zero on success, ENOMEM otherwise.
+ */
+static int size_image(struct decoder *dec,
+	unsigned long width, unsigned long height)
+{
+	size_t data_size = width * height * (app_inst.pixel_size / 8);
+
+	if(data_size > dec->buf_size) {
+		char *new_ptr;
+
+		new_ptr = realloc(dec->buf, data_size);
+		if(!new_ptr) return ENOMEM;
+		dec->buf = new_ptr;
+		dec->buf_size = data_size;
+	}
+
+	return dec_init_image(&dec->image, width, height, dec->buf);
+}
+
+int dec_init_image(XImage *img, unsigned long width,
+	unsigned long height, char *data)
+{
+	memset(img, 0, sizeof(XImage));
+	img->width = width;
+	img->height = height;
+	img->format = ZPixmap;
+	img->data = data;
+	img->byte_order = img->bitmap_bit_order =
+		is_big_endian() ? MSBFirst : LSBFirst;
+	img->bitmap_unit = 32;
+	img->bitmap_pad = app_inst.pixel_size;
+	img->depth = app_inst.visual_info.depth;
+	img->bits_per_pixel = app_inst.pixel_size;
+	img->red_mask = app_inst.visual_info.red_mask;
+	img->green_mask = app_inst.visual_info.green_mask;
+	img->blue_mask = app_inst.visual_info.blue_mask;
+
+	return XInitImage(img) ? 0 : EINVAL;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Client side image decoder type definitions and prototypes.
+ * Decodes image files into XImages in display format without
+ * involving the X server, for use by background and batch workers.
+ */
+
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <X11/Xlib.h>
+#include "imgfile.h"
+#include "pixconv.h"
+#include "thumbcache.h"
+
+/* Decoder state; one per thread */
+struct decoder {
+	struct img_file img_file;
+	struct pixel_format image_pf;
+	struct pixel_format display_pf;
+	uint8_t clut[IMG_CLUT_SIZE];
+	XImage image;	/* decoded image, data points to buf */
+	char *buf;
+	size_t buf_size;
+	volatile sig_atomic_t *cancel; /* decoding stops if non-zero */
+	char *open_name; /* file kept open by dec_decode_page, or NULL */
+};
+
+/*
+ * Initialize 'dec' for the current visual. 'cancel' may be NULL.
+ */
+void dec_init(struct decoder *dec, volatile sig_atomic_t *cancel);
+
+/* Free storage allocated by the decoder */
+void dec_free(struct decoder *dec);
+
+/*
+ * Decode an image file into dec->image, and fill in metadata fields of 'ent'.
+ * Returns zero on success, IMG_* or errno code otherwise.
+ */
+int dec_decode(struct decoder *dec, const char *name, struct tc_entry *ent);
+
+/*
+ * Decode 'page' of an image file into dec->image, as dec_decode does.
+ * The file is kept open, so that subsequent calls for other pages of the
+ * same file don't have to open it again. It's closed once another file is
+ * decoded, or by dec_free.
+ * Returns zero on success, IMG_* or errno code otherwise.
+ */
+int dec_decode_page(struct decoder *dec, const char *name,
+	int page, struct tc_entry *ent);
+
+/*
+ * Convert a thumbnail cache entry into dec->image.
+ * Returns zero on success, ENOMEM otherwise.
+ */
+int dec_load_entry(struct decoder *dec, const struct tc_entry *ent);
+
+/*
+ * Decode an image file, downscale it and store the result in the
+ * thumbnail cache. Returns zero on success, IMG_* or errno code otherwise.
+ */
+int dec_make_thumbnail(struct decoder *dec,
+	const char *name, const struct stat *st);
+
+/*
+ * Hand over dec->image and its storage to the caller, who is responsible
+ * for destroying it with XDestroyImage. Returns NULL on failure.
+ */
+XImage* dec_detach_image(struct decoder *dec);
+
+/*
+ * Initialize a client side XImage in display format.
+ * Returns zero on success, EINVAL otherwise.
+ */
+int dec_init_image(XImage *img, unsigned long width,
+	unsigned long height, char *data);
+
+#endif /* DECODER_H */
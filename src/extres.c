@@ -95,6 +95,9 @@ static void fetch_attributes(XrmDatabase rdb, struct filter_rec *rec)
 
 unsigned int fetch_filters(struct filter_rec** const p)
 {
+	/* no resource database in headless (batch) mode */
+	if(!app_inst.display) return 0;
+
 	if(filters == NULL) {
 		unsigned int i;
 		XrmDatabase rdb = XtDatabase(app_inst.display);
@@ -10,6 +10,8 @@
 
 #include <stdlib.h>
 #include <memory.h>
+#include <errno.h>
+#include <strings.h>
 #include <inttypes.h>
 #include <math.h>
 #include "common.h"
@@ -22,6 +24,14 @@ typedef unsigned long (*get_pixel_fnc_t)(XImage*,int,int);
 typedef int (*set_pixel_fnc_t)(XImage*,int,int,unsigned long);
 
 /* Local prototypes */
+static void blt(XImage *src, unsigned int ox, unsigned int oy,
+	unsigned int del_x, unsigned int del_y, unsigned int bw, unsigned int bh,
+	XImage *dest, float scale, short transfm, short flags);
+static void tform_matrix(unsigned int tform, int m[2][2]);
+static get_pixel_fnc_t select_source_func(XImage *src, get_pixel_fnc_t get);
+static unsigned long get_pixel_clut8(XImage *img, int x, int y);
+static unsigned long get_pixel_clut1(XImage *img, int x, int y);
+static int set_index1(XImage *img, int x, int y, unsigned long index);
 #ifndef USE_XIMAGE_PIXFNC
 static void select_pixel_func(int bpp, set_pixel_fnc_t *set_fnc,
 	get_pixel_fnc_t *get_fnc);
@@ -42,10 +52,41 @@ void img_blt(XImage *src, unsigned int sxc, unsigned int syc,
 	unsigned int sw, unsigned int sh, XImage *dest,
 	float scale, short transfm, short flags)
 {
-	float int_sx, sx = 0, sy = 0;
+	/* box dimensions for decimation with sample averaging */
+	unsigned int bw = (0.5 + sw / (0.5 + sw * scale));
+	unsigned int bh = (0.5 + sh / (0.5 + sh * scale));
+
+	blt(src, ceilf((float)sxc * scale), ceilf((float)syc * scale),
+		(float)sw * scale, (float)sh * scale, bw, bh,
+		dest, scale, transfm, flags);
+}
+
+/*
+ * Transform and blit a rectangle given in scaled coordinates
+ */
+void img_blt_scaled(XImage *src, unsigned int x, unsigned int y,
+	unsigned int width, unsigned int height, XImage *dest,
+	float scale, short transfm, short flags)
+{
+	/* box size mustn't depend on the rectangle, or adjacent
+	 * rectangles wouldn't match */
+	unsigned int box = (0.5 + 1.0 / scale);
+
+	if(!box) box = 1;
+	blt(src, x, y, width, height, box, box, dest, scale, transfm, flags);
+}
+
+/*
+ * Scale the rectangle whose top-left pixel is at 'ox', 'oy' in 'src' scaled
+ * by 'scale', and 'del_x' by 'del_y' pixels in size, transform and blit it
+ * to 'dest' at 0,0. 'bw' and 'bh' specify the box size for decimation.
+ */
+static void blt(XImage *src, unsigned int ox, unsigned int oy,
+	unsigned int del_x, unsigned int del_y, unsigned int bw, unsigned int bh,
+	XImage *dest, float scale, short transfm, short flags)
+{
 	float inc = (1.0 / scale);
 	unsigned int dx = 0, dy = 0;
-	unsigned int del_x, del_y;
 	get_pixel_fnc_t get_pixel_fnc;
 	set_pixel_fnc_t set_pixel_fnc;
 	
@@ -55,17 +96,12 @@ void img_blt(XImage *src, unsigned int sxc, unsigned int syc,
 	#else
 	select_pixel_func(dest->bitmap_pad,&set_pixel_fnc,&get_pixel_fnc);
 	#endif /* USE_XIMAGE_PIXFUNC */
+	get_pixel_fnc = select_source_func(src, get_pixel_fnc);
 
 	/* Discard interpolation options for unsupported pixel formats */
 	if(app_inst.visual_info.class != TrueColor)
 		flags &= ~BLTF_INTERPOLATE;
 	
-	/* figure out initial coordinates */
-	int_sx = (ceilf((float)sxc * scale) / scale);
-	sy = (ceilf((float)syc * scale) / scale);
-	del_x = (float)sw * scale;
-	del_y = (float)sh * scale;
-	
 	/* clip source coordinates to the destination image */
 	if(transfm & IMGT_ROTATE){
 		if(del_x > dest->height) del_x = dest->height;
@@ -80,13 +116,13 @@ void img_blt(XImage *src, unsigned int sxc, unsigned int syc,
 	/*  bi-linear interpolation */
 	if((scale >= 0.5 && scale < 1.0) ||
 		((scale > 1.0) && (flags & BLTF_INT_UP))){
-		for(dy = 0, sx = int_sx; dy < del_y; dy++){
+		for(dy = 0; dy < del_y; dy++){
 			#ifdef ENABLE_OMP
 			#pragma omp parallel for firstprivate(dy)
 			#endif
 			for(dx = 0; dx < del_x; dx++){
-				float fsx = sx + (dx * inc);
-				float fsy = sy + (dy * inc);
+				float fsx = (ox + dx) * inc;
+				float fsy = (oy + dy) * inc;
 				float fx = fsx - floorf(fsx);
 				float fy = fsy - floorf(fsy);
 				unsigned int csx = (fsx + 1 < src->width) ? ceilf(fsx):fsx;
@@ -129,8 +165,6 @@ void img_blt(XImage *src, unsigned int sxc, unsigned int syc,
 		}
 	}else if((flags & BLTF_INT_DOWN) && (scale < 0.5)){
 		/* decimation with sample averaging */
-		unsigned int bw = (0.5 + sw / (0.5 + sw * scale));
-		unsigned int bh = (0.5 + sh / (0.5 + sh * scale));
 		float box = bw * bh;
 
 		/* Round up if we're sub-pixel, so we can generate thumbnails for
@@ -138,7 +172,7 @@ void img_blt(XImage *src, unsigned int sxc, unsigned int syc,
 		del_x = (del_x) ? del_x : 1;
 		del_y = (del_y) ? del_y : 1;
 
-		for(dy = 0, sx = int_sx; dy < del_y; dy++){
+		for(dy = 0; dy < del_y; dy++){
 			#ifdef ENABLE_OMP
 			#pragma omp parallel for firstprivate(dy)
 			#endif
@@ -153,8 +187,8 @@ void img_blt(XImage *src, unsigned int sxc, unsigned int syc,
 				for(by = 0; by < bh; by++){
 					for(bx = 0; bx < bw; bx++){
 						pixel = get_pixel_fnc(src,
-							sx + (inc * dx) + bx,
-							sy + (inc * dy) + by);
+							(ox + dx) * inc + bx,
+							(oy + dy) * inc + by);
 						red += (float)(pixel & src->red_mask) / box;
 						green += (float)(pixel & src->green_mask) / box;
 						blue += (float)(pixel & src->blue_mask) / box;
@@ -172,7 +206,7 @@ void img_blt(XImage *src, unsigned int sxc, unsigned int syc,
 		}
 	}else{
 		/* point sampling */
-		for(dy = 0, sx = int_sx; dy < del_y; dy++){
+		for(dy = 0; dy < del_y; dy++){
 			#ifdef ENABLE_OMP
 			#pragma omp parallel for firstprivate(dy)
 			#endif
@@ -181,7 +215,7 @@ void img_blt(XImage *src, unsigned int sxc, unsigned int syc,
 				unsigned int x, y;
 
 				pixel = get_pixel_fnc(src,
-					(sx + inc * dx), (sy + inc * dy));
+					(ox + dx) * inc, (oy + dy) * inc);
 
 				if(transfm&IMGT_HFLIP) x=(del_x-1)-dx; else x=dx;
 				if(transfm&IMGT_VFLIP) y=(del_y-1)-dy; else y=dy;
@@ -192,6 +226,107 @@ void img_blt(XImage *src, unsigned int sxc, unsigned int syc,
 	}
 }
 
+/*
+ * Move the top-left 'width' x 'height' pixels of 'img' by 'dx', 'dy'.
+ */
+void img_scroll(XImage *img, unsigned int width, unsigned int height,
+	int dx, int dy)
+{
+	unsigned int bpp = img->bits_per_pixel / 8;
+	unsigned int adx = abs(dx), ady = abs(dy);
+	unsigned int i, n;
+	size_t len;
+	
+	dassert(width <= img->width && height <= img->height);
+	if(adx >= width || ady >= height) return;
+
+	len = (width - adx) * bpp;
+	n = height - ady;
+	
+	/* rows are processed away from the direction they are moved in */
+	for(i = 0; i < n; i++){
+		unsigned int sy = (dy > 0) ? (n - 1 - i) : (ady + i);
+		
+		memmove(img->data + (sy + dy) * img->bytes_per_line +
+			((dx > 0) ? adx : 0) * bpp,
+			img->data + sy * img->bytes_per_line +
+			((dx < 0) ? adx : 0) * bpp, len);
+	}
+}
+
+/*
+ * Copy a rectangle of 'src' into 'dest'
+ */
+void img_copy_rect(XImage *src, unsigned int sx, unsigned int sy,
+	unsigned int width, unsigned int height, XImage *dest,
+	unsigned int dx, unsigned int dy)
+{
+	unsigned int bpp = dest->bits_per_pixel / 8;
+	unsigned int i;
+	
+	dassert(src->bits_per_pixel == dest->bits_per_pixel);
+	dassert(sx + width <= src->width && sy + height <= src->height);
+	dassert(dx + width <= dest->width && dy + height <= dest->height);
+
+	for(i = 0; i < height; i++){
+		memcpy(dest->data + (dy + i) * dest->bytes_per_line + dx * bpp,
+			src->data + (sy + i) * src->bytes_per_line + sx * bpp,
+			width * bpp);
+	}
+}
+
+/*
+ * Reduce 'src' to half its size into 'dest'.
+ * Odd trailing rows/columns are averaged with themselves.
+ */
+void img_halve(XImage *src, XImage *dest)
+{
+	unsigned int dx, dy;
+	get_pixel_fnc_t get_pixel_fnc;
+	set_pixel_fnc_t set_pixel_fnc;
+	
+	#ifdef USE_XIMAGE_PIXFNC
+	get_pixel_fnc=src->f.get_pixel;
+	set_pixel_fnc=dest->f.put_pixel;
+	#else
+	select_pixel_func(dest->bitmap_pad,&set_pixel_fnc,&get_pixel_fnc);
+	#endif /* USE_XIMAGE_PIXFUNC */
+	get_pixel_fnc = select_source_func(src, get_pixel_fnc);
+
+	dassert(dest->width == (src->width + 1) / 2 &&
+		dest->height == (src->height + 1) / 2);
+
+	for(dy = 0; dy < dest->height; dy++){
+		unsigned int sy0 = dy * 2;
+		unsigned int sy1 = (sy0 + 1 < src->height) ? sy0 + 1 : sy0;
+
+		#ifdef ENABLE_OMP
+		#pragma omp parallel for firstprivate(dy)
+		#endif
+		for(dx = 0; dx < dest->width; dx++){
+			unsigned int sx0 = dx * 2;
+			unsigned int sx1 = (sx0 + 1 < src->width) ? sx0 + 1 : sx0;
+			unsigned long psrc[4];
+			uint64_t red, green, blue;
+			unsigned int i;
+
+			psrc[0] = get_pixel_fnc(src, sx0, sy0);
+			psrc[1] = get_pixel_fnc(src, sx1, sy0);
+			psrc[2] = get_pixel_fnc(src, sx0, sy1);
+			psrc[3] = get_pixel_fnc(src, sx1, sy1);
+
+			for(red = green = blue = 0, i = 0; i < 4; i++){
+				red += psrc[i] & src->red_mask;
+				green += psrc[i] & src->green_mask;
+				blue += psrc[i] & src->blue_mask;
+			}
+			set_pixel_fnc(dest, dx, dy,
+				((unsigned long)(red / 4) & dest->red_mask) |
+				((unsigned long)(green / 4) & dest->green_mask) |
+				((unsigned long)(blue / 4) & dest->blue_mask));
+		}
+	}
+}
 
 /*
  * Fill given rectangle in ximage with a pixel value.
@@ -208,6 +343,8 @@ void img_fill_rect(XImage *img, unsigned int x, unsigned int y,
 	#else
 	select_pixel_func(img->bitmap_pad,&set_pixel_fnc,NULL);
 	#endif /* USE_XIMAGE_PIXFNC */
+	if(IMG_IS_COMPACT(img) && img->bits_per_pixel == 1)
+		set_pixel_fnc=set_index1;
 
 	for(cy=y; cy<height; cy++){
 		for(cx=x; cx<width; cx++){
@@ -216,6 +353,175 @@ void img_fill_rect(XImage *img, unsigned int x, unsigned int y,
 	}
 }
 
+int img_init_compact(XImage *img, unsigned long width,
+	unsigned long height, int depth)
+{
+	dassert(depth == 8 || depth == 1);
+
+	/* the bit order is that of get_pixel_clut1 */
+	memset(img, 0, sizeof(XImage));
+	img->width = width;
+	img->height = height;
+	img->format = ZPixmap;
+	img->byte_order = img->bitmap_bit_order = MSBFirst;
+	img->bitmap_unit = 8;
+	img->bitmap_pad = 8;
+	img->depth = depth;
+	img->bits_per_pixel = depth;
+	/* as expanded by the blitter */
+	img->red_mask = app_inst.visual_info.red_mask;
+	img->green_mask = app_inst.visual_info.green_mask;
+	img->blue_mask = app_inst.visual_info.blue_mask;
+	if(!XInitImage(img)) return EINVAL;
+
+	img->obdata = calloc(IMG_COMPACT_CLUT_SIZE, sizeof(unsigned long));
+	return img->obdata ? 0 : ENOMEM;
+}
+
+void img_put_compact_row(XImage *img, unsigned int y, const uint8_t *data)
+{
+	uint8_t *ptr = (uint8_t*)&img->data[img->bytes_per_line * y];
+	unsigned int x;
+
+	dassert(IMG_IS_COMPACT(img) && y < img->height);
+	
+	if(img->bits_per_pixel == 8) {
+		memcpy(ptr, data, img->width);
+		return;
+	}
+	memset(ptr, 0, img->bytes_per_line);
+	for(x = 0; x < img->width; x++) {
+		if(data[x] & 0x80) ptr[x >> 3] |= (0x80 >> (x & 7));
+	}
+}
+
+unsigned long img_nearest_index(XImage *img, unsigned long pixel)
+{
+	const unsigned long *clut = (unsigned long*)img->obdata;
+	const unsigned long masks[3] = {
+		img->red_mask, img->green_mask, img->blue_mask
+	};
+	unsigned long i, n = 1UL << img->bits_per_pixel;
+	unsigned long best = 0, best_dist = (unsigned long)-1;
+
+	for(i = 0; i < n; i++) {
+		unsigned long dist = 0;
+		unsigned int c;
+
+		for(c = 0; c < 3; c++) {
+			int shift = ffs(masks[c]) - 1;
+			long d = (long)((clut[i] & masks[c]) >> shift) -
+				(long)((pixel & masks[c]) >> shift);
+			
+			dist += labs(d);
+		}
+		if(dist < best_dist) {
+			best_dist = dist;
+			best = i;
+		}
+	}
+	return best;
+}
+
+/*
+ * Transforms are combined as matrices mapping source to destination
+ * axes, see tform_matrix.
+ */
+unsigned int img_combine_tform(unsigned int first, unsigned int second)
+{
+	int a[2][2], b[2][2], m[2][2];
+	unsigned int i, j;
+
+	tform_matrix(first, a);
+	tform_matrix(second, b);
+	for(i = 0; i < 2; i++) {
+		for(j = 0; j < 2; j++)
+			m[i][j] = b[i][0] * a[0][j] + b[i][1] * a[1][j];
+	}
+	
+	if(!m[0][1]) {
+		return ((m[0][0] < 0) ? IMGT_HFLIP : 0) |
+			((m[1][1] < 0) ? IMGT_VFLIP : 0);
+	}
+	return IMGT_ROTATE | ((m[1][0] < 0) ? IMGT_HFLIP : 0) |
+		((m[0][1] > 0) ? IMGT_VFLIP : 0);
+}
+
+unsigned int img_invert_tform(unsigned int tform)
+{
+	unsigned int inv;
+	
+	/* there's just eight of them */
+	for(inv = 0; inv < 8; inv++) {
+		if(!img_combine_tform(tform, inv)) break;
+	}
+	return inv;
+}
+
+/*
+ * Set 'm' to the matrix mapping source to destination axes, as blt does:
+ * flips first, the vertical one toggled by rotation, then axes swapped.
+ */
+static void tform_matrix(unsigned int tform, int m[2][2])
+{
+	int h = (tform & IMGT_HFLIP) ? -1 : 1;
+	int v = (tform & IMGT_VFLIP) ? -1 : 1;
+	
+	if(tform & IMGT_ROTATE) {
+		m[0][0] = 0;
+		m[0][1] = -v;
+		m[1][0] = h;
+		m[1][1] = 0;
+	} else {
+		m[0][0] = h;
+		m[0][1] = 0;
+		m[1][0] = 0;
+		m[1][1] = v;
+	}
+}
+
+/*
+ * Returns the pixel function to read 'src' with, which is 'get' unless
+ * it's a compact image.
+ */
+static get_pixel_fnc_t select_source_func(XImage *src, get_pixel_fnc_t get)
+{
+	if(!IMG_IS_COMPACT(src)) return get;
+	return (src->bits_per_pixel == 1) ? get_pixel_clut1 : get_pixel_clut8;
+}
+
+/*
+ * Compact image pixel routines. Getters return display pixel values.
+ */
+static unsigned long get_pixel_clut8(XImage *img, int x, int y)
+{
+	dassert(x<img->width && y<img->height);
+	return ((unsigned long*)img->obdata)
+		[(uint8_t)img->data[img->bytes_per_line*y+x]];
+}
+
+static unsigned long get_pixel_clut1(XImage *img, int x, int y)
+{
+	uint8_t bits;
+	
+	dassert(x<img->width && y<img->height);
+	bits=img->data[img->bytes_per_line*y+(x>>3)];
+	return ((unsigned long*)img->obdata)[(bits>>(7-(x&7)))&1];
+}
+
+static int set_index1(XImage *img, int x, int y, unsigned long index)
+{
+	uint8_t *ptr;
+	
+	dassert(x<img->width && y<img->height);
+	ptr=(uint8_t*)&img->data[img->bytes_per_line*y+(x>>3)];
+	if(index&1)
+		*ptr|=(0x80>>(x&7));
+	else
+		*ptr&=~(0x80>>(x&7));
+	return 0;
+}
+
 #ifndef USE_XIMAGE_PIXFNC
 
 /*
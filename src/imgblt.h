@@ -11,6 +11,7 @@
 #ifndef IMGBLT_H
 #define IMGBLT_H
 
+#include <inttypes.h>
 #include <X11/Xlib.h>
 
 /*
@@ -20,12 +21,83 @@ void img_blt(XImage *src, unsigned int sxc, unsigned int syc,
 	unsigned int sw, unsigned int sh, XImage *dest,
 	float scale, short transfm, short flags);
 
+/*
+ * Same as img_blt, but the rectangle is specified in coordinates of 'src'
+ * scaled by 'scale'. Adjacent rectangles blitted separately are pixel
+ * exact with the same rectangles blitted at once.
+ */
+void img_blt_scaled(XImage *src, unsigned int x, unsigned int y,
+	unsigned int width, unsigned int height, XImage *dest,
+	float scale, short transfm, short flags);
+
 /*
  * Fill a rectangular area in 'img' with a pixel value.
  */
 void img_fill_rect(XImage *img, unsigned int x, unsigned int y,
 	unsigned int width, unsigned int height, unsigned long pixel);
 
+/*
+ * Reduce 'src' to half its size into 'dest' by averaging 2x2 pixel blocks.
+ * 'dest' must be (src->width+1)/2 by (src->height+1)/2 pixels.
+ */
+void img_halve(XImage *src, XImage *dest);
+
+/*
+ * Move the top-left 'width' x 'height' pixels of 'img' by 'dx', 'dy'.
+ * Pixels moved out of the area are discarded, those uncovered are left
+ * unchanged.
+ */
+void img_scroll(XImage *img, unsigned int width, unsigned int height,
+	int dx, int dy);
+
+/*
+ * Copy a 'width' x 'height' rectangle at 'sx', 'sy' in 'src' into 'dest'
+ * at 'dx', 'dy'. Both images must be in the same format.
+ */
+void img_copy_rect(XImage *src, unsigned int sx, unsigned int sy,
+	unsigned int width, unsigned int height, XImage *dest,
+	unsigned int dx, unsigned int dy);
+
+/*
+ * Initialize a compact client side image of 'depth' (8 or 1) bits per pixel.
+ * Its pixels are indices into a table of IMG_COMPACT_CLUT_SIZE display
+ * pixel values, allocated here and pointed to by 'obdata', which is freed
+ * along with the image by XDestroyImage. Compact images may be used as the
+ * source for img_blt, img_blt_scaled and img_halve, which expand pixels to
+ * the display format as they're drawn, and with img_fill_rect, which takes
+ * an index then. Data must be allocated by the caller.
+ * Returns zero on success, EINVAL or ENOMEM otherwise.
+ */
+int img_init_compact(XImage *img, unsigned long width,
+	unsigned long height, int depth);
+
+/*
+ * Store a row of 8 bit indices (or samples, thresholded in the middle,
+ * if 'img' is 1 bit deep) into compact image 'img' at 'y'.
+ */
+void img_put_compact_row(XImage *img, unsigned int y, const uint8_t *data);
+
+/*
+ * Returns the index of the color nearest to display pixel 'pixel' in
+ * compact image's 'img' table.
+ */
+unsigned long img_nearest_index(XImage *img, unsigned long pixel);
+
+/*
+ * Returns transform flags equivalent to transforming by 'first',
+ * then by 'second'.
+ */
+unsigned int img_combine_tform(unsigned int first, unsigned int second);
+
+/* Returns transform flags undoing 'tform' */
+unsigned int img_invert_tform(unsigned int tform);
+
+/* True if 'img' was initialized by img_init_compact */
+#define IMG_IS_COMPACT(img) ((img)->obdata != NULL)
+
+/* Compact image color table size */
+#define IMG_COMPACT_CLUT_SIZE 256
+
 /* Blitter flags */
 #define BLTF_INT_UP 0x0001 /* Interpolate when scaling up */
 #define BLTF_INT_DOWN 0x0002 /* Interpolate when decimating */
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Decoded image cache. Entries are kept in a list in order of use, most
+ * recent first, and evicted from the tail when the size limit is reached.
+ * The number of entries is small, since images are large, so lookups
+ * simply walk the list.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include "imgcache.h"
+#include "debug.h"
+
+struct ic_entry {
+	char *path;
+	time_t mtime;
+	off_t size;
+	int page;
+	XImage *image;
+	size_t data_size;
+	struct ic_entry *prev;
+	struct ic_entry *next;
+};
+
+/* Local prototypes */
+static struct ic_entry* find_entry(const char*, int);
+static void unlink_entry(struct ic_entry*);
+static void free_entry(struct ic_entry*);
+
+/* Cache state, protected by ic_mutex */
+static pthread_mutex_t ic_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct ic_entry *head = NULL;
+static struct ic_entry *tail = NULL;
+static size_t cur_size = 0;
+static size_t max_size = 0;
+
+void ic_init(size_t size)
+{
+	pthread_mutex_lock(&ic_mutex);
+	max_size = size;
+	while(tail && cur_size > max_size) {
+		struct ic_entry *ent = tail;
+		unlink_entry(ent);
+		free_entry(ent);
+	}
+	pthread_mutex_unlock(&ic_mutex);
+}
+
+void ic_put(const char *path, time_t mtime, off_t size,
+	int page, XImage *img)
+{
+	struct ic_entry *ent;
+	size_t data_size = img->bytes_per_line * img->height;
+
+	pthread_mutex_lock(&ic_mutex);
+
+	/* replace outdated entry, if any */
+	if( (ent = find_entry(path, page)) ) {
+		unlink_entry(ent);
+		free_entry(ent);
+	}
+
+	if(data_size > max_size) {
+		pthread_mutex_unlock(&ic_mutex);
+		XDestroyImage(img);
+		return;
+	}
+
+	if( (ent = malloc(sizeof(struct ic_entry))) ) {
+		if(!(ent->path = strdup(path))) {
+			free(ent);
+			ent = NULL;
+		}
+	}
+	if(!ent) {
+		pthread_mutex_unlock(&ic_mutex);
+		XDestroyImage(img);
+		return;
+	}
+
+	while(tail && (cur_size + data_size) > max_size) {
+		struct ic_entry *lru = tail;
+		unlink_entry(lru);
+		free_entry(lru);
+	}
+
+	ent->mtime = mtime;
+	ent->size = size;
+	ent->page = page;
+	ent->image = img;
+	ent->data_size = data_size;
+	ent->prev = NULL;
+	ent->next = head;
+	if(head) head->prev = ent;
+	else tail = ent;
+	head = ent;
+	cur_size += data_size;
+
+	pthread_mutex_unlock(&ic_mutex);
+}
+
+XImage* ic_take(const char *path, time_t mtime, off_t size, int page)
+{
+	struct ic_entry *ent;
+	XImage *img = NULL;
+
+	pthread_mutex_lock(&ic_mutex);
+	if( (ent = find_entry(path, page)) ) {
+		unlink_entry(ent);
+		if(ent->mtime == mtime && ent->size == size) {
+			img = ent->image;
+			ent->image = NULL;
+		}
+		free_entry(ent);
+	}
+	pthread_mutex_unlock(&ic_mutex);
+	return img;
+}
+
+Bool ic_contains(const char *path, time_t mtime, off_t size, int page)
+{
+	struct ic_entry *ent;
+	Bool res;
+
+	pthread_mutex_lock(&ic_mutex);
+	ent = find_entry(path, page);
+	res = (ent && ent->mtime == mtime && ent->size == size);
+	pthread_mutex_unlock(&ic_mutex);
+	return res;
+}
+
+Bool ic_fits(size_t data_size)
+{
+	Bool res;
+
+	pthread_mutex_lock(&ic_mutex);
+	res = (data_size <= max_size);
+	pthread_mutex_unlock(&ic_mutex);
+	return res;
+}
+
+static struct ic_entry* find_entry(const char *path, int page)
+{
+	struct ic_entry *ent;
+
+	for(ent = head; ent; ent = ent->next) {
+		if(ent->page == page && !strcmp(ent->path, path)) break;
+	}
+	return ent;
+}
+
+static void unlink_entry(struct ic_entry *ent)
+{
+	if(ent->prev) ent->prev->next = ent->next;
+	else head = ent->next;
+	if(ent->next) ent->next->prev = ent->prev;
+	else tail = ent->prev;
+	dassert(cur_size >= ent->data_size);
+	cur_size -= ent->data_size;
+}
+
+static void free_entry(struct ic_entry *ent)
+{
+	if(ent->image) XDestroyImage(ent->image);
+	free(ent->path);
+	free(ent);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Decoded image cache prototypes.
+ * Images are cached in display format and shared by all viewers. Entries
+ * are moved in and out of the cache rather than copied, so an image being
+ * displayed is owned by its viewer, and is put back when it's done with it.
+ */
+
+#ifndef IMGCACHE_H
+#define IMGCACHE_H
+
+#include <time.h>
+#include <sys/types.h>
+#include <X11/Xlib.h>
+
+/* Set the cache size limit in bytes; zero disables the cache */
+void ic_init(size_t max_size);
+
+/*
+ * Put 'img' of page 'page' of the file 'path', as of 'mtime' and 'size',
+ * into the cache, evicting least recently used entries as necessary.
+ * The cache takes ownership of 'img', which is destroyed if it doesn't fit.
+ */
+void ic_put(const char *path, time_t mtime, off_t size,
+	int page, XImage *img);
+
+/*
+ * Remove a matching image from the cache and return it. The caller is
+ * responsible for destroying it. Returns NULL if there's no such entry.
+ */
+XImage* ic_take(const char *path, time_t mtime, off_t size, int page);
+
+/* Returns True if a matching image is in the cache */
+Bool ic_contains(const char *path, time_t mtime, off_t size, int page);
+
+/*
+ * Returns True if an image of 'data_size' bytes would be kept by ic_put,
+ * which is never the case if the cache is disabled.
+ */
+Bool ic_fits(size_t data_size);
+
+#endif /* IMGCACHE_H */
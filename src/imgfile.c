@@ -149,10 +149,10 @@ int img_open(const char *file_name, const char *type_suffix,
 		return IMG_EUNSUP;
 	
 	if(type.open_fnc) {
-		res = type.open_fnc(file_name, img, 0);
+		res = type.open_fnc(file_name, img, flags);
 		if(!img->type_str) img->type_str = type.desc;
 	}  else if(type.filter_cmd) {
-		res = img_filter_pnm(type.filter_cmd, file_name, img, 0);
+		res = img_filter_pnm(type.filter_cmd, file_name, img, flags);
 		if(type.desc) img->type_str = type.desc;
 	} else {
 		return IMG_EUNSUP;
@@ -245,6 +245,25 @@ char * const img_strerror(int img_errno)
 	return str;
 }
 
+/* Map TIFF/EXIF orientation onto transform flags */
+unsigned int img_orientation_tform(unsigned int orientation)
+{
+	/* see img_blt for how flips combine with rotation */
+	static const unsigned int tforms[] = {
+		0,								/* 1: top-left */
+		IMGT_HFLIP,						/* 2: top-right */
+		IMGT_HFLIP|IMGT_VFLIP,			/* 3: bottom-right */
+		IMGT_VFLIP,						/* 4: bottom-left */
+		IMGT_ROTATE|IMGT_VFLIP,			/* 5: left-top */
+		IMGT_ROTATE,					/* 6: right-top */
+		IMGT_ROTATE|IMGT_HFLIP,			/* 7: right-bottom */
+		IMGT_ROTATE|IMGT_HFLIP|IMGT_VFLIP	/* 8: left-bottom */
+	};
+	
+	if(orientation<1 || orientation>8) return 0;
+	return tforms[orientation-1];
+}
+
 static int img_type_rec_compare(const struct img_type_rec *a,
 	const struct img_type_rec *b)
 {
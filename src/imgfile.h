@@ -27,6 +27,16 @@
 /* Pixel format flags */
 #define IMGF_PMALPHA	1	/* pixel values are premultiplied with alpha */
 #define IMGF_BGCOLOR	2	/* image has background color */
+#define IMGF_WIDE		4	/* scanlines contain 16 bit samples (see below) */
+
+/*
+ * img_open flags
+ * IMG_OPEN_WIDE requests 16 bit samples to be delivered as they are, if
+ * the loader supports it. It sets IMGF_WIDE then, and scanlines contain
+ * full range samples in host byte order, while bpp and masks describe the
+ * pixel format as if samples were reduced to 8 bits.
+ */
+#define IMG_OPEN_WIDE	1
 
 /* Default color lookup table size */
 #define IMG_CLUT_SIZE	768
@@ -72,6 +82,8 @@ struct img_file {
 	int (*read_cmap_fnc)(struct img_file*,void*);
 	int (*read_scanlines_fnc)(struct img_file*,img_scanline_cbt,void *cdata);
 	int (*set_page_fnc)(struct img_file*,unsigned int);
+	int (*reduce_fnc)(struct img_file*,unsigned long,unsigned long);
+	int (*skip_scanlines_fnc)(struct img_file*,unsigned long);
 };
 
 /* Return values for the public imgfile functions */
@@ -109,6 +121,13 @@ int img_open(const char *file_name, const char *type_suffix,
 /* Retrieve descriptive text for an IMG error code */
 char * const img_strerror(int img_errno);
 
+/*
+ * Returns IMGT_* flags that display an image stored with TIFF/EXIF
+ * Orientation tag value 'orientation' upright. Loaders set img_file.tform
+ * to it, rather than reordering pixels.
+ */
+unsigned int img_orientation_tform(unsigned int orientation);
+
 /* Inlines for calling the loader assigned functions */
 static inline int img_read_cmap(struct img_file *img, void *buf){
 	if(!img->read_cmap_fnc) return IMG_EINVAL;
@@ -126,6 +145,30 @@ static inline int img_set_page(struct img_file *img, unsigned int page){
 	return img->set_page_fnc(img, page);
 }
 
+/*
+ * Request the current page to be read at the lowest resolution available
+ * that's no less than 'width' x 'height'. Must be called before reading
+ * scanlines. Image width and height are updated to what will be read.
+ * Returns IMG_EINVAL if the loader can't read reduced resolution images.
+ */
+static inline int img_reduce(struct img_file *img,
+	unsigned long width, unsigned long height){
+	if(!img->reduce_fnc) return IMG_EINVAL;
+	return img->reduce_fnc(img, width, height);
+}
+
+/*
+ * Have the next read_scanlines call start with scanline 'nscl', so that
+ * reading of a file that's still being written can be resumed. Scanlines
+ * are counted in the order read_scanlines delivers them. Returns IMG_EINVAL
+ * if the loader can't skip scanlines without decoding them.
+ */
+static inline int img_skip_scanlines(struct img_file *img,
+	unsigned long nscl){
+	if(!img->skip_scanlines_fnc) return IMG_EINVAL;
+	return img->skip_scanlines_fnc(img, nscl);
+}
+
 static inline void img_close(struct img_file *img){
 	img->close_fnc(img);
 }
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Perceptual image hashing and a BK-tree for Hamming distance queries.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "imghash.h"
+
+/* dHash sampling grid; one extra column for horizontal differences */
+#define DHASH_COLS	9
+#define DHASH_ROWS	8
+
+#define BK_GROWBY	256
+
+uint64_t img_dhash(const uint8_t *data,
+	unsigned int width, unsigned int height)
+{
+	uint64_t cells[DHASH_ROWS][DHASH_COLS];
+	uint64_t hash = 0;
+	unsigned int cx, cy, x, y;
+
+	/* average luminance (x1000) of each grid cell */
+	for(cy = 0; cy < DHASH_ROWS; cy++) {
+		unsigned int y0 = (cy * height) / DHASH_ROWS;
+		unsigned int y1 = ((cy + 1) * height) / DHASH_ROWS;
+
+		if(y0 >= height) y0 = height - 1;
+		if(y1 <= y0) y1 = y0 + 1;
+
+		for(cx = 0; cx < DHASH_COLS; cx++) {
+			unsigned int x0 = (cx * width) / DHASH_COLS;
+			unsigned int x1 = ((cx + 1) * width) / DHASH_COLS;
+			uint64_t sum = 0;
+
+			if(x0 >= width) x0 = width - 1;
+			if(x1 <= x0) x1 = x0 + 1;
+
+			for(y = y0; y < y1; y++) {
+				const uint8_t *p = data + (y * width + x0) * 3;
+
+				for(x = x0; x < x1; x++, p += 3)
+					sum += p[0] * 299 + p[1] * 587 + p[2] * 114;
+			}
+			cells[cy][cx] = sum / ((x1 - x0) * (y1 - y0));
+		}
+	}
+
+	for(cy = 0; cy < DHASH_ROWS; cy++) {
+		for(cx = 0; cx < (DHASH_COLS - 1); cx++) {
+			hash <<= 1;
+			if(cells[cy][cx] < cells[cy][cx + 1]) hash |= 1;
+		}
+	}
+	return hash;
+}
+
+unsigned int hash_distance(uint64_t a, uint64_t b)
+{
+	uint64_t v = a ^ b;
+
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (unsigned int)((v * 0x0101010101010101ULL) >> 56);
+}
+
+void bk_init(struct bk_tree *tree)
+{
+	memset(tree, 0, sizeof(struct bk_tree));
+}
+
+int bk_insert(struct bk_tree *tree, uint64_t hash, long item)
+{
+	struct bk_node *node;
+	long i, cur;
+
+	if(tree->count == tree->size) {
+		struct bk_node *new_ptr;
+
+		new_ptr = realloc(tree->nodes,
+			sizeof(struct bk_node) * (tree->size + BK_GROWBY));
+		if(!new_ptr) return ENOMEM;
+		tree->nodes = new_ptr;
+		tree->size += BK_GROWBY;
+	}
+
+	i = tree->count++;
+	node = &tree->nodes[i];
+	node->hash = hash;
+	node->item = item;
+	node->child = node->sibling = node->same = -1;
+	node->dist = 0;
+
+	if(i == 0) return 0;
+
+	for(cur = 0; ; ) {
+		struct bk_node *parent = &tree->nodes[cur];
+		unsigned int dist = hash_distance(hash, parent->hash);
+		long c;
+
+		/* identical hashes are chained, so that large sets of
+		 * duplicates don't degrade the tree into a list */
+		if(!dist) {
+			node->same = parent->same;
+			parent->same = i;
+			return 0;
+		}
+
+		for(c = parent->child; c != -1; c = tree->nodes[c].sibling) {
+			if(tree->nodes[c].dist == dist) break;
+		}
+		if(c == -1) {
+			node->dist = dist;
+			node->sibling = parent->child;
+			parent->child = i;
+			return 0;
+		}
+		cur = c;
+	}
+}
+
+int bk_search(const struct bk_tree *tree, uint64_t hash,
+	unsigned int max_dist, bk_search_cbt cb, void *cdata)
+{
+	long *stack;
+	long top = 0;
+
+	if(!tree->count) return 0;
+
+	/* each node is pushed at most once */
+	if(!(stack = malloc(sizeof(long) * tree->count))) return ENOMEM;
+	stack[top++] = 0;
+
+	while(top) {
+		long n = stack[--top];
+		const struct bk_node *node = &tree->nodes[n];
+		unsigned int dist = hash_distance(hash, node->hash);
+		long c;
+
+		if(dist <= max_dist) {
+			for(c = n; c != -1; c = tree->nodes[c].same) {
+				if(cb(tree->nodes[c].item, dist, cdata)) {
+					free(stack);
+					return 0;
+				}
+			}
+		}
+
+		/* by the triangle inequality, matches may only be found in
+		 * subtrees within max_dist of the distance to this node */
+		for(c = node->child; c != -1; c = tree->nodes[c].sibling) {
+			unsigned int d = tree->nodes[c].dist;
+
+			if(d + max_dist >= dist && d <= dist + max_dist)
+				stack[top++] = c;
+		}
+	}
+	free(stack);
+	return 0;
+}
+
+void bk_free(struct bk_tree *tree)
+{
+	if(tree->nodes) free(tree->nodes);
+	memset(tree, 0, sizeof(struct bk_tree));
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Perceptual image hashing and BK-tree type definitions and prototypes.
+ */
+
+#ifndef IMGHASH_H
+#define IMGHASH_H
+
+#include <inttypes.h>
+
+/* BK-tree node */
+struct bk_node {
+	uint64_t hash;
+	long item;		/* caller supplied item index */
+	long child;		/* first child node, -1 if none */
+	long sibling;	/* next node with the same parent, -1 if none */
+	long same;		/* next node with an identical hash, -1 if none */
+	unsigned int dist;	/* distance to the parent node */
+};
+
+/* BK-tree container; nodes are kept in a single vector */
+struct bk_tree {
+	struct bk_node *nodes;
+	long count;
+	long size;
+};
+
+/*
+ * Search callback; 'item' is within the requested distance 'dist'.
+ * Returns zero to continue searching, non-zero to stop.
+ */
+typedef int (*bk_search_cbt)(long item, unsigned int dist, void *cdata);
+
+/*
+ * Compute a 64 bit difference hash (dHash) of 'width' x 'height' R,G,B byte
+ * triplets. Similar looking images yield hashes with small Hamming distance,
+ * regardless of their size.
+ */
+uint64_t img_dhash(const uint8_t *data,
+	unsigned int width, unsigned int height);
+
+/* Returns the number of bits in which 'a' and 'b' differ */
+unsigned int hash_distance(uint64_t a, uint64_t b);
+
+void bk_init(struct bk_tree *tree);
+
+/*
+ * Insert 'hash' for the caller's 'item' into the tree.
+ * Returns zero on success, ENOMEM otherwise.
+ */
+int bk_insert(struct bk_tree *tree, uint64_t hash, long item);
+
+/*
+ * Invoke 'cb' for each item whose hash is within 'max_dist' of 'hash'.
+ * Returns zero on success, ENOMEM otherwise.
+ */
+int bk_search(const struct bk_tree *tree, uint64_t hash,
+	unsigned int max_dist, bk_search_cbt cb, void *cdata);
+
+/* Free storage and reset the tree to empty state */
+void bk_free(struct bk_tree *tree);
+
+#endif /* IMGHASH_H */
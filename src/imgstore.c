@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Image data storage. File backed data is mapped from a sparse, unlinked
+ * scratch file, so untouched pages take neither memory nor disk space, and
+ * the file goes away with the mapping, even if the application crashes.
+ * If built with ENABLE_FALLOCATE, space is reserved up front instead, so
+ * that a full scratch file system fails allocation rather than raise
+ * SIGBUS once the mapping is written to.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include "imgstore.h"
+#include "debug.h"
+
+#define SCRATCH_TEMPLATE "ximaging.XXXXXX"
+
+/* Local prototypes */
+static int map_data(XImage *img, size_t size);
+static int destroy_mapped(XImage *img);
+
+static char *scratch_dir = NULL;
+static size_t map_threshold = 0;
+
+void ims_init(const char *dir, size_t threshold)
+{
+	if(!dir || !dir[0]) {
+		dir = getenv("TMPDIR");
+		if(!dir || !dir[0]) dir = "/tmp";
+	}
+	if(scratch_dir) free(scratch_dir);
+	scratch_dir = strdup(dir);
+	map_threshold = scratch_dir ? threshold : 0;
+}
+
+int ims_alloc_data(XImage *img)
+{
+	size_t size = (size_t)img->bytes_per_line * img->height;
+
+	dassert(img->data == NULL);
+
+	/* fall back to the heap if the scratch file can't be set up */
+	if(map_threshold && size > map_threshold && !map_data(img, size))
+		return 0;
+
+	img->data = calloc(1, size);
+	return img->data ? 0 : ENOMEM;
+}
+
+Bool ims_is_mapped(const XImage *img)
+{
+	return (img->f.destroy_image == destroy_mapped);
+}
+
+/*
+ * Map a scratch file of 'size' bytes as 'img' data
+ */
+static int map_data(XImage *img, size_t size)
+{
+	char *name;
+	void *data;
+	int fd, res = 0;
+
+	name = malloc(strlen(scratch_dir) + strlen(SCRATCH_TEMPLATE) + 2);
+	if(!name) return ENOMEM;
+	sprintf(name, "%s/%s", scratch_dir, SCRATCH_TEMPLATE);
+
+	fd = mkstemp(name);
+	if(fd == -1) {
+		res = errno;
+		free(name);
+		return res;
+	}
+	unlink(name);
+	free(name);
+
+	#ifdef ENABLE_FALLOCATE
+	res = posix_fallocate(fd, 0, (off_t)size);
+	/* not all file systems support it, these stay sparse */
+	if(res && res != EINVAL && res != EOPNOTSUPP) {
+		close(fd);
+		return res;
+	}
+	res = 0;
+	#endif
+
+	if(ftruncate(fd, (off_t)size) == -1) {
+		res = errno;
+		close(fd);
+		return res;
+	}
+
+	data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(data == MAP_FAILED) res = errno;
+	close(fd);
+	if(res) return res;
+
+	img->data = data;
+	img->f.destroy_image = destroy_mapped;
+	return 0;
+}
+
+/*
+ * XDestroyImage for file backed images
+ */
+static int destroy_mapped(XImage *img)
+{
+	munmap(img->data, (size_t)img->bytes_per_line * img->height);
+	img->data = NULL;
+	if(img->obdata) free(img->obdata);
+	XFree(img);
+	return 1;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Image data storage prototypes.
+ * Data of images larger than a threshold is kept in a memory mapped
+ * scratch file rather than on the heap, so that the system can page it
+ * out, and images larger than the available memory can be viewed.
+ */
+
+#ifndef IMGSTORE_H
+#define IMGSTORE_H
+
+#include <sys/types.h>
+#include <X11/Xlib.h>
+
+/*
+ * Set the scratch file directory and the size in bytes above which image
+ * data is file backed. If 'dir' is NULL, $TMPDIR or /tmp is used.
+ * A zero 'threshold' disables file backed storage.
+ */
+void ims_init(const char *dir, size_t threshold);
+
+/*
+ * Allocate zero filled data for 'img', which must have been initialized
+ * (including function pointers) with data set to NULL.
+ * File backed data is unmapped by XDestroyImage, so 'img' must not be
+ * destroyed by any other means, nor the data pointer replaced.
+ * Returns zero on success, errno otherwise.
+ */
+int ims_alloc_data(XImage *img);
+
+/* Returns True if 'img' data is file backed */
+Bool ims_is_mapped(const XImage *img);
+
+#endif /* IMGSTORE_H */
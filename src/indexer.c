@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Background subdirectory indexer. Walks subdirectories of the directory
+ * being browsed, breadth first, and generates thumbnail cache entries for
+ * images that don't have up to date ones, so that navigating down the tree
+ * shows populated grids immediately. The indexer runs at the lowest
+ * scheduling priority available, and pauses while browsers are loading.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <X11/Intrinsic.h>
+#include "common.h"
+#include "thumbcache.h"
+#include "decoder.h"
+#include "indexer.h"
+#include "debug.h"
+
+/* Directory queue entry */
+struct idx_dir {
+	char *path;
+	int level;
+};
+
+/* Directory queue */
+struct idx_queue {
+	struct idx_dir *dirs;
+	size_t first;
+	size_t count;
+	size_t size;
+};
+
+#define QUEUE_GROWBY	64
+
+/* Local prototypes */
+static void* indexer_thread(void*);
+static void index_tree(struct decoder*, const char*, int);
+static int index_dir(struct decoder*, struct idx_queue*,
+	const char*, int, int);
+static int queue_dir(struct idx_queue*, char*, int);
+static Boolean yield_point(void);
+
+/* Indexer state, protected by idx_mutex */
+static pthread_mutex_t idx_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idx_cond = PTHREAD_COND_INITIALIZER;
+static Boolean thread_running = False;
+static char *cur_path = NULL;	/* path being indexed */
+static char *req_path = NULL;	/* requested path, pending */
+static int req_depth = 0;
+static int nsuspended = 0;
+
+/* Set when a new request supersedes the current one */
+static volatile sig_atomic_t cancel_walk = 0;
+
+int idx_request(const char *path, int depth)
+{
+	pthread_attr_t attr;
+	pthread_t tid;
+	int res = 0;
+
+	/* cache entries aren't made on PseudoColor visuals */
+	if(depth <= 0 || !tc_enabled() ||
+		app_inst.visual_info.class == PseudoColor) return 0;
+	if(depth > IDX_MAX_DEPTH) depth = IDX_MAX_DEPTH;
+
+	pthread_mutex_lock(&idx_mutex);
+
+	/* already indexed or being indexed */
+	if(!req_path && cur_path && !strcmp(cur_path, path)) {
+		pthread_mutex_unlock(&idx_mutex);
+		return 0;
+	}
+
+	if(req_path) free(req_path);
+	if(!(req_path = strdup(path))) {
+		pthread_mutex_unlock(&idx_mutex);
+		return ENOMEM;
+	}
+	req_depth = depth;
+	cancel_walk = 1;
+
+	if(!thread_running) {
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		res = pthread_create(&tid, &attr, indexer_thread, NULL);
+		pthread_attr_destroy(&attr);
+		if(!res) thread_running = True;
+	}
+	pthread_cond_signal(&idx_cond);
+	pthread_mutex_unlock(&idx_mutex);
+	return res;
+}
+
+void idx_suspend(void)
+{
+	pthread_mutex_lock(&idx_mutex);
+	nsuspended++;
+	pthread_mutex_unlock(&idx_mutex);
+}
+
+void idx_resume(void)
+{
+	pthread_mutex_lock(&idx_mutex);
+	dassert(nsuspended > 0);
+	if(nsuspended) nsuspended--;
+	if(!nsuspended) pthread_cond_signal(&idx_cond);
+	pthread_mutex_unlock(&idx_mutex);
+}
+
+/*
+ * Indexer thread entry point. Waits for requests and processes them.
+ */
+static void* indexer_thread(void *data)
+{
+	struct decoder dec;
+	char *path;
+	int depth;
+
+	#ifdef SCHED_IDLE
+	{
+		struct sched_param sp;
+
+		memset(&sp, 0, sizeof(struct sched_param));
+		pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+	}
+	#endif
+
+	dec_init(&dec, &cancel_walk);
+
+	for(;;) {
+		pthread_mutex_lock(&idx_mutex);
+		while(!req_path)
+			pthread_cond_wait(&idx_cond, &idx_mutex);
+
+		path = req_path;
+		depth = req_depth;
+		req_path = NULL;
+		cancel_walk = 0;
+		if(cur_path) free(cur_path);
+		cur_path = strdup(path);
+		pthread_mutex_unlock(&idx_mutex);
+
+		dtrace("indexing %s, %d levels\n", path, depth);
+		index_tree(&dec, path, depth);
+		free(path);
+
+		/* release memory held for the largest image decoded */
+		dec_free(&dec);
+	}
+	return NULL;
+}
+
+/*
+ * Index subdirectories of 'path' breadth first, 'depth' levels deep.
+ */
+static void index_tree(struct decoder *dec, const char *path, int depth)
+{
+	struct idx_queue queue;
+	size_t i;
+
+	memset(&queue, 0, sizeof(struct idx_queue));
+
+	/* the directory itself is loaded by the browser */
+	if(!index_dir(dec, &queue, path, 0, depth)) {
+		while(queue.first < queue.count) {
+			/* the queue may be reallocated by index_dir */
+			char *dir_path = queue.dirs[queue.first].path;
+			int level = queue.dirs[queue.first].level;
+
+			queue.first++;
+			if(index_dir(dec, &queue, dir_path, level, depth)) break;
+		}
+	}
+
+	for(i = 0; i < queue.count; i++) free(queue.dirs[i].path);
+	if(queue.dirs) free(queue.dirs);
+}
+
+/*
+ * Generate thumbnails for image files in 'path', unless it's the root
+ * (level zero), and queue its subdirectories if 'level' is below 'depth'.
+ * Returns non-zero if the walk must be abandoned.
+ */
+static int index_dir(struct decoder *dec, struct idx_queue *queue,
+	const char *path, int level, int depth)
+{
+	DIR *dh;
+	struct dirent *ent;
+	struct stat st;
+	char *name;
+	int res = 0;
+
+	if(yield_point()) return 1;
+	if(!(dh = opendir(path))) return 0;
+
+	while((ent = readdir(dh))) {
+		if(ent->d_name[0] == '.') continue;
+
+		if(!(name = malloc(strlen(path) + strlen(ent->d_name) + 2))) {
+			res = ENOMEM;
+			break;
+		}
+		sprintf(name, "%s/%s", path, ent->d_name);
+
+		if(lstat(name, &st)) {
+			free(name);
+			continue;
+		}
+
+		if(S_ISDIR(st.st_mode)) {
+			if(level < depth)
+				res = queue_dir(queue, name, level + 1);
+			else
+				free(name);
+			if(res) break;
+			continue;
+		}
+
+		if(level && (S_ISREG(st.st_mode) || (S_ISLNK(st.st_mode) &&
+			!stat(name, &st) && S_ISREG(st.st_mode)))) {
+			if(yield_point()) {
+				res = 1;
+			} else if(tc_lookup(name, &st, NULL)) {
+				/* fails if it's not an image file, which is fine */
+				dec_make_thumbnail(dec, name, &st);
+			}
+		}
+		free(name);
+		if(res) break;
+	}
+	closedir(dh);
+	return res;
+}
+
+/*
+ * Append 'path' (allocated by the caller) to the queue. The queue takes
+ * ownership of 'path' in any case. Returns zero on success, ENOMEM otherwise.
+ */
+static int queue_dir(struct idx_queue *queue, char *path, int level)
+{
+	if(queue->count == queue->size) {
+		struct idx_dir *new_ptr;
+
+		new_ptr = realloc(queue->dirs,
+			sizeof(struct idx_dir) * (queue->size + QUEUE_GROWBY));
+		if(!new_ptr) {
+			free(path);
+			return ENOMEM;
+		}
+		queue->dirs = new_ptr;
+		queue->size += QUEUE_GROWBY;
+	}
+	queue->dirs[queue->count].path = path;
+	queue->dirs[queue->count].level = level;
+	queue->count++;
+	return 0;
+}
+
+/*
+ * Waits while indexing is suspended.
+ * Returns True if the current walk has been superseded.
+ */
+static Boolean yield_point(void)
+{
+	Boolean cancel;
+
+	pthread_mutex_lock(&idx_mutex);
+	while(nsuspended && !req_path)
+		pthread_cond_wait(&idx_cond, &idx_mutex);
+	cancel = (req_path != NULL);
+	pthread_mutex_unlock(&idx_mutex);
+	return cancel;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Background subdirectory indexer prototypes.
+ */
+
+#ifndef INDEXER_H
+#define INDEXER_H
+
+/* Maximum indexing depth */
+#define IDX_MAX_DEPTH	8
+
+/*
+ * Generate cached thumbnails for images in subdirectories of 'path',
+ * up to 'depth' levels deep, in a low priority background thread.
+ * A new request supersedes the one in progress.
+ * Returns zero on success, errno otherwise.
+ */
+int idx_request(const char *path, int depth);
+
+/*
+ * Pause/resume indexing while foreground work is in progress.
+ * Calls nest; indexing continues once each idx_suspend is matched by
+ * an idx_resume.
+ */
+void idx_suspend(void);
+void idx_resume(void);
+
+#endif /* INDEXER_H */
@@ -25,6 +25,7 @@ struct jpeg_ld {
 	jmp_buf jmp;
 	struct jpeg_decompress_struct cinfo;
 	struct jpeg_error_mgr jerr;
+	int started; /* jpeg_start_decompress has been called */
 };
 
 /* Local prototypes */
@@ -33,6 +34,18 @@ static void error_exit (j_common_ptr cinfo);
 static void output_message (j_common_ptr cinfo);
 static int read_scanlines(struct img_file *img,
 	img_scanline_cbt cb, void *cdata);
+static int reduce(struct img_file *img,
+	unsigned long width, unsigned long height);
+static unsigned int read_orientation(j_decompress_ptr cinfo);
+static unsigned int get16(const JOCTET *p, int be);
+static unsigned int get32(const JOCTET *p, int be);
+
+/* EXIF APP1 marker signature, followed by a TIFF header */
+#define EXIF_SIG "Exif\0\0"
+#define EXIF_SIG_LEN 6
+
+/* TIFF orientation tag */
+#define EXIF_ORIENTATION 0x0112
 
 
 static int read_scanlines(struct img_file *img,
@@ -42,6 +55,13 @@ static int read_scanlines(struct img_file *img,
 	void *buf;
 	unsigned long iscl;
 	
+	/* deferred so that output scale can be set by reduce() */
+	if(!ld->started){
+		if(setjmp(ld->jmp)) return IMG_EFILE;
+		jpeg_start_decompress(&ld->cinfo);
+		ld->started=1;
+	}
+	
 	buf=malloc(ld->cinfo.output_width*ld->cinfo.output_components);
 	if(!buf) return IMG_ENOMEM;
 
@@ -60,6 +80,36 @@ static int read_scanlines(struct img_file *img,
 	return 0;
 }
 
+/*
+ * Select the smallest DCT scaling factor that yields at least
+ * 'width' x 'height' pixels.
+ */
+static int reduce(struct img_file *img,
+	unsigned long width, unsigned long height)
+{
+	struct jpeg_ld *ld=(struct jpeg_ld*)img->loader_data;
+	unsigned int denom;
+	
+	if(ld->started) return IMG_EINVAL;
+	
+	if(setjmp(ld->jmp)) return IMG_EFILE;
+	
+	for(denom=8; denom>1; denom/=2){
+		ld->cinfo.scale_num=1;
+		ld->cinfo.scale_denom=denom;
+		jpeg_calc_output_dimensions(&ld->cinfo);
+		if(ld->cinfo.output_width>=width &&
+			ld->cinfo.output_height>=height) break;
+	}
+	if(denom==1){
+		ld->cinfo.scale_denom=1;
+		jpeg_calc_output_dimensions(&ld->cinfo);
+	}
+	img->width=ld->cinfo.output_width;
+	img->height=ld->cinfo.output_height;
+	return 0;
+}
+
 int img_open_jpeg(const char *file_name, struct img_file *img, int flags)
 {
 	struct stat st;
@@ -91,6 +141,7 @@ int img_open_jpeg(const char *file_name, struct img_file *img, int flags)
 	}
 	jpeg_create_decompress(&ld->cinfo);	
 	jpeg_stdio_src(&ld->cinfo,file);
+	jpeg_save_markers(&ld->cinfo,JPEG_APP0+1,0xFFFF);
 
 	if(setjmp(ld->jmp)){
 		jpeg_destroy_decompress(&ld->cinfo);
@@ -111,17 +162,19 @@ int img_open_jpeg(const char *file_name, struct img_file *img, int flags)
 		free(ld);
 		return IMG_ENOMEM;
 	}
-	jpeg_start_decompress(&ld->cinfo);
+	jpeg_calc_output_dimensions(&ld->cinfo);
 	img->width=ld->cinfo.output_width;
 	img->height=ld->cinfo.output_height;
 	img->orig_bpp=img->bpp=ld->cinfo.output_components*8;
 	img->format=IMG_DIRECT;
 	img->cr_time=st.st_mtime;
+	img->tform=img_orientation_tform(read_orientation(&ld->cinfo));
 	img->loader_data=ld;
 	img->red_mask=0x000000FF<<(RGB_RED*8);
 	img->green_mask=0x000000FF<<(RGB_GREEN*8);
 	img->blue_mask=0x000000FF<<(RGB_BLUE*8);
 	img->read_scanlines_fnc=read_scanlines;
+	img->reduce_fnc=reduce;
 	img->close_fnc=close_image;
 	
 	return 0;
@@ -135,11 +188,64 @@ static void close_image(struct img_file *img)
 		free(ld);
 		return;
 	}
-	jpeg_finish_decompress(&ld->cinfo);	
+	if(ld->started) jpeg_finish_decompress(&ld->cinfo);
 	jpeg_destroy_decompress(&ld->cinfo);
 	longjmp(ld->jmp,1);
 }
 
+/*
+ * Returns the orientation tag value from EXIF data saved by
+ * jpeg_read_header, or zero if there's none.
+ */
+static unsigned int read_orientation(j_decompress_ptr cinfo)
+{
+	jpeg_saved_marker_ptr m;
+	
+	for(m=cinfo->marker_list; m; m=m->next){
+		const JOCTET *tiff=m->data+EXIF_SIG_LEN;
+		unsigned int len=m->data_length-EXIF_SIG_LEN;
+		unsigned int ifd, n, i;
+		int be;
+		
+		if(m->marker!=JPEG_APP0+1 || m->data_length<EXIF_SIG_LEN+8 ||
+			memcmp(m->data,EXIF_SIG,EXIF_SIG_LEN)) continue;
+		
+		/* TIFF header, either byte order */
+		if(tiff[0]=='M' && tiff[1]=='M')
+			be=1;
+		else if(tiff[0]=='I' && tiff[1]=='I')
+			be=0;
+		else
+			return 0;
+		if(get16(tiff+2,be)!=42) return 0;
+		ifd=get32(tiff+4,be);
+		if(ifd>len-2) return 0;
+		
+		/* 12 byte IFD0 entries: tag, type, count, value */
+		n=get16(tiff+ifd,be);
+		for(i=0; i<n && ifd+2+(i+1)*12<=len; i++){
+			const JOCTET *e=tiff+ifd+2+i*12;
+			
+			if(get16(e,be)==EXIF_ORIENTATION && get16(e+2,be)==3)
+				return get16(e+8,be);
+		}
+		return 0;
+	}
+	return 0;
+}
+
+/* Read TIFF words in big or little endian byte order */
+static unsigned int get16(const JOCTET *p, int be)
+{
+	return be?(((unsigned int)p[0]<<8)|p[1]):(((unsigned int)p[1]<<8)|p[0]);
+}
+
+static unsigned int get32(const JOCTET *p, int be)
+{
+	return be?((get16(p,be)<<16)|get16(p+2,be)):
+		((get16(p+2,be)<<16)|get16(p,be));
+}
+
 /* Error handler overrides */
 static void error_exit(j_common_ptr cinfo)
 {
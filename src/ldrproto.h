@@ -40,5 +40,14 @@ PROTODEF(tiff)
 int img_filter_pnm(const char *cmd_spec,
 	const char *file_name, struct img_file *img, int flags);
 
+#ifdef ENABLE_PNG
+/* in png.c; RGB output for batch operations */
+int img_png_wopen(const char *file_name, unsigned long width,
+	unsigned long height, void **handle);
+int img_png_write(void *handle, const uint8_t *data,
+	unsigned long width, unsigned long nrows);
+int img_png_wclose(void *handle, int discard);
+#endif
+
 #endif /* LDRPROTO_H */
 
@@ -29,6 +29,10 @@
 #include "tooltalk.h"
 #include "guiutil.h"
 #include "cmap.h"
+#include "batch.h"
+#include "thumbcache.h"
+#include "imgcache.h"
+#include "imgstore.h"
 #include "debug.h"
 
 /* Local prototypes */
@@ -77,6 +81,15 @@ static XtResource xrdb_resources[]={
 	{ "visualProgress","VisualProgress",XmRBoolean,sizeof(Boolean),
 		RESFIELD(vprog),XmRImmediate,(XtPointer)True
 	},
+	{ "followChanges","FollowChanges",XmRBoolean,sizeof(Boolean),
+		RESFIELD(follow_changes),XmRImmediate,(XtPointer)False
+	},
+	{ "highBitDepth","HighBitDepth",XmRBoolean,sizeof(Boolean),
+		RESFIELD(high_bit_depth),XmRImmediate,(XtPointer)False
+	},
+	{ "serverScaling","ServerScaling",XmRBoolean,sizeof(Boolean),
+		RESFIELD(server_scaling),XmRImmediate,(XtPointer)False
+	},
 	{ "lockRotation","LockRoration",XmRBoolean,sizeof(Boolean),
 		RESFIELD(keep_tform),XmRImmediate,(XtPointer)False
 	},
@@ -124,6 +137,51 @@ static XtResource xrdb_resources[]={
 	},
 	{ "advanceOnDelete","AdvanceOnDelete",XmRBoolean,sizeof(Boolean),
 		RESFIELD(advance_on_del),XmRImmediate,(XtPointer)True
+	},
+	{ "thumbnailCache","ThumbnailCache",XmRBoolean,sizeof(Boolean),
+		RESFIELD(thumb_cache),XmRImmediate,(XtPointer)True
+	},
+	{ "thumbnailCacheDir","ThumbnailCacheDir",XmRString,sizeof(char*),
+		RESFIELD(thumb_cache_dir),XmRImmediate,(XtPointer)NULL
+	},
+	{ "similarityThreshold","SimilarityThreshold",XmRInt,sizeof(int),
+		RESFIELD(similar_dist),XmRImmediate,(XtPointer)DEF_SIMILAR_DIST
+	},
+	{ "duplicateThreshold","DuplicateThreshold",XmRInt,sizeof(int),
+		RESFIELD(duplicate_dist),XmRImmediate,(XtPointer)DEF_DUPLICATE_DIST
+	},
+	{ "indexDepth","IndexDepth",XmRInt,sizeof(int),
+		RESFIELD(index_depth),XmRImmediate,(XtPointer)0
+	},
+	{ "prefetchDepth","PrefetchDepth",XmRInt,sizeof(int),
+		RESFIELD(prefetch_depth),XmRImmediate,(XtPointer)DEF_PREFETCH_DEPTH
+	},
+	{ "prefetchMemory","PrefetchMemory",XmRInt,sizeof(int),
+		RESFIELD(prefetch_mem),XmRImmediate,(XtPointer)DEF_PREFETCH_MEM
+	},
+	{ "slideshow","Slideshow",XmRBoolean,sizeof(Boolean),
+		RESFIELD(slideshow),XmRImmediate,(XtPointer)False
+	},
+	{ "slideshowInterval","SlideshowInterval",XmRInt,sizeof(int),
+		RESFIELD(slideshow_int),XmRImmediate,(XtPointer)DEF_SLIDESHOW_INT
+	},
+	{ "slideshowOrder","SlideshowOrder",XmRString,sizeof(char*),
+		RESFIELD(slideshow_order),XmRImmediate,(XtPointer)DEF_SLIDESHOW_ORDER
+	},
+	{ "imageCacheSize","ImageCacheSize",XmRInt,sizeof(int),
+		RESFIELD(image_cache_size),XmRImmediate,
+		(XtPointer)DEF_IMAGE_CACHE_SIZE
+	},
+	{ "renderCacheSize","RenderCacheSize",XmRInt,sizeof(int),
+		RESFIELD(render_cache_size),XmRImmediate,
+		(XtPointer)DEF_RENDER_CACHE_SIZE
+	},
+	{ "largeImageSize","LargeImageSize",XmRInt,sizeof(int),
+		RESFIELD(large_image_size),XmRImmediate,
+		(XtPointer)DEF_LARGE_IMAGE_SIZE
+	},
+	{ "scratchDir","ScratchDir",XmRString,sizeof(char*),
+		RESFIELD(scratch_dir),XmRImmediate,(XtPointer)NULL
 	}
 };
 #undef RESFIELD
@@ -268,6 +326,9 @@ int main(int argc, char **argv)
 		perror("Couldn't open " BASE_NAME " message catalog");
 	#endif
 	
+	/* batch operations run headless, without a display connection */
+	if(batch_requested(argc, argv)) return batch_main(argc, argv);
+	
 	XtToolkitThreadInitialize();
 	XtToolkitInitialize();
 	app_inst.context=XtCreateApplicationContext();
@@ -297,6 +358,25 @@ int main(int argc, char **argv)
 		XtNumber(xrdb_resources),NULL,0);
 	
 	init_display_globals();
+	
+	if(init_app_res.thumb_cache) {
+		int res;
+		if( (res = tc_init(init_app_res.thumb_cache_dir)) )
+			warning_msg("Thumbnail cache disabled: %s\n", strerror(res));
+	}
+	
+	if(init_app_res.image_cache_size < 0) {
+		warning_msg("Illegal value for \"ImageCacheSize\". Using default.");
+		init_app_res.image_cache_size = DEF_IMAGE_CACHE_SIZE;
+	}
+	ic_init((size_t)init_app_res.image_cache_size * 1024 * 1024);
+	
+	if(init_app_res.large_image_size < 0) {
+		warning_msg("Illegal value for \"LargeImageSize\". Using default.");
+		init_app_res.large_image_size = DEF_LARGE_IMAGE_SIZE;
+	}
+	ims_init(init_app_res.scratch_dir,
+		(size_t)init_app_res.large_image_size * 1024 * 1024);
 		
 	/* non XRDB arguments */
 	for(i = 1; i < argc; i++) {
@@ -63,12 +63,14 @@ struct bmp_ld {
 	size_t pixel_size;
 	size_t pad_size;
 	size_t scl_size;
+	unsigned long first_scl;
 };
 
 /* Local prototypes */
 static int read_scanlines(struct img_file *img,
 	img_scanline_cbt cb, void *cdata);
 static int read_cmap(struct img_file *img, void *buffer);
+static int skip_scanlines(struct img_file *img, unsigned long nscl);
 static void bswap_dstruct(struct bmp_info_hdr *ih, struct bmp_bitmasks *bm);
 static void close_image(struct img_file *img);
 static size_t fread_be(void *ptr, size_t size, size_t nmemb, FILE *file);
@@ -108,13 +110,14 @@ static int read_scanlines(struct img_file *img,
 	
 	if(is_big_endian())	read_proc=&fread_be;
 	
-	if(fseek(ld->file,ld->data_offset,SEEK_SET)== -1)
+	if(fseek(ld->file,ld->data_offset+
+		(ld->scl_size+ld->pad_size)*ld->first_scl,SEEK_SET)== -1)
 		return IMG_EFILE;
 	
 	buffer=malloc(ld->scl_size);
 	if(!buffer) return IMG_ENOMEM;
 	
-	for(i=0; i<img->height; i++){
+	for(i=ld->first_scl; i<img->height; i++){
 		read=read_proc(buffer,1,ld->scl_size,ld->file);
 		fseek(ld->file,ld->pad_size,SEEK_CUR);
 		if(read<ld->scl_size){
@@ -123,10 +126,21 @@ static int read_scanlines(struct img_file *img,
 		}
 		if((*cb)(i,buffer,cdata)==IMG_READ_CANCEL) break;
 	}
+	free(buffer);
 
 	return res;
 }
 
+/* Data is uncompressed, so read_scanlines can just seek past 'nscl' */
+static int skip_scanlines(struct img_file *img, unsigned long nscl)
+{
+	struct bmp_ld *ld=(struct bmp_ld*)img->loader_data;
+	
+	if(nscl>img->height) return IMG_EINVAL;
+	ld->first_scl=nscl;
+	return 0;
+}
+
 /* Read multiword values converting them to big endian */
 static size_t fread_be(void *ptr, size_t size, size_t nmemb, FILE *file)
 {
@@ -267,6 +281,7 @@ int img_open_bmp(char *file_name, struct img_file *img)
 	img->tform=(ih.height>0)?IMGT_VFLIP:0;
 	img->loader_data=(void*)ld;
 	img->read_scanlines_fnc=&read_scanlines;
+	img->skip_scanlines_fnc=&skip_scanlines;
 	img->read_cmap_fnc=(ih.bpp==8)?(&read_cmap):NULL;
 	img->format=(ih.bpp==8)?IMG_PSEUDO:IMG_DIRECT;
 	img->close_fnc=&close_image;
@@ -38,6 +38,9 @@ struct pam_info {
 	enum pam_tupltype tupltype;
 
 	FILE *file;	
+	long data_offset;
+	unsigned long first_scl;
+	int wide;	/* deliver 16 bit samples (see IMG_OPEN_WIDE) */
 };
 
 #define PAM_HDR_BUFSIZ 40
@@ -51,12 +54,13 @@ struct pam_info {
 #define PAM_GRSV_MASK	0x000000FF
 #define PAM_GRSA_MASK	0x0000FF00
 
-static int init_stream(FILE*, struct img_file *img, struct pam_info*);
+static int init_stream(FILE*, struct img_file *img, struct pam_info*, int);
 static int read_header(FILE*, struct pam_info*);
 static int read_pnm_header(FILE*, int type, struct pam_info*);
 static int read_pam_header(FILE*, struct pam_info*);
 static int read_scanlines(struct img_file*, img_scanline_cbt, void*);
 static int read_bw_scanlines(struct img_file*, img_scanline_cbt, void*);
+static int skip_scanlines(struct img_file*, unsigned long);
 
 
 static int read_scanlines(struct img_file *img,
@@ -70,15 +74,34 @@ static int read_scanlines(struct img_file *img,
 	int res = 0;
 	int big_endian = is_big_endian();
 
-	rb = malloc(inf->width * inf->depth);
+	rb = malloc(inf->width * inf->depth * (inf->wide ? 2 : 1));
 	if(!rb) return IMG_ENOMEM;
 	
-	if(inf->maxval > 255) {
+	if(inf->wide) {
+		uint16_t *wrb = (uint16_t*)rb;
+		size_t nsamples = inf->width * inf->depth;
+		size_t i;
+
+		for(nrow = inf->first_scl; nrow < inf->height; nrow++) {
+			read = fread(wrb, 2, nsamples, inf->file);
+			if(read < nsamples) {
+				res = IMG_EDATA;
+				break;
+			}
+			for(i = 0; i < nsamples; i++) {
+				uint32_t v = (big_endian) ? wrb[i] : bswap_word(wrb[i]);
+				
+				wrb[i] = (inf->maxval == 65535) ? v :
+					((v > inf->maxval) ? 65535 : (v * 65535 / inf->maxval));
+			}
+			if((*cb)(nrow, rb, cdata) == IMG_READ_CANCEL) break;
+		}
+	} else if(inf->maxval > 255) {
 		uint16_t tupl[4];
 		int s;
 		unsigned int div = (0.5 + ((float)inf->maxval / 256));
 		
-		for(nrow = 0; nrow < inf->height; nrow++) {
+		for(nrow = inf->first_scl; nrow < inf->height; nrow++) {
 			for(ncol = 0; ncol < inf->width; ncol++) {
 				read = fread(tupl, 2, inf->depth, inf->file);
 				if(read < inf->depth) {
@@ -90,6 +113,7 @@ static int read_scanlines(struct img_file *img,
 					rb[ncol * inf->depth + s] = (big_endian) ?
 						(tupl[s] / div) : (bswap_word(tupl[s]) / div);
 			}
+			if(res) break;
 			if((*cb)(nrow, rb, cdata) == IMG_READ_CANCEL) break;
 		}
 	} else if(inf->maxval < 255) {
@@ -97,7 +121,7 @@ static int read_scanlines(struct img_file *img,
 		int s;
 		float fac = 255.0 / inf->maxval;
 		
-		for(nrow = 0; nrow < inf->height; nrow++) {
+		for(nrow = inf->first_scl; nrow < inf->height; nrow++) {
 			for(ncol = 0; ncol < inf->width; ncol++) {
 				read = fread(tupl, 1, inf->depth, inf->file);
 				if(read < inf->depth) {
@@ -107,14 +131,15 @@ static int read_scanlines(struct img_file *img,
 				for(s = 0; s < inf->depth; s++)
 					rb[ncol * inf->depth + s] = ((float)tupl[s] * fac);
 			}
+			if(res) break;
 			if((*cb)(nrow, rb, cdata) == IMG_READ_CANCEL) break;
 		}
 
 	} else {
 
-		for(nrow = 0; nrow < inf->height; nrow++) {
+		for(nrow = inf->first_scl; nrow < inf->height; nrow++) {
 			read = fread(rb, 1, row_size, inf->file);
-			if(read < inf->depth) {
+			if(read < row_size) {
 				res = IMG_EDATA;
 				break;
 			}
@@ -140,7 +165,7 @@ static int read_bw_scanlines(struct img_file *img,
 	rb = malloc(inf->width + 8);
 	if(!rb) return IMG_ENOMEM;
 
-	for(nrow = 0; nrow < inf->height; nrow++) {
+	for(nrow = inf->first_scl; nrow < inf->height; nrow++) {
 		for(ncol = 0; ncol < inf->width; ncol += 8) {
 			byte = fgetc(inf->file);
 			if(byte == EOF) {
@@ -153,6 +178,7 @@ static int read_bw_scanlines(struct img_file *img,
 				byte <<= 1;
 			}
 		}
+		if(res) break;
 		if((*cb)(nrow, rb, cdata) == IMG_READ_CANCEL) break;
 	}
 	
@@ -160,6 +186,29 @@ static int read_bw_scanlines(struct img_file *img,
 	return res;
 }
 
+/*
+ * Seek to scanline 'nscl'. Only for files, since data read
+ * from filters can't be sought.
+ */
+static int skip_scanlines(struct img_file *img, unsigned long nscl)
+{
+	struct pam_info *inf = (struct pam_info*)img->loader_data;
+	size_t row_size;
+	
+	if(nscl > inf->height) return IMG_EINVAL;
+	
+	if(inf->type == 4)
+		row_size = (inf->width + 7) / 8;
+	else
+		row_size = inf->width * inf->depth * ((inf->maxval > 255) ? 2 : 1);
+	
+	if(fseek(inf->file, inf->data_offset + (long)(row_size * nscl), SEEK_SET))
+		return IMG_EIO;
+
+	inf->first_scl = nscl;
+	return 0;
+}
+
 static int read_header(FILE *fin, struct pam_info *inf)
 {
 	int res = 0;
@@ -316,11 +365,13 @@ int img_open_pam(const char *file_name, struct img_file *img, int flags)
 		return IMG_ENOMEM;
 	}
 
-	res = init_stream(file, img, inf);
+	res = init_stream(file, img, inf, flags);
 
 	img->loader_data = inf;
 	img->close_fnc = close;
 	inf->file = file;
+	inf->data_offset = ftell(file);
+	img->skip_scanlines_fnc = skip_scanlines;
 	
 	if(res) {
 		fclose(file);
@@ -330,13 +381,19 @@ int img_open_pam(const char *file_name, struct img_file *img, int flags)
 	return res;
 }
 
-static int init_stream(FILE *file, struct img_file *img, struct pam_info *inf)
+static int init_stream(FILE *file, struct img_file *img,
+	struct pam_info *inf, int flags)
 {
 	int res;
 	
 	res = read_header(file, inf);
 	if(res) return res;
 
+	if(inf->type != 4 && inf->maxval > 255 && (flags & IMG_OPEN_WIDE)) {
+		inf->wide = 1;
+		img->flags |= IMGF_WIDE;
+	}
+
 	if(inf->type == 4) {
 		img->read_scanlines_fnc = read_bw_scanlines;
 		img->bpp = 8;
@@ -403,7 +460,7 @@ int img_filter_pnm(const char *cmd_spec, const char *file_name,
 	img->loader_data = inf;
 	img->close_fnc = close;
 
-	res = init_stream(file, img, inf);
+	res = init_stream(file, img, inf, flags);
 	if(res) {
 		fclose(file);
 		free(inf);
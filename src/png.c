@@ -16,6 +16,7 @@
 #include <sys/stat.h>
 #include <png.h>
 #include "imgfile.h"
+#include "bswap.h"
 #include "debug.h"
 
 /* Loader data */
@@ -26,6 +27,13 @@ struct png_ld {
 	unsigned int passes;
 };
 
+/* Writer data */
+struct png_wr {
+	FILE *file;
+	png_structp png;
+	png_infop info;
+};
+
 /* Local prototypes */
 static void close_image(struct img_file *img);
 static int read_scanlines(struct img_file *img,
@@ -40,7 +48,7 @@ static int read_scanlines(struct img_file *img,
 	int passes=ld->passes;
 	void *buf;
 	
-	buf=malloc((img->bpp/8)*img->width);
+	buf=malloc((img->bpp/8)*img->width*((img->flags&IMGF_WIDE)?2:1));
 	if(!buf) return IMG_ENOMEM;
 	
 	if(setjmp(png_jmpbuf(ld->png))){
@@ -168,7 +176,14 @@ int img_open_png(const char *file_name, struct img_file *img, int flags)
 		img->alpha_mask=0x000FF00;
 		break;
 	}
-	if(bit_depth==16) png_set_strip_16(ld->png);
+	if(bit_depth==16){
+		if((flags&IMG_OPEN_WIDE) && clr_type!=PNG_COLOR_TYPE_PALETTE){
+			if(!is_big_endian()) png_set_swap(ld->png);
+			img->flags|=IMGF_WIDE;
+		}else{
+			png_set_strip_16(ld->png);
+		}
+	}
 	img->format=IMG_DIRECT;
 	if(png_get_interlace_type(ld->png,ld->info)!=PNG_INTERLACE_NONE){
 		ld->passes=png_set_interlace_handling(ld->png);		
@@ -194,3 +209,80 @@ static void close_image(struct img_file *img)
 }
 
 static void error_cb(png_structp png, png_const_charp msg){	/* don't care */ }
+
+/*
+ * Create a PNG file for writing 8 bit RGB rows (R,G,B byte triplets).
+ */
+int img_png_wopen(const char *file_name, unsigned long width,
+	unsigned long height, void **handle)
+{
+	struct png_wr *wr;
+	
+	wr=calloc(1,sizeof(struct png_wr));
+	if(!wr) return IMG_ENOMEM;
+	wr->file=fopen(file_name,"w");
+	if(!wr->file){
+		free(wr);
+		return IMG_EIO;
+	}
+	wr->png=png_create_write_struct(PNG_LIBPNG_VER_STRING,NULL,error_cb,NULL);
+	if(wr->png) wr->info=png_create_info_struct(wr->png);
+	if(!wr->png || !wr->info){
+		if(wr->png) png_destroy_write_struct(&wr->png,&wr->info);
+		fclose(wr->file);
+		free(wr);
+		return IMG_ENOMEM;
+	}
+	
+	if(setjmp(png_jmpbuf(wr->png))){
+		png_destroy_write_struct(&wr->png,&wr->info);
+		fclose(wr->file);
+		free(wr);
+		return IMG_EIO;
+	}
+	png_init_io(wr->png,wr->file);
+	png_set_IHDR(wr->png,wr->info,width,height,8,PNG_COLOR_TYPE_RGB,
+		PNG_INTERLACE_NONE,PNG_COMPRESSION_TYPE_DEFAULT,
+		PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(wr->png,wr->info);
+	
+	*handle=wr;
+	return 0;
+}
+
+/*
+ * Write 'nrows' consecutive rows of 'width'*3 bytes each.
+ */
+int img_png_write(void *handle, const uint8_t *data,
+	unsigned long width, unsigned long nrows)
+{
+	struct png_wr *wr=(struct png_wr*)handle;
+	unsigned long i;
+	
+	if(setjmp(png_jmpbuf(wr->png))) return IMG_EIO;
+	
+	for(i=0; i<nrows; i++)
+		png_write_row(wr->png,(png_const_bytep)(data+i*width*3));
+	return 0;
+}
+
+/*
+ * Finish writing and close the file. If 'discard' is True the output
+ * is incomplete, and only resources are released.
+ */
+int img_png_wclose(void *handle, int discard)
+{
+	struct png_wr *wr=(struct png_wr*)handle;
+	int res=0;
+	
+	if(!discard){
+		if(setjmp(png_jmpbuf(wr->png)))
+			res=IMG_EIO;
+		else
+			png_write_end(wr->png,NULL);
+	}
+	png_destroy_write_struct(&wr->png,&wr->info);
+	if(fclose(wr->file) && !res) res=IMG_EIO;
+	free(wr);
+	return res;
+}
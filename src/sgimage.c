@@ -63,6 +63,8 @@ struct sgi_ld {
 	/* scanline tables for encoded files */
 	uint32_t tab_len;
 	uint32_t *start_tab;
+	
+	unsigned int first_scl; /* see skip_scanlines */
 };
 
 /* Local prototypes */
@@ -71,6 +73,7 @@ static void bswap_header_struct(struct sgi_header* h);
 static int read_scanlines(struct img_file *img,
 	img_scanline_cbt cb, void *cdata);
 static int read_rle(uint8_t *buffer, size_t len, size_t bpc, FILE *file);
+static int skip_scanlines(struct img_file *img, unsigned long nscl);
 static void planes_to_row(uint8_t *planes, short nplanes,
 	unsigned int xres, uint8_t *row, short bpc);
 
@@ -136,7 +139,7 @@ static int read_scanlines(struct img_file *img,
 	}
 	memset(planes,0xFF,psize*ld->hdr.zsize);
 	if(ld->hdr.stor_fmt==SGI_SF_VERBATIM){
-		for(iscl=0; iscl<ld->hdr.yres; iscl++){
+		for(iscl=ld->first_scl; iscl<ld->hdr.yres; iscl++){
 			for(ip=0; ip<ld->hdr.zsize; ip++){
 				fseek(ld->file,HEADER_SIZE+
 					(iscl*psize)+(ip*(ld->hdr.yres*psize)),SEEK_SET);
@@ -167,6 +170,18 @@ static int read_scanlines(struct img_file *img,
 	return res;
 }
 
+/*
+ * Verbatim data is read by seeking to each scanline anyway
+ */
+static int skip_scanlines(struct img_file *img, unsigned long nscl)
+{
+	struct sgi_ld *ld=(struct sgi_ld*)img->loader_data;
+	
+	if(nscl>ld->hdr.yres) return IMG_EINVAL;
+	ld->first_scl=nscl;
+	return 0;
+}
+
 /*
  * Convert 'nplanes' planes to a row
  */
@@ -273,7 +288,9 @@ int img_open_sgi(const char *file_name, struct img_file *img, int flags)
 	}else{
 		/* verbatim */
 		ld->tab_len=0;
+		img->skip_scanlines_fnc=&skip_scanlines;
 	}
+	ld->first_scl=0;
 	ld->file=file;
 	img->width=hdr.xres;
 	img->height=hdr.yres;
@@ -33,6 +33,8 @@
 #define SID_VMNEXTPAGE	23	/* Next Page */
 #define SID_VMPREVPAGE	24	/* Previous Page */
 #define SID_VMTOOLBAR	25	/* Toolbar */
+#define SID_VMFOLLOW	26	/* Follow Changes */
+#define SID_VMSLIDESHOW	27	/* Slideshow */
 
 #define SID_VMZOOM		30	/* Zoom (cascade) */
 #define SID_VMZOOMIN	31	/* Zoom In */
@@ -58,6 +60,12 @@
 #define SID_VMPIN		61	/* Pin This*/
 #define SID_VMNEW		62	/* Open New */
 
+#define SID_VMLEVELS	70	/* Levels (cascade) */
+#define SID_VMINVERT	71	/* Invert */
+#define SID_VMGAMMAUP	72	/* Increase Gamma */
+#define SID_VMGAMMADN	73	/* Decrease Gamma */
+#define SID_VMLVRESET	74	/* Reset */
+
 #define SID_VMHELP		100	/* Help (cascade) */
 #define SID_VMTOPICS	101	/* Manual */
 #define SID_VMABOUT		102	/* About */
@@ -100,6 +108,8 @@
 #define SID_BMRENAME		46	/* Rename... */
 #define SID_BMDELETE		47	/* Delete */
 #define SID_BMSELPAT		48	/* Select Pattern */
+#define SID_BMSELSIMILAR	49	/* Select Similar */
+#define SID_BMSELDUPES		50	/* Select Duplicates */
 
 #define SID_BMHELP			100	/* Help (cascade) */
 #define SID_BMTOPICS		101	/* Manual */
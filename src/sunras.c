@@ -54,6 +54,7 @@ struct ras_ld
 	size_t scl_size;
 	uint8_t *buffer;
 	unsigned int data_offset;
+	unsigned long first_scl; /* see skip_scanlines */
 };
 
 /* RLE decoder state */
@@ -68,6 +69,7 @@ static int read_bw_rle(struct img_file*,img_scanline_cbt,void*);
 static int read_raw(struct img_file*,img_scanline_cbt,void*);
 static int read_rle(struct img_file*,img_scanline_cbt,void*);
 static int read_cmap(struct img_file*,void*);
+static int skip_scanlines(struct img_file*,unsigned long);
 static void bits_to_bytes(uint8_t b, uint8_t *buf,
 	uint8_t black, uint8_t white);
 static void close_image(struct img_file*);
@@ -82,16 +84,18 @@ static int read_bw_raw(struct img_file *img, img_scanline_cbt cb, void *cdata)
 	unsigned long i,j;
 	uint8_t black=0;
 	uint8_t white=(ld->hdr.cmap_type==CMAP_NONE)?0xFF:1;
+	int c=0;
 			
-	fseek(ld->file,ld->data_offset,SEEK_SET);
+	fseek(ld->file,ld->data_offset+
+		((ld->hdr.width+7)/8)*ld->first_scl,SEEK_SET);
 	
-	for(i=0, j=0; i<ld->hdr.height; i++){
+	for(i=ld->first_scl, j=0; i<ld->hdr.height; i++){
 		for(j=0; j<ld->hdr.width; j+=8){
-			int c;
 			c=fgetc(ld->file);
 			if(c==EOF) break;
 			bits_to_bytes(c,&ld->buffer[j],black,white);
 		}
+		if(c==EOF) break;
 		if((*cb)(i,ld->buffer,cdata)==IMG_READ_CANCEL) return 0;
 	}
 	
@@ -140,9 +144,9 @@ static int read_raw(struct img_file *img, img_scanline_cbt cb, void *cdata)
 	unsigned long i;
 	int res=0;
 	
-	fseek(ld->file,ld->data_offset,SEEK_SET);
+	fseek(ld->file,ld->data_offset+ld->scl_size*ld->first_scl,SEEK_SET);
 	
-	for(i=0; i<ld->hdr.height; i++){
+	for(i=ld->first_scl; i<ld->hdr.height; i++){
 		read=fread(ld->buffer,1,ld->scl_size,ld->file);
 		if(read<ld->scl_size){
 			if(feof(ld->file))
@@ -156,6 +160,18 @@ static int read_raw(struct img_file *img, img_scanline_cbt cb, void *cdata)
 	return res;
 }
 
+/*
+ * Raw data is read from the offset of the first scanline requested.
+ */
+static int skip_scanlines(struct img_file *img, unsigned long nscl)
+{
+	struct ras_ld *ld=(struct ras_ld*)img->loader_data;
+	
+	if(nscl>ld->hdr.height) return IMG_EINVAL;
+	ld->first_scl=nscl;
+	return 0;
+}
+
 /*
  * Read RLE RGB(X)/greyscale/indexed scanlines.
  */
@@ -402,6 +418,7 @@ int img_open_ras(const char *file_name, struct img_file *img, int flags)
 	ld->data_offset=sizeof(struct sun_hdr);
 	if(ld->hdr.cmap_type!=CMAP_NONE)
 		ld->data_offset+=hdr.cmap_len;
+	if(hdr.type!=RAS_ENCODED) img->skip_scanlines_fnc=&skip_scanlines;
 	return 0;
 }
 
@@ -0,0 +1,417 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Persistent thumbnail cache.
+ * Entries are stored in separate files, named after a hash of the source
+ * file's path, and are valid as long as the source's mtime and size match.
+ * Pixel data is stored uncompressed as R,G,B byte triplets.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include "thumbcache.h"
+#include "imgfile.h"
+#include "imgblt.h"
+#include "imghash.h"
+#include "ioutil.h"
+#include "bswap.h"
+#include "debug.h"
+
+/* Cache file header */
+#define TC_MAGIC	0x58544331	/* also detects foreign byte order */
+#define TC_VERSION	3
+
+struct tc_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t mtime;		/* source file modification time */
+	uint64_t size;		/* source file size */
+	int64_t cr_time;	/* image creation time */
+	uint32_t xres;		/* image dimensions */
+	uint32_t yres;
+	uint32_t width;		/* thumbnail dimensions */
+	uint32_t height;
+	int32_t bpp;		/* image bit depth */
+	uint32_t tform;		/* image orientation */
+	uint32_t path_len;	/* length of the source path that follows */
+	uint64_t dhash;		/* perceptual hash of the thumbnail */
+};
+
+/* Subdirectory of the cache root holding thumbnails */
+#define TC_SUBDIR "thumbnails"
+
+/* Local prototypes */
+static char* entry_name(const char *path);
+static int make_dir(const char *path);
+static uint64_t hash_path(const char *path);
+
+/* Cache directory, set up by tc_init */
+static char *cache_dir = NULL;
+
+/*
+ * Initialize the cache
+ */
+int tc_init(const char *path)
+{
+	const char *base;
+	char *dir;
+	int res;
+
+	if(cache_dir) return 0;
+
+	if(path) {
+		dir = malloc(strlen(path) + strlen(TC_SUBDIR) + 2);
+		if(!dir) return ENOMEM;
+		sprintf(dir, "%s/%s", path, TC_SUBDIR);
+	} else if( (base = getenv("XDG_CACHE_HOME")) && base[0] == '/') {
+		dir = malloc(strlen(base) + strlen(TC_SUBDIR) + 12);
+		if(!dir) return ENOMEM;
+		sprintf(dir, "%s/ximaging/%s", base, TC_SUBDIR);
+	} else {
+		if(!(base = getenv("HOME"))) return ENOENT;
+		dir = malloc(strlen(base) + strlen(TC_SUBDIR) + 19);
+		if(!dir) return ENOMEM;
+		sprintf(dir, "%s/.cache/ximaging/%s", base, TC_SUBDIR);
+	}
+
+	if( (res = make_dir(dir)) ) {
+		free(dir);
+		return res;
+	}
+	cache_dir = dir;
+	return 0;
+}
+
+Bool tc_enabled(void)
+{
+	return (cache_dir != NULL);
+}
+
+/*
+ * Look up a valid entry for 'path'
+ */
+int tc_lookup(const char *path, const struct stat *st, struct tc_entry *ent)
+{
+	struct tc_header hdr;
+	char *name;
+	char *src_path = NULL;
+	size_t path_len = strlen(path);
+	size_t data_size;
+	int fd;
+	int res = ENOENT;
+
+	if(!cache_dir) return ENOENT;
+	if(!(name = entry_name(path))) return ENOMEM;
+
+	fd = open(name, O_RDONLY);
+	free(name);
+	if(fd == -1) return (errno == ENOENT) ? ENOENT : errno;
+
+	if(readn(fd, &hdr, sizeof(struct tc_header)) !=
+		sizeof(struct tc_header)) goto finish;
+
+	if(hdr.magic != TC_MAGIC || hdr.version != TC_VERSION ||
+		hdr.mtime != (uint64_t)st->st_mtime ||
+		hdr.size != (uint64_t)st->st_size ||
+		hdr.path_len != path_len ||
+		!hdr.width || hdr.width > TC_THUMB_SIZE ||
+		!hdr.height || hdr.height > TC_THUMB_SIZE) goto finish;
+
+	/* make sure it's not a hash collision */
+	if(!(src_path = malloc(path_len))) {
+		res = ENOMEM;
+		goto finish;
+	}
+	if(readn(fd, src_path, path_len) != path_len ||
+		memcmp(src_path, path, path_len)) goto finish;
+
+	if(!ent) {
+		res = 0;
+		goto finish;
+	}
+
+	data_size = hdr.width * hdr.height * 3;
+	if(!(ent->data = malloc(data_size))) {
+		res = ENOMEM;
+		goto finish;
+	}
+	if(readn(fd, ent->data, data_size) != data_size) {
+		free(ent->data);
+		ent->data = NULL;
+		goto finish;
+	}
+
+	ent->width = hdr.width;
+	ent->height = hdr.height;
+	ent->xres = hdr.xres;
+	ent->yres = hdr.yres;
+	ent->bpp = hdr.bpp;
+	ent->tform = hdr.tform;
+	ent->cr_time = (time_t)hdr.cr_time;
+	ent->dhash = hdr.dhash;
+	res = 0;
+
+	finish:
+	if(src_path) free(src_path);
+	close(fd);
+	return res;
+}
+
+/*
+ * Store an entry for 'path'
+ */
+int tc_store(const char *path, const struct stat *st,
+	const struct tc_entry *ent)
+{
+	struct tc_header hdr;
+	char *name;
+	char *tmp_name;
+	char *ptr;
+	size_t path_len = strlen(path);
+	size_t data_size = ent->width * ent->height * 3;
+	int fd;
+	int res = 0;
+
+	if(!cache_dir) return ENOENT;
+	if(!(name = entry_name(path))) return ENOMEM;
+
+	if(!(tmp_name = malloc(strlen(name) + 8))) {
+		free(name);
+		return ENOMEM;
+	}
+
+	/* entries are fanned out into subdirectories */
+	ptr = strrchr(name, '/');
+	*ptr = '\0';
+	if(access(name, F_OK) && (res = make_dir(name))) {
+		free(name);
+		free(tmp_name);
+		return res;
+	}
+	*ptr = '/';
+
+	sprintf(tmp_name, "%s.XXXXXX", name);
+	fd = mkstemp(tmp_name);
+	if(fd == -1) {
+		res = errno;
+		free(name);
+		free(tmp_name);
+		return res;
+	}
+
+	memset(&hdr, 0, sizeof(struct tc_header));
+	hdr.magic = TC_MAGIC;
+	hdr.version = TC_VERSION;
+	hdr.mtime = (uint64_t)st->st_mtime;
+	hdr.size = (uint64_t)st->st_size;
+	hdr.cr_time = (int64_t)ent->cr_time;
+	hdr.xres = ent->xres;
+	hdr.yres = ent->yres;
+	hdr.width = ent->width;
+	hdr.height = ent->height;
+	hdr.bpp = ent->bpp;
+	hdr.tform = ent->tform;
+	hdr.path_len = path_len;
+	hdr.dhash = ent->dhash;
+
+	if(writen(fd, &hdr, sizeof(struct tc_header)) == -1 ||
+		writen(fd, path, path_len) == -1 ||
+		writen(fd, ent->data, data_size) == -1) res = errno;
+
+	if(close(fd) && !res) res = errno;
+
+	if(!res && rename(tmp_name, name)) res = errno;
+	if(res) unlink(tmp_name);
+
+	free(name);
+	free(tmp_name);
+	return res;
+}
+
+/*
+ * Downscale 'img' and store the result in 'ent'
+ */
+int tc_make_entry(XImage *img, const struct pixel_format *pf,
+	struct tc_entry *ent)
+{
+	XImage thumb;
+	struct pixel_format tc_pf;
+	float xs, ys, scale;
+	unsigned int y;
+
+	xs = (float)TC_THUMB_SIZE / img->width;
+	ys = (float)TC_THUMB_SIZE / img->height;
+	scale = (xs < ys) ? xs : ys;
+	if(scale > 1.0) scale = 1.0;
+
+	/* same format as the source, we just need different dimensions */
+	memcpy(&thumb, img, sizeof(XImage));
+	thumb.width = img->width * scale;
+	thumb.height = img->height * scale;
+	if(!thumb.width) thumb.width = 1;
+	if(!thumb.height) thumb.height = 1;
+	thumb.bytes_per_line = 0;
+	thumb.data = NULL;
+	XInitImage(&thumb);
+
+	thumb.data = malloc(thumb.bytes_per_line * thumb.height);
+	ent->data = malloc(thumb.width * thumb.height * 3);
+	if(!thumb.data || !ent->data) {
+		if(thumb.data) free(thumb.data);
+		if(ent->data) free(ent->data);
+		ent->data = NULL;
+		return ENOMEM;
+	}
+
+	if(scale < 1.0) {
+		img_blt(img, 0, 0, img->width, img->height,
+			&thumb, scale, 0, BLTF_INTERPOLATE);
+	} else {
+		memcpy(thumb.data, img->data, thumb.bytes_per_line * thumb.height);
+	}
+
+	tc_init_pixel_format(&tc_pf);
+	for(y = 0; y < thumb.height; y++) {
+		convert_rgb_pixels(ent->data + (y * thumb.width * 3), &tc_pf,
+			thumb.data + (y * thumb.bytes_per_line), pf, thumb.width);
+	}
+	free(thumb.data);
+
+	ent->width = thumb.width;
+	ent->height = thumb.height;
+	ent->dhash = img_dhash(ent->data, ent->width, ent->height);
+	return 0;
+}
+
+int tc_image_hash(XImage *img, const struct pixel_format *pf,
+	uint64_t *hash)
+{
+	struct pixel_format tc_pf;
+	uint8_t *data;
+	unsigned int y;
+
+	data = malloc(img->width * img->height * 3);
+	if(!data) return ENOMEM;
+
+	tc_init_pixel_format(&tc_pf);
+	for(y = 0; y < img->height; y++) {
+		convert_rgb_pixels(data + (y * img->width * 3), &tc_pf,
+			(uint8_t*)img->data + (y * img->bytes_per_line),
+			pf, img->width);
+	}
+	*hash = img_dhash(data, img->width, img->height);
+	free(data);
+	return 0;
+}
+
+/*
+ * Check whether 'ent' has enough resolution for 'width' x 'height'
+ */
+Bool tc_entry_fits(const struct tc_entry *ent,
+	unsigned int width, unsigned int height)
+{
+	float xs, ys, scale;
+
+	/* the area is for the image as displayed */
+	if(ent->tform & IMGT_ROTATE) {
+		xs = (float)width / ent->yres;
+		ys = (float)height / ent->xres;
+	} else {
+		xs = (float)width / ent->xres;
+		ys = (float)height / ent->yres;
+	}
+	scale = (xs < ys) ? xs : ys;
+	if(scale > 1.0) scale = 1.0;
+
+	return (ent->width >= (unsigned int)(ent->xres * scale) &&
+		ent->height >= (unsigned int)(ent->yres * scale));
+}
+
+/*
+ * Initialize 'pf' so that pixels are stored as R,G,B bytes
+ * regardless of the host byte order.
+ */
+void tc_init_pixel_format(struct pixel_format *pf)
+{
+	if(is_big_endian()) {
+		init_pixel_format(pf, 24, 0xFF000000, 0x00FF0000,
+			0x0000FF00, 0, 0, 0);
+	} else {
+		init_pixel_format(pf, 24, 0x000000FF, 0x0000FF00,
+			0x00FF0000, 0, 0, 0);
+	}
+}
+
+void tc_free_entry(struct tc_entry *ent)
+{
+	if(ent->data) free(ent->data);
+	ent->data = NULL;
+}
+
+/*
+ * Returns the cache file name for 'path' (must be freed by the caller),
+ * or NULL on allocation failure.
+ */
+static char* entry_name(const char *path)
+{
+	char *name;
+	char hex[17];
+
+	if(!(name = malloc(strlen(cache_dir) + 22))) return NULL;
+
+	snprintf(hex, 17, "%016llx", (unsigned long long)hash_path(path));
+	sprintf(name, "%s/%.2s/%s", cache_dir, hex, hex + 2);
+	return name;
+}
+
+/*
+ * Create 'path' including any missing parent directories.
+ */
+static int make_dir(const char *path)
+{
+	char *buf;
+	char *ptr;
+	int res = 0;
+
+	if(!(buf = strdup(path))) return ENOMEM;
+
+	for(ptr = buf + 1; ; ptr++) {
+		if(*ptr != '/' && *ptr != '\0') continue;
+
+		if(*ptr == '/') *ptr = '\0';
+		else ptr = NULL;
+
+		if(mkdir(buf, 0700) && errno != EEXIST) {
+			res = errno;
+			break;
+		}
+		if(!ptr) break;
+		*ptr = '/';
+	}
+	free(buf);
+	return res;
+}
+
+/* 64-bit FNV-1a hash of 'path' */
+static uint64_t hash_path(const char *path)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for( ; *path; path++) {
+		h ^= (uint8_t)*path;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
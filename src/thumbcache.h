@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Persistent thumbnail cache type definitions and prototypes.
+ */
+
+#ifndef THUMBCACHE_H
+#define THUMBCACHE_H
+
+#include <time.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <X11/Xlib.h>
+#include "pixconv.h"
+
+/* Maximum width/height of cached thumbnails */
+#define TC_THUMB_SIZE	256
+
+/* Cache entry */
+struct tc_entry {
+	unsigned int width;		/* thumbnail dimensions */
+	unsigned int height;
+	unsigned long xres;		/* original image dimensions */
+	unsigned long yres;
+	short bpp;				/* original image bit depth */
+	unsigned int tform;		/* image orientation IMGT_*, data is as stored */
+	time_t cr_time;			/* original image creation time */
+	uint64_t dhash;			/* perceptual hash (see imghash.h) */
+	uint8_t *data;			/* R,G,B byte triplets, width*height*3 */
+};
+
+/*
+ * Initialize the cache. If 'path' is NULL, $XDG_CACHE_HOME/ximaging or
+ * $HOME/.cache/ximaging is used. The directory is created if necessary.
+ * Returns zero on success, errno otherwise.
+ */
+int tc_init(const char *path);
+
+/* Returns True if tc_init succeeded */
+Bool tc_enabled(void);
+
+/*
+ * Look up a valid entry for the file 'path' with status 'st'.
+ * 'ent' may be NULL if only the presence of an up to date entry is to be
+ * checked, otherwise its data must be freed with tc_free_entry.
+ * Returns zero on success, ENOENT if missing or stale, errno otherwise.
+ */
+int tc_lookup(const char *path, const struct stat *st, struct tc_entry *ent);
+
+/*
+ * Store an entry for the file 'path' with status 'st'.
+ * The entry is written to a temporary file and renamed into place, so an
+ * interrupted write never leaves a partial entry behind.
+ * Returns zero on success, errno otherwise.
+ */
+int tc_store(const char *path, const struct stat *st,
+	const struct tc_entry *ent);
+
+/*
+ * Downscale 'img' (pixel format 'pf') to TC_THUMB_SIZE and store the
+ * result and its perceptual hash in 'ent' (image metadata fields are
+ * left untouched).
+ * Returns zero on success, errno otherwise.
+ */
+int tc_make_entry(XImage *img, const struct pixel_format *pf,
+	struct tc_entry *ent);
+
+/*
+ * Compute the perceptual hash of 'img' (pixel format 'pf') as is, without
+ * making an entry. Meant for images already about thumbnail sized.
+ * Returns zero on success, errno otherwise.
+ */
+int tc_image_hash(XImage *img, const struct pixel_format *pf,
+	uint64_t *hash);
+
+/*
+ * Returns True if 'ent' has enough resolution to be scaled down to fit
+ * a 'width' x 'height' area as displayed (or is the full size image).
+ */
+Bool tc_entry_fits(const struct tc_entry *ent,
+	unsigned int width, unsigned int height);
+
+/* Initialize 'pf' to describe tc_entry pixel data */
+void tc_init_pixel_format(struct pixel_format *pf);
+
+/* Free data allocated by tc_lookup/tc_make_entry */
+void tc_free_entry(struct tc_entry *ent);
+
+#endif /* THUMBCACHE_H */
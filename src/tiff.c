@@ -22,21 +22,33 @@
 struct tiff_ld {
 	TIFF *file;
 	void *data;
+	tdir_t *pages; /* directory number of each page */
+	tdir_t cur_dir; /* directory of the current page */
+	tdir_t rdc_dir; /* reduced resolution directory, if non-zero */
+	toff_t rdc_offset; /* reduced resolution sub-IFD, if non-zero */
+	uint16_t orientation; /* of the current page */
 };
 
 /* Local prototypes */
 static void close_image(struct img_file *img);
 static int read_scanlines(struct img_file *img,
 	img_scanline_cbt cb, void *cdata);
-static int read_directory(struct img_file *img, unsigned int ndir);
+static int read_directory(struct img_file *img, unsigned int page);
+static int reduce(struct img_file *img,
+	unsigned long width, unsigned long height);
+static int decode_image(struct img_file *img);
 
 static int read_scanlines(struct img_file *img,
 	img_scanline_cbt cb, void *cdata)
 {
 	struct tiff_ld *ld = (struct tiff_ld*) img->loader_data;
 	unsigned int i;
-	uint32_t *data = ld->data;
+	uint32_t *data;
+	int res;
 	
+	if(!ld->data && (res = decode_image(img))) return res;
+	
+	data = ld->data;
 	for(i = 0; i < img->height; i++) {
 		if( (*cb)(i, (uint8_t*)data, cdata) == IMG_READ_CANCEL) break;
 		data += img->width;
@@ -44,7 +56,11 @@ static int read_scanlines(struct img_file *img,
 	return 0;
 }
 
-static int read_directory(struct img_file *img, unsigned int ndir)
+/*
+ * Read properties of the full resolution image of 'page'.
+ * Image data is decoded once scanlines are read.
+ */
+static int read_directory(struct img_file *img, unsigned int page)
 {
 	struct tiff_ld *ld = (struct tiff_ld*) img->loader_data;
 	uint32_t width = 0;
@@ -56,14 +72,19 @@ static int read_directory(struct img_file *img, unsigned int ndir)
 		free(ld->data);
 		ld->data = NULL;
 	}
+	ld->cur_dir = ld->pages[page];
+	ld->rdc_dir = 0;
+	ld->rdc_offset = 0;
 	
-	if(!TIFFSetDirectory(ld->file, ndir) ||
+	if(!TIFFSetDirectory(ld->file, ld->cur_dir) ||
 		!TIFFGetField(ld->file, TIFFTAG_BITSPERSAMPLE, &bps) ||
 		!TIFFGetField(ld->file, TIFFTAG_IMAGEWIDTH, &width) ||
 		!TIFFGetField(ld->file, TIFFTAG_IMAGELENGTH, &height) ) {
 			return IMG_EFILE;
 	}
 	TIFFGetFieldDefaulted(ld->file, TIFFTAG_SAMPLESPERPIXEL, &bpp);
+	if(!TIFFGetField(ld->file, TIFFTAG_ORIENTATION, &ld->orientation))
+		ld->orientation = ORIENTATION_TOPLEFT;
 
 	img->width = width;
 	img->height = height;
@@ -76,13 +97,92 @@ static int read_directory(struct img_file *img, unsigned int ndir)
 	img->alpha_mask = 0xff000000;
 	img->flags = IMGF_PMALPHA;
 	img->orig_bpp = bpp * bps;
+	img->tform = img_orientation_tform(ld->orientation);
 	img->read_scanlines_fnc = &read_scanlines;
+	return 0;
+}
+
+/*
+ * Select the smallest reduced resolution image of the current page, either
+ * following it in the main IFD chain, or in its sub-IFDs, that's no less
+ * than 'width' x 'height'.
+ */
+static int reduce(struct img_file *img,
+	unsigned long width, unsigned long height)
+{
+	struct tiff_ld *ld = (struct tiff_ld*) img->loader_data;
+	uint32_t rw, rh, sft;
+	uint16_t nsubifd = 0;
+	toff_t *subifd = NULL;
+	toff_t *offsets = NULL;
+	tdir_t dir;
+	unsigned int i;
+	
+	if(ld->data) return IMG_EINVAL;
+	
+	/* sub-IFD offsets are overwritten when switching directories */
+	if(!TIFFSetDirectory(ld->file, ld->cur_dir)) return IMG_EFILE;
+	if(TIFFGetField(ld->file, TIFFTAG_SUBIFD, &nsubifd, &subifd) &&
+		nsubifd) {
+		offsets = malloc(sizeof(toff_t) * nsubifd);
+		if(!offsets) return IMG_ENOMEM;
+		memcpy(offsets, subifd, sizeof(toff_t) * nsubifd);
+	}
+	
+	for(dir = ld->cur_dir + 1; TIFFSetDirectory(ld->file, dir); dir++) {
+		if(!TIFFGetField(ld->file, TIFFTAG_SUBFILETYPE, &sft) ||
+			!(sft & FILETYPE_REDUCEDIMAGE)) break;
+		
+		if(TIFFGetField(ld->file, TIFFTAG_IMAGEWIDTH, &rw) &&
+			TIFFGetField(ld->file, TIFFTAG_IMAGELENGTH, &rh) &&
+			rw >= width && rh >= height && rw < img->width) {
+			img->width = rw;
+			img->height = rh;
+			ld->rdc_dir = dir;
+			ld->rdc_offset = 0;
+		}
+	}
+
+	for(i = 0; i < nsubifd; i++) {
+		if(!TIFFSetSubDirectory(ld->file, offsets[i])) continue;
+		
+		if(TIFFGetField(ld->file, TIFFTAG_SUBFILETYPE, &sft) &&
+			(sft & FILETYPE_REDUCEDIMAGE) &&
+			TIFFGetField(ld->file, TIFFTAG_IMAGEWIDTH, &rw) &&
+			TIFFGetField(ld->file, TIFFTAG_IMAGELENGTH, &rh) &&
+			rw >= width && rh >= height && rw < img->width) {
+			img->width = rw;
+			img->height = rh;
+			ld->rdc_dir = 0;
+			ld->rdc_offset = offsets[i];
+		}
+	}
+	if(offsets) free(offsets);
+	return 0;
+}
 
-	ld->data = malloc((width * height) * 8);
+/*
+ * Decode the current page, or the reduced resolution image selected
+ */
+static int decode_image(struct img_file *img)
+{
+	struct tiff_ld *ld = (struct tiff_ld*) img->loader_data;
+	
+	if(ld->rdc_offset) {
+		if(!TIFFSetDirectory(ld->file, ld->cur_dir) ||
+			!TIFFSetSubDirectory(ld->file, ld->rdc_offset))
+			return IMG_EFILE;
+	} else if(!TIFFSetDirectory(ld->file,
+		ld->rdc_dir ? ld->rdc_dir : ld->cur_dir)) {
+		return IMG_EFILE;
+	}
+	
+	ld->data = malloc((img->width * img->height) * 8);
 	if(!ld->data) return IMG_ENOMEM;
 
-	if(!TIFFReadRGBAImageOriented(
-		ld->file, width, height, ld->data, ORIENTATION_TOPLEFT, 0) ) {
+	/* as stored, orientation is up to the viewer (see read_directory) */
+	if(!TIFFReadRGBAImageOriented(ld->file, img->width, img->height,
+		ld->data, ld->orientation, 0) ) {
 		free(ld->data);
 		ld->data = NULL;
 		return IMG_EUNSUP;
@@ -94,6 +194,8 @@ int img_open_tiff(const char *file_name, struct img_file *img, int flags)
 {
 	struct stat st;
 	struct tiff_ld *ld;
+	tdir_t dir = 0;
+	tdir_t *pages;
 	int npages = 0;
 	
 	memset(img, 0, sizeof(struct img_file));
@@ -101,29 +203,45 @@ int img_open_tiff(const char *file_name, struct img_file *img, int flags)
 	ld = calloc(1, sizeof(struct tiff_ld));
 	if(!ld) return IMG_ENOMEM;
 	
+	#ifndef DEBUG
+	TIFFSetWarningHandler(NULL);
+	TIFFSetErrorHandler(NULL);
+	#endif
+	
 	ld->file = TIFFOpen(file_name, "r");
 	if(!ld->file){
 		free(ld);
 		return IMG_EIO;
 	}
 
+	/* reduced resolution images aren't pages on their own */
 	do {
-		npages++;
-	} while(TIFFReadDirectory(ld->file));
+		uint32_t sft = 0;
+		
+		if(npages && TIFFGetField(ld->file, TIFFTAG_SUBFILETYPE, &sft) &&
+			(sft & FILETYPE_REDUCEDIMAGE)) continue;
+		
+		pages = realloc(ld->pages, sizeof(tdir_t) * (npages + 1));
+		if(!pages) {
+			TIFFClose(ld->file);
+			if(ld->pages) free(ld->pages);
+			free(ld);
+			return IMG_ENOMEM;
+		}
+		ld->pages = pages;
+		ld->pages[npages++] = dir;
+	} while(dir++, TIFFReadDirectory(ld->file));
 
 	img->npages = npages;
 	img->cr_time = st.st_ctime;	
 	img->close_fnc = &close_image;
 	if(npages > 1) img->set_page_fnc = &read_directory;
+	img->reduce_fnc = &reduce;
 	img->loader_data = ld;
 	
-	#ifndef DEBUG
-	TIFFSetWarningHandler(NULL);
-	TIFFSetErrorHandler(NULL);
-	#endif
-	
 	if(read_directory(img, 0)) {
 		TIFFClose(ld->file);
+		free(ld->pages);
 		free(ld);
 		return IMG_EIO;	
 	}
@@ -136,5 +254,6 @@ static void close_image(struct img_file *img)
 	struct tiff_ld *ld=(struct tiff_ld*)img->loader_data;
 	TIFFClose(ld->file);
 	if(ld->data) free(ld->data);
+	free(ld->pages);
 	free(ld);
 }
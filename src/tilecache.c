@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Rendered tile cache. Only a few dozen tiles cover a view, and the size
+ * limit keeps the number of tiles down to a few hundred, so lookups simply
+ * walk the list of tiles, which is kept in order of use.
+ */
+
+#include <stdlib.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include "tilecache.h"
+#include "debug.h"
+
+struct tlc_tile {
+	struct tlc_key key;
+	XImage *image;
+	size_t data_size;
+	struct tlc_tile *prev;
+	struct tlc_tile *next;
+};
+
+/* Local prototypes */
+static void unlink_tile(struct tile_cache*, struct tlc_tile*);
+static void link_tile(struct tile_cache*, struct tlc_tile*);
+static void free_tile(struct tlc_tile*);
+
+void tlc_init(struct tile_cache *tc, size_t max_size)
+{
+	tc->head = NULL;
+	tc->tail = NULL;
+	tc->cur_size = 0;
+	tc->max_size = max_size;
+}
+
+Bool tlc_enabled(const struct tile_cache *tc)
+{
+	return (tc->max_size != 0);
+}
+
+XImage* tlc_get(struct tile_cache *tc, const struct tlc_key *key)
+{
+	struct tlc_tile *tile;
+
+	for(tile = tc->head; tile; tile = tile->next) {
+		if(tile->key.x == key->x && tile->key.y == key->y &&
+			tile->key.src == key->src && tile->key.zoom == key->zoom &&
+			tile->key.tform == key->tform &&
+			tile->key.flags == key->flags) break;
+	}
+	if(!tile) return NULL;
+
+	if(tile != tc->head) {
+		unlink_tile(tc, tile);
+		link_tile(tc, tile);
+	}
+	return tile->image;
+}
+
+void tlc_put(struct tile_cache *tc, const struct tlc_key *key, XImage *img)
+{
+	struct tlc_tile *tile;
+	size_t data_size = img->bytes_per_line * img->height;
+
+	if(data_size > tc->max_size || !(tile = malloc(sizeof(struct tlc_tile)))) {
+		XDestroyImage(img);
+		return;
+	}
+
+	while(tc->tail && (tc->cur_size + data_size) > tc->max_size) {
+		struct tlc_tile *lru = tc->tail;
+		unlink_tile(tc, lru);
+		free_tile(lru);
+	}
+
+	tile->key = *key;
+	tile->image = img;
+	tile->data_size = data_size;
+	link_tile(tc, tile);
+}
+
+void tlc_purge(struct tile_cache *tc)
+{
+	while(tc->head) {
+		struct tlc_tile *tile = tc->head;
+		unlink_tile(tc, tile);
+		free_tile(tile);
+	}
+}
+
+/* Insert 'tile' at the head of the list */
+static void link_tile(struct tile_cache *tc, struct tlc_tile *tile)
+{
+	tile->prev = NULL;
+	tile->next = tc->head;
+	if(tc->head) tc->head->prev = tile;
+	else tc->tail = tile;
+	tc->head = tile;
+	tc->cur_size += tile->data_size;
+}
+
+static void unlink_tile(struct tile_cache *tc, struct tlc_tile *tile)
+{
+	if(tile->prev) tile->prev->next = tile->next;
+	else tc->head = tile->next;
+	if(tile->next) tile->next->prev = tile->prev;
+	else tc->tail = tile->prev;
+	dassert(tc->cur_size >= tile->data_size);
+	tc->cur_size -= tile->data_size;
+}
+
+static void free_tile(struct tlc_tile *tile)
+{
+	XDestroyImage(tile->image);
+	free(tile);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Rendered tile cache type definitions and prototypes.
+ * The viewer renders the scaled and transformed image in fixed size tiles,
+ * and keeps recently used ones, so that portions of the image already
+ * rendered at a given zoom level don't need to be rendered again.
+ */
+
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <X11/Xlib.h>
+
+/* Width and height of a tile in scaled image coordinates */
+#define TLC_TILE_SIZE	256
+
+/* Tile key */
+struct tlc_key {
+	const XImage *src;	/* image (or reduced copy) rendered from */
+	float zoom;
+	short tform;		/* IMGT_* flags */
+	short flags;		/* BLTF_* flags */
+	unsigned int x;		/* tile coordinates, in tiles */
+	unsigned int y;
+};
+
+struct tlc_tile;
+
+/* Cache instance; tiles are kept in order of use, most recent first */
+struct tile_cache {
+	struct tlc_tile *head;
+	struct tlc_tile *tail;
+	size_t cur_size;
+	size_t max_size;
+};
+
+/* Initialize 'tc' with a size limit in bytes; zero disables the cache */
+void tlc_init(struct tile_cache *tc, size_t max_size);
+
+/* Returns True if the cache is enabled */
+Bool tlc_enabled(const struct tile_cache *tc);
+
+/*
+ * Returns the tile matching 'key', or NULL. The tile remains owned by the
+ * cache and is only valid until the next tlc_put or tlc_purge call.
+ */
+XImage* tlc_get(struct tile_cache *tc, const struct tlc_key *key);
+
+/*
+ * Add 'img' for 'key' (which mustn't be in the cache), evicting least
+ * recently used tiles as necessary.
+ * The cache takes ownership of 'img', which is destroyed if it doesn't fit.
+ */
+void tlc_put(struct tile_cache *tc, const struct tlc_key *key, XImage *img);
+
+/* Drop all tiles; must be called whenever the source image changes */
+void tlc_purge(struct tile_cache *tc);
+
+#endif /* TILECACHE_H */
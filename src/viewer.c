@@ -32,7 +32,13 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <unistd.h>
+#include <sched.h>
 #include <math.h>
+#include <fcntl.h>
+#ifdef ENABLE_INOTIFY
+#include <sys/inotify.h>
+#include <limits.h>
+#endif
 #include "common.h"
 #include "viewerp.h"
 #include "menu.h"
@@ -47,6 +53,11 @@
 #include "browser.h"
 #include "bswap.h"
 #include "ioutil.h"
+#include "decoder.h"
+#include "thumbcache.h"
+#include "tilecache.h"
+#include "imgcache.h"
+#include "imgstore.h"
 #include "debug.h"
 #include "bitmaps/wmiconv.bm"
 #include "bitmaps/wmiconv_m.bm"
@@ -60,8 +71,44 @@ static void create_viewer_toolbar(struct viewer_data *vd);
 static Boolean load_image(struct viewer_data *vd, const char*, const char*);
 static void reset_viewer(struct viewer_data *vd);
 static int alloc_storage(struct viewer_data *vd);
+static int compact_depth(struct viewer_data *vd);
+static int set_compact_clut(struct viewer_data *vd);
+static unsigned long image_bg_pixel(struct viewer_data *vd);
 static void set_status_msg(struct viewer_data *vd,int msg_id, const char *text);
 static void update_back_buffer(struct viewer_data *vd);
+static void request_render(struct viewer_data *vd, unsigned short flags);
+static void render_frame(struct viewer_data *vd);
+static void render_timer_cb(XtPointer client, XtIntervalId *iid);
+static Boolean needs_refinement(struct viewer_data *vd);
+static void start_refinement(struct viewer_data *vd);
+static void cancel_refinement(struct viewer_data *vd);
+static Boolean refine_proc(XtPointer client);
+static Boolean scroll_back_buffer(struct viewer_data *vd,
+	int prev_ox, int prev_oy);
+static Boolean draw_back_buffer_rect(struct viewer_data *vd,
+	XImage *src, float zoom, int ox, int oy, int width, int height,
+	int x, int y, int rect_width, int rect_height, XRectangle *area);
+static Boolean draw_tiles(struct viewer_data *vd,
+	XImage *src, float zoom, int ox, int oy, int width, int height,
+	int x, int y, int rect_width, int rect_height);
+static XImage* create_display_image(unsigned int width, unsigned int height);
+static void update_loaded_rows(struct viewer_data *vd);
+static void put_back_buffer_rect(struct viewer_data *vd,
+	const XRectangle *area);
+static void alloc_back_pixmap(struct viewer_data *vd);
+static int pixmap_error_handler(Display *dpy, XErrorEvent *evt);
+static void update_back_pixmap(struct viewer_data *vd,
+	int width, int height);
+static void clip_to_back_buffer(struct viewer_data *vd,
+	int *width, int *height);
+static XImage* get_blit_source(struct viewer_data *vd,
+	float *zoom, int *ox, int *oy);
+static short get_blit_flags(struct viewer_data *vd);
+static XImage* get_mip_level(struct viewer_data *vd, float *zoom);
+static void free_derived_images(struct viewer_data *vd);
+static Boolean use_server_scaling(struct viewer_data *vd);
+static void draw_server_scaled(struct viewer_data *vd, int x, int y,
+	int width, int height, int dest_x, int dest_y);
 static void redraw_view(struct viewer_data *vd, Boolean clear);
 static void zoom_view(struct viewer_data *vd, float zoom);
 static void rotate_view(struct viewer_data *vd, Boolean cw);
@@ -74,6 +121,58 @@ static void clear_dir_cache(struct viewer_data*);
 static int scanline_read_cb(unsigned long, const uint8_t*, void*);
 static void load_next_page(struct viewer_data *vd, Bool forward);
 static void load_next_file(struct viewer_data *vd, Bool forward);
+static void navigate_to(struct viewer_data *vd, const char *fname);
+static void nav_timer_cb(XtPointer client, XtIntervalId *iid);
+static void start_follow(struct viewer_data *vd);
+static void stop_follow(struct viewer_data *vd);
+static void follow_update(struct viewer_data *vd);
+static void follow_timer_cb(XtPointer client, XtIntervalId *iid);
+#ifdef ENABLE_INOTIFY
+static void follow_input_cb(XtPointer client, int *pfd, XtInputId *iid);
+#endif
+static void resume_loading(struct viewer_data *vd,
+	struct img_file *img_file, const struct stat *st);
+static void alloc_wide(struct viewer_data *vd);
+static void free_wide(struct viewer_data *vd);
+static void build_lut(struct viewer_data *vd);
+static void map_samples(const struct viewer_data *vd,
+	uint8_t *dest, const uint16_t *src);
+static void apply_levels(struct viewer_data *vd);
+static void map_level_rows(struct viewer_data *vd,
+	unsigned long top, unsigned long bottom);
+static void remap_rows(struct viewer_data *vd,
+	unsigned long top, unsigned long bottom);
+static void set_levels(struct viewer_data *vd, float window, float level);
+static Boolean has_cached_image(struct viewer_data *vd,
+	const char *fname, const struct stat *st);
+static void show_preview(struct viewer_data *vd);
+static void show_loaded_image(struct viewer_data *vd);
+static Boolean seed_image(struct viewer_data *vd);
+static void reduce_resolution(struct viewer_data *vd);
+static void start_full_resolution(struct viewer_data *vd);
+static void stop_full_resolution(struct viewer_data *vd);
+static void show_full_resolution(struct viewer_data *vd);
+static void* full_res_thread(void *arg);
+static int full_res_read_cb(unsigned long, const uint8_t*, void*);
+static void get_image_size(struct viewer_data *vd,
+	unsigned long *width, unsigned long *height);
+static char* make_dir_path(struct viewer_data *vd, const char *title);
+static void start_prefetch(struct viewer_data *vd);
+static void stop_prefetch(struct viewer_data *vd);
+static void clear_prefetch(struct viewer_data *vd);
+static void cache_current_image(struct viewer_data *vd);
+static XImage* take_cached_image(struct viewer_data *vd,
+	const char *fname, const struct stat *st, int page,
+	struct prefetch_slot *info);
+static void* prefetch_thread(void *arg);
+static XImage* fit_image(XImage *img, unsigned int width, unsigned int height);
+static void start_slideshow(struct viewer_data *vd);
+static void stop_slideshow(struct viewer_data *vd);
+static void schedule_slideshow(struct viewer_data *vd);
+static void slideshow_timer_cb(XtPointer client, XtIntervalId *iid);
+static void slideshow_shown(struct viewer_data *vd);
+static unsigned long slideshow_step(struct viewer_data *vd,
+	unsigned long cur, long n);
 static void update_shell_title(struct viewer_data *vd);
 static void update_props_msg(struct viewer_data *vd);
 static void update_page_msg(struct viewer_data *vd);
@@ -82,6 +181,7 @@ static void update_controls(struct viewer_data *vd);
 static void update_pointer_shape(struct viewer_data *vd);
 static Widget get_menu_item(struct viewer_data *vd, const char *name);
 static float compute_fit_zoom(struct viewer_data *vd);
+static unsigned int view_tform(struct viewer_data *vd);
 static void compute_image_dimensions(struct viewer_data *vd,
 	float zoom, unsigned int transfm, int *width, int *height);
 static void report_img_error(struct viewer_data *vd, int img_errno);
@@ -111,6 +211,12 @@ static void rotate_left_cb(Widget,XtPointer,XtPointer);
 static void rotate_reset_cb(Widget,XtPointer,XtPointer);
 static void rotate_lock_cb(Widget,XtPointer,XtPointer);
 static void refresh_cb(Widget,XtPointer,XtPointer);
+static void follow_cb(Widget,XtPointer,XtPointer);
+static void slideshow_cb(Widget,XtPointer,XtPointer);
+static void invert_levels_cb(Widget,XtPointer,XtPointer);
+static void gamma_up_cb(Widget,XtPointer,XtPointer);
+static void gamma_down_cb(Widget,XtPointer,XtPointer);
+static void reset_levels_cb(Widget,XtPointer,XtPointer);
 static void open_cb(Widget,XtPointer,XtPointer);
 static void edit_cb(Widget,XtPointer,XtPointer);
 static void pass_to_cb(Widget,XtPointer,XtPointer);
@@ -131,6 +237,9 @@ static void help_topics_cb(Widget w, XtPointer client, XtPointer call);
 /* Linked list of viewer instances */
 struct viewer_data *viewers=NULL;
 
+/* Set by pixmap_error_handler; only accessed from the main thread */
+static Bool pixmap_failed;
+
 /*
  * Create new viewer_data with a shell and widgets and link it into the list.
  */
@@ -153,6 +262,12 @@ static struct viewer_data* create_viewer(const struct app_resources *res)
 		return NULL;
 	}
 	vd->vprog=res->vprog;
+	vd->follow=res->follow_changes;
+	vd->follow_fd=-1;
+	vd->keep_wide=res->high_bit_depth;
+	vd->lv_window=LUT_SIZE;
+	vd->lv_level=LUT_SIZE/2;
+	vd->lv_gamma=1.0;
 	vd->keep_tform=res->keep_tform;
 	vd->show_tbr=res->show_viewer_tbr;
 	vd->large_tbr=res->large_tbr_icons;
@@ -168,6 +283,44 @@ static struct viewer_data* create_viewer(const struct app_resources *res)
 	}else{
 		vd->key_pan_amount=res->key_pan_amount;
 	}
+	if(res->prefetch_depth<0 || res->prefetch_depth>MAX_PREFETCH_DEPTH){
+		warning_msg("Illegal value for \"PrefetchDepth\". Using default.");
+		vd->pf_depth=DEF_PREFETCH_DEPTH;
+	}else{
+		vd->pf_depth=res->prefetch_depth;
+	}
+	if(res->prefetch_mem<0){
+		warning_msg("Illegal value for \"PrefetchMemory\". Using default.");
+		vd->pf_mem_max=(size_t)DEF_PREFETCH_MEM*1024*1024;
+	}else{
+		vd->pf_mem_max=(size_t)res->prefetch_mem*1024*1024;
+	}
+	if(res->slideshow_int<1){
+		warning_msg("Illegal value for \"SlideshowInterval\". Using default.");
+		vd->ss_interval=DEF_SLIDESHOW_INT*1000;
+	}else{
+		vd->ss_interval=(unsigned long)res->slideshow_int*1000;
+	}
+	if(!strcasecmp(res->slideshow_order,"name")){
+		vd->ss_order=SSO_NAME;
+	}else if(!strcasecmp(res->slideshow_order,"reverse")){
+		vd->ss_order=SSO_REVERSE;
+	}else if(!strcasecmp(res->slideshow_order,"random")){
+		vd->ss_order=SSO_RANDOM;
+	}else{
+		warning_msg("Illegal value for \"SlideshowOrder\". Using default.");
+		vd->ss_order=SSO_NAME;
+	}
+	/* seeded once, so that each pass is shuffled differently */
+	vd->ss_seed=(unsigned int)time(NULL)^(unsigned int)getpid()^
+		(unsigned int)(uintptr_t)vd;
+	vd->ss_active=res->slideshow;
+	if(res->render_cache_size<0){
+		warning_msg("Illegal value for \"RenderCacheSize\". Using default.");
+		tlc_init(&vd->tiles,(size_t)DEF_RENDER_CACHE_SIZE*1024*1024);
+	}else{
+		tlc_init(&vd->tiles,(size_t)res->render_cache_size*1024*1024);
+	}
 	
 	vd->wshell=XtVaAppCreateShell("ximagingViewer",APP_CLASS "Viewer",
 		applicationShellWidgetClass,app_inst.display,
@@ -300,13 +453,26 @@ static struct viewer_data* create_viewer(const struct app_resources *res)
 	gc_values.plane_mask=AllPlanes;
 	vd->blit_gc=XCreateGC(app_inst.display,XtWindow(vd->wview),
 		GCFunction|GCBackground|GCPlaneMask,&gc_values);
+	
+	/* client side scaling is used if RENDER isn't there */
+	vd->srv_enabled=(res->server_scaling &&
+		app_inst.visual_info.class==TrueColor &&
+		xrb_available(app_inst.display,app_inst.visual_info.visual));
+	alloc_back_pixmap(vd);
 
 	/* initialize thread related data and add thread notification input */
 	if(pthread_cond_init(&vd->ldr_finished_cond,NULL)||
 		pthread_cond_init(&vd->rdr_finished_cond,NULL)||
+		pthread_cond_init(&vd->pf_finished_cond,NULL)||
+		pthread_cond_init(&vd->fr_finished_cond,NULL)||
 		pthread_mutex_init(&vd->ldr_cond_mutex,NULL) ||
 		pthread_mutex_init(&vd->rdr_cond_mutex,NULL) ||
+		pthread_mutex_init(&vd->pf_cond_mutex,NULL) ||
+		pthread_mutex_init(&vd->fr_cond_mutex,NULL) ||
+		pthread_mutex_init(&vd->dmg_mutex,NULL) ||
 		pthread_mutex_init(&vd->thread_notify_mutex,NULL)){
+			if(vd->srv_dest) xrb_free_dest(app_inst.display,vd->srv_dest);
+			if(vd->bkpix) XFreePixmap(app_inst.display,vd->bkpix);
 			XtDestroyWidget(vd->wshell);
 			XDestroyImage(vd->bkbuf);
 			XFreeGC(app_inst.display,vd->blit_gc);
@@ -340,6 +506,10 @@ static struct viewer_data* create_viewer(const struct app_resources *res)
 
 	XmToggleButtonGadgetSetState(
 		get_menu_item(vd,"*zoomFit"),res->zoom_fit,True);
+	XmToggleButtonGadgetSetState(
+		get_menu_item(vd,"*follow"),res->follow_changes,False);
+	XmToggleButtonGadgetSetState(
+		get_menu_item(vd,"*slideshow"),res->slideshow,False);
 	update_controls(vd);
 	update_props_msg(vd);
 	display_status_summary(vd);
@@ -356,8 +526,15 @@ static Boolean load_image(struct viewer_data *vd, const char *fname,
 	struct stat st;
 	int img_errno;
 	char *new_path;
+	XImage *pf_image;
+	struct prefetch_slot pf_info;
+	Boolean seeded;
 	
-	if(vd->state&(ISF_OPENED|ISF_LOADING|ISF_READY))
+	/* keep the current image around in case the user comes back to it */
+	stop_prefetch(vd);
+	cache_current_image(vd);
+	
+	if((vd->state&(ISF_OPENED|ISF_LOADING|ISF_READY)) || vd->nav_pending)
 		reset_viewer(vd);
 
 	vd->file_name=strdup(fname);
@@ -383,13 +560,53 @@ static Boolean load_image(struct viewer_data *vd, const char *fname,
 		vd->dir_name=new_path;
 	}
 
+	pf_image=force_suffix?NULL:
+		take_cached_image(vd,vd->file_name,&st,0,&pf_info);
+
 	/* open the image and allocate initial buffers */
-	img_errno = img_open(vd->file_name, force_suffix, &vd->img_file,0);
+	img_errno = img_open(vd->file_name, force_suffix, &vd->img_file,
+		vd->keep_wide?IMG_OPEN_WIDE:0);
 	if(img_errno){
+		if(pf_image) XDestroyImage(pf_image);
 		report_img_error(vd,img_errno);
 		reset_viewer(vd);
 		return False;
 	}
+	start_follow(vd);
+	
+	/* if it has been decoded already, just swap it in, unless
+	 * samples are to be retained for levels adjustment */
+	if(pf_image){
+		/* scaled down to fit the view, see fit_image */
+		Boolean scaled=(pf_info.full_width && vd->img_file.npages<=1 &&
+			pf_info.full_width==vd->img_file.width &&
+			pf_info.full_height==vd->img_file.height);
+		
+		if(!(vd->img_file.flags&IMGF_WIDE) && (scaled ||
+			(pf_image->width==vd->img_file.width &&
+			pf_image->height==vd->img_file.height))){
+			vd->image=pf_image;
+			vd->pf_decode_time=pf_info.decode_time;
+			if(scaled){
+				vd->reduced=True;
+				vd->full_width=pf_info.full_width;
+				vd->full_height=pf_info.full_height;
+			}
+			vd->state|=ISF_OPENED;
+			update_shell_title(vd);
+			update_props_msg(vd);
+			show_loaded_image(vd);
+			start_prefetch(vd);
+			return True;
+		}
+		XDestroyImage(pf_image);
+	}
+	
+	vd->pf_decode_time=0;
+	
+	/* only as much as needed to fit the view, if forced, it
+	 * can't be reopened for full resolution decoding */
+	if(!force_suffix) reduce_resolution(vd);
 
 	img_errno=alloc_storage(vd);
 	if(img_errno){
@@ -398,12 +615,15 @@ static Boolean load_image(struct viewer_data *vd, const char *fname,
 		return False;
 	}
 
-	/* set up vprog if enabled */
-	if(vd->vprog){
+	/* set up vprog if enabled, or show the preview if there's one */
+	seeded=seed_image(vd);
+	if(vd->vprog || vd->follow || seeded){
 		img_fill_rect(vd->bkbuf,0,0,vd->bkbuf->width,
 			vd->bkbuf->height,vd->bg_pixel);
-		img_fill_rect(vd->image,0,0,vd->image->width,
-			vd->image->height,vd->bg_pixel);
+		if(!seeded){
+			img_fill_rect(vd->image,0,0,vd->image->width,
+				vd->image->height,image_bg_pixel(vd));
+		}
 		if(vd->zoom_fit)
 			vd->zoom=compute_fit_zoom(vd);
 		else
@@ -414,8 +634,11 @@ static Boolean load_image(struct viewer_data *vd, const char *fname,
 	vd->state|=ISF_OPENED;
 	update_shell_title(vd);
 	update_props_msg(vd);
+	alloc_wide(vd);
 	vd->state|=ISF_LOADING;
 	vd->load_prog=0;
+	vd->rows_read=0;
+	vd->dmg_top=vd->dmg_bottom=0;
 	if(pthread_create(&vd->ldr_thread,NULL,loader_thread,(void*)vd)){
 		vd->state&=(~ISF_LOADING);
 		report_img_error(vd,IMG_ENOMEM);
@@ -423,6 +646,7 @@ static Boolean load_image(struct viewer_data *vd, const char *fname,
 		return False;
 	}
 	pthread_detach(vd->ldr_thread);
+	if(seeded) request_render(vd,RF_UPDATE|RF_CLEAR);
 
 	update_controls(vd);
 	/* set up timers */
@@ -463,8 +687,17 @@ static void destroy_viewer(struct viewer_data *vd)
 	}
 	#endif /* ENABLE_CDE */
 
-	if(vd->state&(ISF_READY|ISF_LOADING|ISF_OPENED))
+	if((vd->state&(ISF_READY|ISF_LOADING|ISF_OPENED)) || vd->nav_pending)
 		reset_viewer(vd);
+	if(vd->nav_timer) XtRemoveTimeOut(vd->nav_timer);
+	if(vd->render_timer) XtRemoveTimeOut(vd->render_timer);
+	cancel_refinement(vd);
+	stop_follow(vd);
+	if(vd->lut) free(vd->lut);
+	stop_slideshow(vd);
+	if(vd->srv_dest) xrb_free_dest(app_inst.display,vd->srv_dest);
+	if(vd->bkpix) XFreePixmap(app_inst.display,vd->bkpix);
+	clear_prefetch(vd);
 	clear_dir_cache(vd);
 	if(vd->wfile_dlg) XtDestroyWidget(vd->wfile_dlg);
 	XtDestroyWidget(vd->wshell);
@@ -473,8 +706,13 @@ static void destroy_viewer(struct viewer_data *vd)
 	
 	pthread_cond_destroy(&vd->ldr_finished_cond);
 	pthread_cond_destroy(&vd->rdr_finished_cond);
+	pthread_cond_destroy(&vd->pf_finished_cond);
+	pthread_cond_destroy(&vd->fr_finished_cond);
 	pthread_mutex_destroy(&vd->ldr_cond_mutex);
 	pthread_mutex_destroy(&vd->rdr_cond_mutex);
+	pthread_mutex_destroy(&vd->pf_cond_mutex);
+	pthread_mutex_destroy(&vd->fr_cond_mutex);
+	pthread_mutex_destroy(&vd->dmg_mutex);
 	pthread_mutex_destroy(&vd->thread_notify_mutex);
 	XtRemoveInput(vd->thread_notify_input);
 	close(vd->tnfd[0]);
@@ -548,6 +786,8 @@ static void load_next_page(struct viewer_data *vd, Bool forward)
 {
 	int img_errno;
 	struct stat st;
+	XImage *image;
+	unsigned long prev_width, prev_height;
 	
 	dassert(vd->img_file.npages);
 	
@@ -574,6 +814,12 @@ static void load_next_page(struct viewer_data *vd, Bool forward)
 	}
 	pthread_mutex_unlock(&vd->ldr_cond_mutex);
 	
+	get_image_size(vd,&prev_width,&prev_height);
+	stop_full_resolution(vd);
+	cache_current_image(vd);
+	free_derived_images(vd);
+	vd->reduced=False;
+	
 	if(forward){
 		if(++vd->cur_page==vd->img_file.npages)
 			update_controls(vd);
@@ -591,27 +837,59 @@ static void load_next_page(struct viewer_data *vd, Bool forward)
 		reset_viewer(vd);
 		return;
 	}
-	/* realloc storage and reset view values if pages differ in size */
-	if(vd->img_file.width!=vd->image->width ||
+	
+	/* pages viewed before may still be in the image cache */
+	image=take_cached_image(vd,vd->file_name,&st,vd->cur_page,NULL);
+	if(image && (image->width!=vd->img_file.width ||
+		image->height!=vd->img_file.height)){
+		XDestroyImage(image);
+		image=NULL;
+	}
+	if(image){
+		free_wide(vd);
+		if(vd->image) XDestroyImage(vd->image);
+		vd->image=image;
+		if(image->width!=prev_width || image->height!=prev_height)
+			vd->xoff=vd->yoff=0;
+		update_props_msg(vd);
+		show_loaded_image(vd);
+		start_prefetch(vd);
+		return;
+	}
+	
+	/* realloc storage and reset view values if pages differ in size
+	 * or format; compact images need the page's own color table */
+	if(vd->image && IMG_IS_COMPACT(vd->image) &&
+		vd->image->depth==compact_depth(vd) &&
+		vd->img_file.width==vd->image->width &&
+		vd->img_file.height==vd->image->height){
+		img_errno=set_compact_clut(vd);
+		if(img_errno){
+			report_img_error(vd,img_errno);
+			reset_viewer(vd);
+			return;
+		}
+	}else if(!vd->image || vd->img_file.width!=vd->image->width ||
 		vd->img_file.height!=vd->image->height ||
-		vd->img_file.bpp!=vd->image->depth){
-		XDestroyImage(vd->image);
+		IMG_IS_COMPACT(vd->image) || compact_depth(vd)){
+		if(vd->image) XDestroyImage(vd->image);
 		img_errno=alloc_storage(vd);
 		if(img_errno){
 			report_img_error(vd,img_errno);
 			reset_viewer(vd);
 			return;
 		}
-		vd->xoff=vd->yoff=0;
+		if(vd->img_file.width!=prev_width ||
+			vd->img_file.height!=prev_height) vd->xoff=vd->yoff=0;
 		vd->zoom=1;
 		update_props_msg(vd);
 	}
 	/* setup vprog if enabled */
-	if(vd->vprog){
+	if(vd->vprog || vd->follow){
 		img_fill_rect(vd->bkbuf,0,0,vd->bkbuf->width,
 			vd->bkbuf->height,vd->bg_pixel);
 		img_fill_rect(vd->image,0,0,vd->image->width,
-			vd->image->height,vd->bg_pixel);
+			vd->image->height,image_bg_pixel(vd));
 		if(vd->zoom_fit)
 			vd->zoom=compute_fit_zoom(vd);
 		else
@@ -621,8 +899,11 @@ static void load_next_page(struct viewer_data *vd, Bool forward)
 	update_controls(vd);
 	
 	/* launch the loader thread */
+	alloc_wide(vd);
 	vd->state|=ISF_LOADING;
 	vd->load_prog=0;
+	vd->rows_read=0;
+	vd->dmg_top=vd->dmg_bottom=0;
 	if(pthread_create(&vd->ldr_thread,NULL,loader_thread,(void*)vd)){
 		vd->state&=(~ISF_LOADING);
 		report_img_error(vd,IMG_ENOMEM);
@@ -648,6 +929,16 @@ static void load_next_file(struct viewer_data *vd, Bool forward)
 	struct stat st;
 	char *new_file_name;
 
+	/* being read for decode-ahead; navigate once it's done */
+	if(vd->state&DSF_READING){
+		vd->dir_bkgnd=False;
+		vd->dir_forward=forward;
+		set_widget_cursor(vd->wshell,CUR_HOURGLAS);
+		update_controls(vd);
+		set_status_msg(vd,SID_READDIRPG,"Reading directory...");
+		return;
+	}
+
 	if(vd->dir_name && stat(vd->dir_name,&st)){
 		errno_message_box(vd->wshell,errno,nlstr(
 				APP_MSGSET,SID_EREADDIR,"Error reading directory."),False);
@@ -666,7 +957,9 @@ static void load_next_file(struct viewer_data *vd, Bool forward)
 		}
 		pthread_mutex_unlock(&vd->ldr_cond_mutex);
 		vd->state|=DSF_READING;
+		vd->dir_bkgnd=False;
 		if(pthread_create(&vd->rdr_thread,NULL,dir_reader_thread,(void*)vd)){
+			vd->state&=(~DSF_READING);
 			errno_message_box(vd->wshell,errno,NULL,False);
 			return;
 		}
@@ -680,7 +973,9 @@ static void load_next_file(struct viewer_data *vd, Bool forward)
 	}
 	if(!vd->dir_nfiles) return;
 	
-	if(forward){
+	if(vd->ss_active && vd->ss_order==SSO_RANDOM){
+		vd->dir_cur_file=slideshow_step(vd,vd->dir_cur_file,forward?1:-1);
+	}else if(forward){
 		if(vd->dir_cur_file+1==vd->dir_nfiles)
 			vd->dir_cur_file=0;
 		else
@@ -691,921 +986,3137 @@ static void load_next_file(struct viewer_data *vd, Bool forward)
 		else
 			vd->dir_cur_file--;
 	}
-	new_file_name=malloc(strlen(vd->dir_name)+
-		strlen(vd->dir_files[vd->dir_cur_file])+2);
-	sprintf(new_file_name,"%s/%s",vd->dir_name,
-		vd->dir_files[vd->dir_cur_file]);
+	new_file_name=make_dir_path(vd,vd->dir_files[vd->dir_cur_file]);
+	if(!new_file_name) return;
 	
 	if(!vd->file_name || strcmp(vd->file_name, new_file_name))
-		load_image(vd, new_file_name, NULL);
+		navigate_to(vd, new_file_name);
 
 	free(new_file_name);
 }
 
 /*
- * Allocate an XImage according to img_file properties
- * Must return an IMG_* status value.
+ * Load 'fname' if it's the first of a series of navigation requests, or
+ * already decoded. Otherwise only the title and a thumbnail cache preview
+ * are updated, and the file is loaded once no further requests arrive
+ * within NAV_SETTLE_INT, so that files skipped over aren't decoded.
  */
-static int alloc_storage(struct viewer_data *vd)
+static void navigate_to(struct viewer_data *vd, const char *fname)
 {
-	/* storage for a complete image */
-	vd->image=XCreateImage(app_inst.display,app_inst.visual_info.visual,
-		app_inst.visual_info.depth,ZPixmap,0,NULL,vd->img_file.width,
-		vd->img_file.height,app_inst.pixel_size,0);
-	if(vd->image){
-		vd->image->data=calloc(1,vd->img_file.height*vd->image->bytes_per_line);
-	}
-	if(!vd->image || !vd->image->data){
-		XDestroyImage(vd->image);
-		return IMG_ENOMEM;
+	struct stat st;
+	Boolean repeated=(vd->nav_timer!=None);
+	
+	if(!repeated || (!stat(fname,&st) && has_cached_image(vd,fname,&st))){
+		load_image(vd,fname,NULL);
+	}else{
+		stop_prefetch(vd);
+		cache_current_image(vd);
+		if((vd->state&(ISF_OPENED|ISF_LOADING|ISF_READY)) || vd->nav_pending)
+			reset_viewer(vd);
+		
+		vd->file_name=strdup(fname);
+		if(vd->file_name){
+			vd->nav_pending=True;
+			update_shell_title(vd);
+			set_status_msg(vd,SID_LOADING,"Loading...");
+			show_preview(vd);
+		}
 	}
-	vd->image->bitmap_bit_order=vd->image->byte_order=
-		(is_big_endian())?MSBFirst:LSBFirst;
-	_XInitImageFuncPtrs(vd->image);
-	return 0;
+	
+	if(vd->nav_timer) XtRemoveTimeOut(vd->nav_timer);
+	vd->nav_timer=XtAppAddTimeOut(app_inst.context,NAV_SETTLE_INT,
+		nav_timer_cb,(XtPointer)vd);
 }
 
 /*
- * The image loader thread entry point. Don't make any X/Motif calls here.
+ * Load the file navigated to, once navigation requests have settled
  */
-static void* loader_thread(void *arg)
+static void nav_timer_cb(XtPointer client, XtIntervalId *iid)
 {
-	struct proc_thread_msg tmsg;
-	struct loader_cb_data *cbd;
-	struct viewer_data *vd=(struct viewer_data*)arg;
-	int img_errno=0;
-
-	cbd=calloc(1,sizeof(struct loader_cb_data));
-	if(!cbd){
-		img_errno=IMG_ENOMEM;
-		free(cbd);
-		goto loader_thread_exit;
-	}
-	cbd->vd=vd;
-	/* check if pseudo-color and read the lookup table if so */
-	if(vd->img_file.format==IMG_PSEUDO){
-		cbd->clut=malloc(IMG_CLUT_SIZE);
-		if(!cbd->clut){
-			img_errno=IMG_ENOMEM;
-			free(cbd);
-			goto loader_thread_exit;
-		}
-		img_errno=img_read_cmap(&vd->img_file,cbd->clut);
-		if(img_errno){
-			free(cbd->clut);
-			free(cbd);
-			goto loader_thread_exit;
-		}
-	}
-
-	img_errno=init_pixel_format(&cbd->image_pf,vd->img_file.bpp,
-		vd->img_file.red_mask,vd->img_file.green_mask,
-		vd->img_file.blue_mask,vd->img_file.alpha_mask,
-		vd->img_file.bg_pixel,vd->img_file.flags);
-
-	if(!img_errno){
-		img_errno=img_read_scanlines(&vd->img_file,
-			scanline_read_cb,(void*)cbd);
-	}
-	if(cbd->clut) free(cbd->clut);
-	free(cbd);
+	struct viewer_data *vd=(struct viewer_data*)client;
+	char *fname;
 	
-	/* always go there to exit the thread */
-	loader_thread_exit:
-	pthread_mutex_lock(&vd->ldr_cond_mutex);
-
-	tmsg.cancelled=(vd->state&ISF_CANCEL)?True:False;
-	vd->state&=(~(ISF_LOADING|ISF_CANCEL));
-	pthread_cond_signal(&vd->ldr_finished_cond);
-	pthread_mutex_unlock(&vd->ldr_cond_mutex);
-	tmsg.proc=TP_IMG_LOAD;
-	tmsg.result=img_errno;
-	pthread_mutex_lock(&vd->thread_notify_mutex);
-	writen(vd->tnfd[TNFD_OUT], &tmsg, sizeof(struct proc_thread_msg));
-	pthread_mutex_unlock(&vd->thread_notify_mutex);
-	return NULL;
+	vd->nav_timer=None;
+	if(!vd->nav_pending) return;
+	
+	fname=vd->file_name;
+	vd->file_name=NULL;
+	vd->nav_pending=False;
+	load_image(vd,fname,NULL);
+	free(fname);
 }
 
 /*
- * The scaline reader callback proc
+ * Start watching the current file for changes if follow mode is enabled.
+ * With inotify its directory is watched, so that files replaced by renaming
+ * are noticed as well. Otherwise the file's status is polled.
  */
-static int scanline_read_cb(unsigned long iscl,
-	const uint8_t *data, void *client)
+static void start_follow(struct viewer_data *vd)
 {
-	struct loader_cb_data *cbd=(struct loader_cb_data*)client;
-	uint8_t *ptr=(uint8_t*)&cbd->vd->image->data
-		[iscl*cbd->vd->image->bytes_per_line];
-
-	dassert(iscl < cbd->vd->img_file.height);
+	stop_follow(vd);
+	if(!vd->follow || !vd->file_name || !vd->dir_name) return;
 	
-	if(app_inst.visual_info.class==PseudoColor){
-		if(cbd->vd->img_file.format==IMG_PSEUDO){
-			remap_pixels(ptr,data,cbd->clut,cbd->vd->img_file.width);
-		}else{
-			rgb_pixels_to_clut(ptr,data,&cbd->image_pf,
-				cbd->vd->img_file.width);
-		}
-	}else{
-		if(cbd->vd->img_file.format==IMG_PSEUDO){
-			clut_to_rgb_pixels(ptr,&cbd->vd->display_pf,data,
-				cbd->clut,cbd->vd->img_file.width);
-		}else{
-			convert_rgb_pixels(ptr,&cbd->vd->display_pf,data,
-				&cbd->image_pf,cbd->vd->img_file.width);
+	#ifdef ENABLE_INOTIFY
+	vd->follow_fd=inotify_init();
+	if(vd->follow_fd!=-1){
+		fcntl(vd->follow_fd,F_SETFD,FD_CLOEXEC);
+		fcntl(vd->follow_fd,F_SETFL,O_NONBLOCK);
+		if(inotify_add_watch(vd->follow_fd,vd->dir_name,
+			IN_MODIFY|IN_CLOSE_WRITE|IN_CREATE|IN_MOVED_TO)!=-1){
+			vd->follow_input=XtAppAddInput(app_inst.context,vd->follow_fd,
+				(XtPointer)XtInputReadMask,follow_input_cb,(XtPointer)vd);
+			return;
 		}
+		close(vd->follow_fd);
+		vd->follow_fd=-1;
 	}
-	if(cbd->vd->state&ISF_CANCEL) return IMG_READ_CANCEL;
-
-	cbd->nscl++;
-	cbd->vd->load_prog=ceil((float)cbd->nscl/
-		((float)cbd->vd->img_file.height*0.01));
+	#endif /* ENABLE_INOTIFY */
+	
+	vd->follow_mtime=vd->mod_time;
+	vd->follow_size=vd->file_size;
+	vd->follow_timer=XtAppAddTimeOut(app_inst.context,FOLLOW_POLL_INT,
+		follow_timer_cb,(XtPointer)vd);
+}
 
-	return IMG_READ_CONT;
+static void stop_follow(struct viewer_data *vd)
+{
+	if(vd->follow_timer){
+		XtRemoveTimeOut(vd->follow_timer);
+		vd->follow_timer=None;
+	}
+	#ifdef ENABLE_INOTIFY
+	if(vd->follow_fd!=-1){
+		XtRemoveInput(vd->follow_input);
+		close(vd->follow_fd);
+		vd->follow_fd=-1;
+	}
+	#endif /* ENABLE_INOTIFY */
 }
 
+#ifdef ENABLE_INOTIFY
 /*
- * Receives notifications from work threads through XtInput
+ * Restarts the settle timer whenever the followed file is written to
  */
-static void thread_callback_proc(XtPointer client, int *pfd, XtInputId *iid)
+static void follow_input_cb(XtPointer client, int *pfd, XtInputId *iid)
 {
 	struct viewer_data *vd=(struct viewer_data*)client;
-	struct proc_thread_msg tmsg;
+	union {
+		struct inotify_event ev;
+		char buf[sizeof(struct inotify_event)+NAME_MAX+1];
+	} evb;
+	const char *title;
+	Boolean changed=False;
+	ssize_t len;
 	
-	if(readn(vd->tnfd[TNFD_IN], &tmsg, sizeof(struct proc_thread_msg))
-		< sizeof(struct proc_thread_msg)) return;
-
-	if(tmsg.proc==TP_IMG_LOAD){	
-		if(tmsg.result){
-			report_img_error(vd,tmsg.result);
-			reset_viewer(vd);
-		}else if(!tmsg.cancelled){
-			vd->state|=ISF_READY;
-			display_status_summary(vd);
-			update_controls(vd);
-			if(vd->zoom_fit)
-				vd->zoom=compute_fit_zoom(vd);
-			else
-				vd->zoom=1;
-			update_back_buffer(vd);
-			redraw_view(vd,False);
-			update_page_msg(vd);
-			update_pointer_shape(vd);
-			XmUpdateDisplay(vd->wshell);
-		}
-	}else if(tmsg.proc==TP_DIR_READ){
-		set_widget_cursor(vd->wshell,CUR_POINTER);
-		update_controls(vd);
-		display_status_summary(vd);
-		XmUpdateDisplay(vd->wshell);
-		if(tmsg.result){
-			errno_message_box(vd->wshell,tmsg.result,
-				nlstr(APP_MSGSET,SID_EREADDIR,
-				"Error reading directory."),False);
-		}else if(!tmsg.cancelled && vd->dir_nfiles){
-			load_next_file(vd,vd->dir_forward);
+	title=strrchr(vd->file_name,'/');
+	title=(title)?title+1:vd->file_name;
+	
+	while((len=read(vd->follow_fd,evb.buf,sizeof(evb)))>0){
+		char *ptr=evb.buf;
+		
+		while(ptr<evb.buf+len){
+			struct inotify_event *ev=(struct inotify_event*)ptr;
+			
+			if(ev->len && !strcmp(ev->name,title)) changed=True;
+			ptr+=sizeof(struct inotify_event)+ev->len;
 		}
 	}
+	if(!changed) return;
+	
+	if(vd->follow_timer) XtRemoveTimeOut(vd->follow_timer);
+	vd->follow_timer=XtAppAddTimeOut(app_inst.context,FOLLOW_SETTLE_INT,
+		follow_timer_cb,(XtPointer)vd);
 }
+#endif /* ENABLE_INOTIFY */
 
 /*
- * Timed framebuffer update handler
+ * Settle timer expiry, or status poll. When polling, the file is considered
+ * settled once its status is the same as at the previous poll.
  */
-static void load_fb_update_handler(XtPointer client, XtIntervalId *iid)
+static void follow_timer_cb(XtPointer client, XtIntervalId *iid)
 {
 	struct viewer_data *vd=(struct viewer_data*)client;
+	struct stat st;
 	
-	if(vd->state&ISF_LOADING && !(vd->state&ISF_CANCEL)){
-		update_back_buffer(vd);
-		redraw_view(vd,False);
-		vd->vprog_timer=XtAppAddTimeOut(app_inst.context,LOADER_FB_UPDATE_INT,
-				load_fb_update_handler,(XtPointer)vd);
-	}else{
-		vd->vprog_timer=None;
+	vd->follow_timer=None;
+	
+	#ifdef ENABLE_INOTIFY
+	if(vd->follow_fd!=-1){
+		follow_update(vd);
+		return;
+	}
+	#endif /* ENABLE_INOTIFY */
+	
+	if(!stat(vd->file_name,&st)){
+		if(st.st_mtime==vd->follow_mtime && st.st_size==vd->follow_size)
+			follow_update(vd);
+		vd->follow_mtime=st.st_mtime;
+		vd->follow_size=st.st_size;
+	}
+	
+	/* unless it has been restarted by a reload */
+	if(!vd->follow_timer && vd->follow && (vd->state&ISF_OPENED)){
+		vd->follow_timer=XtAppAddTimeOut(app_inst.context,FOLLOW_POLL_INT,
+			follow_timer_cb,(XtPointer)vd);
 	}
 }
 
 /*
- * Update the loading progress message.
- * This function is called by a timed event.
+ * Bring the view up to date with the followed file. Reading is resumed
+ * where it stopped if the loader can skip scanlines read already, a page
+ * added to a multi-page file is switched to, otherwise the file is read
+ * again from scratch.
  */
-static void load_prog_handler(XtPointer client, XtIntervalId *iid)
+static void follow_update(struct viewer_data *vd)
 {
-	Arg arg[1];
-	XmString str;
-	char *msg_text;
-	char *prog_msg;
-	size_t len;
-	struct viewer_data *vd=(struct viewer_data*)client;
+	struct img_file img_file;
+	struct stat st;
+	char *fname;
 	
-	if(vd->state&ISF_LOADING && !(vd->state&ISF_CANCEL)){
-		msg_text=nlstr(APP_MSGSET,SID_LOADING,"Loading...");
-		len=strlen(msg_text)+12;
-		prog_msg=alloca(len+1);
-		snprintf(prog_msg,len,"%s%d%%",msg_text,vd->load_prog);
-		str=XmStringCreateLocalized(prog_msg);
-		XtSetArg(arg[0],XmNlabelString,str);
-		XtSetValues(vd->wmsg,arg,1);
-		XmUpdateDisplay(vd->wmsg);
-		XmStringFree(str);
-		vd->prog_timer=XtAppAddTimeOut(app_inst.context,PROG_UPDATE_INT,
-				load_prog_handler,(XtPointer)vd);
-	}else{
-		vd->prog_timer=None;
+	if(!(vd->state&ISF_OPENED) || vd->nav_pending) return;
+	
+	/* still busy reading, try again later */
+	if(vd->state&ISF_LOADING){
+		if(vd->follow_timer) XtRemoveTimeOut(vd->follow_timer);
+		vd->follow_timer=XtAppAddTimeOut(app_inst.context,FOLLOW_SETTLE_INT,
+			follow_timer_cb,(XtPointer)vd);
+		return;
+	}
+	
+	if(stat(vd->file_name,&st) || (st.st_mtime==vd->mod_time &&
+		st.st_size==vd->file_size)) return;
+	
+	/* if the header isn't complete yet, there will be more writes */
+	if(img_open(vd->file_name,NULL,&img_file,
+		vd->keep_wide?IMG_OPEN_WIDE:0)) return;
+	
+	if(img_file.npages>1){
+		int page=vd->cur_page;
+		
+		if(img_file.npages>vd->img_file.npages) page=img_file.npages-1;
+		if(page>=img_file.npages) page=img_file.npages-1;
+
+		/* the current page isn't to be cached, it may be outdated */
+		vd->state&=(~ISF_READY);
+		img_close(&vd->img_file);
+		vd->img_file=img_file;
+		vd->mod_time=st.st_mtime;
+		vd->file_size=st.st_size;
+		vd->partial=False;
+		vd->cur_page=page-1;
+		load_next_page(vd,True);
+		return;
+	}
+
+	if(vd->partial && !vd->reduced && vd->image &&
+		st.st_size>=vd->file_size &&
+		img_file.width==vd->img_file.width &&
+		img_file.height==vd->img_file.height &&
+		img_file.bpp==vd->img_file.bpp &&
+		img_file.format==vd->img_file.format &&
+		img_file.flags==vd->img_file.flags &&
+		img_file.red_mask==vd->img_file.red_mask &&
+		img_file.green_mask==vd->img_file.green_mask &&
+		img_file.blue_mask==vd->img_file.blue_mask &&
+		img_file.alpha_mask==vd->img_file.alpha_mask &&
+		!img_skip_scanlines(&img_file,vd->rows_read)){
+		resume_loading(vd,&img_file,&st);
+		return;
 	}
+	img_close(&img_file);
+	
+	fname=strdup(vd->file_name);
+	if(!fname) return;
+	reset_viewer(vd);
+	load_image(vd,fname,NULL);
+	free(fname);
 }
 
 /*
- * qsort compare function for read_directory
+ * Continue reading a partially read file with 'img_file', which has been
+ * set up to start with the first scanline not read yet.
  */
-static int fn_sort_compare(const void *pa, const void *pb)
+static void resume_loading(struct viewer_data *vd,
+	struct img_file *img_file, const struct stat *st)
 {
-	const char **a=(const char**)pa;
-	const char **b=(const char**)pb;
-	return strcmp(*a,*b);
-}
-
-/*
- * Directory reader thread entry point
- */
-static void* dir_reader_thread(void *arg)
-{
-	struct viewer_data *vd=(struct viewer_data*)arg;
-	struct proc_thread_msg tmsg;
-	DIR *dir;
-	struct dirent *dir_ent;
-	size_t buf_size=0;
-	int i;
-	int icur_file=0;
-	int ret_code=0;
-	char **files=NULL;
-	unsigned long nfiles=0;
-	char *tmp_name = NULL;
-	size_t tmp_name_len = 0;
-
-	dassert(vd->dir_name);
+	img_close(&vd->img_file);
+	vd->img_file=*img_file;
+	vd->mod_time=st->st_mtime;
+	vd->file_size=st->st_size;
+	vd->partial=False;
 	
-	if(vd->dir_nfiles){
-		while(vd->dir_nfiles--)
-			free(vd->dir_files[vd->dir_nfiles]);
-		vd->dir_nfiles=0;
+	/* anything derived from the image so far is incomplete */
+	cancel_refinement(vd);
+	free_derived_images(vd);
+	
+	/* rows not remapped since levels were changed are out of date */
+	if(vd->wide && (vd->lv_top || vd->lv_bottom<vd->image->height))
+		vd->lv_dirty=True;
+	
+	vd->state&=(~ISF_READY);
+	vd->state|=ISF_LOADING;
+	vd->load_prog=0;
+	vd->dmg_top=vd->dmg_bottom=0;
+	update_controls(vd);
+	set_status_msg(vd,SID_LOADING,"Loading...");
+	if(pthread_create(&vd->ldr_thread,NULL,loader_thread,(void*)vd)){
+		vd->state&=(~ISF_LOADING);
+		report_img_error(vd,IMG_ENOMEM);
+		reset_viewer(vd);
+		return;
 	}
+	pthread_detach(vd->ldr_thread);
 	
-	if(vd->dir_files) {
-		free(vd->dir_files);
-		vd->dir_files=NULL;
-		vd->dir_cur_file=0;
+	if(vd->vprog){
+		vd->vprog_timer=XtAppAddTimeOut(app_inst.context,LOADER_FB_UPDATE_INT,
+			load_fb_update_handler,(XtPointer)vd);
 	}
+	vd->prog_timer=XtAppAddTimeOut(app_inst.context,PROG_UPDATE_INT,
+		load_prog_handler,(XtPointer)vd);
+}
 
-	dir=opendir(vd->dir_name);
-	if(!dir){
-		ret_code=errno;
-		goto exit_thread;
-	}
+/*
+ * Set up storage for samples of high bit depth images, which are retained
+ * so that levels can be adjusted without reading the file again. If there
+ * isn't enough memory, the image is displayed with levels as they are.
+ */
+static void alloc_wide(struct viewer_data *vd)
+{
+	free_wide(vd);
+	if(!(vd->img_file.flags&IMGF_WIDE)) return;
 	
-	while((dir_ent=readdir(dir))){
-		size_t tmp_len;
-		
-		if(vd->state & DSF_CANCEL) {
-			closedir(dir);
-			goto exit_thread;
-		}
+	/* rows are mapped with current levels as they're read */
+	if(!vd->lut && !(vd->lut=malloc(LUT_SIZE))) return;
+	build_lut(vd);
+	vd->lv_top=0;
+	vd->lv_bottom=vd->img_file.height;
+	vd->wide_nchan=vd->img_file.bpp/8;
+	init_pixel_format(&vd->wide_pf,vd->img_file.bpp,
+		vd->img_file.red_mask,vd->img_file.green_mask,
+		vd->img_file.blue_mask,vd->img_file.alpha_mask,
+		vd->img_file.bg_pixel,vd->img_file.flags);
+	vd->wide=malloc(vd->img_file.width*vd->img_file.height*
+		vd->wide_nchan*sizeof(uint16_t));
+}
 
-		if(!strcmp(dir_ent->d_name, "..") ||
-			!strcmp(dir_ent->d_name, ".")) continue;
-			
-		if(nfiles==buf_size){
-			char **new_buf;
-			buf_size+=DIR_CACHE_GROWBY;
-			new_buf=realloc(files,buf_size*sizeof(char*));
-			if(!new_buf){
-				ret_code=errno;
-				closedir(dir);
-				goto exit_thread;
-			}
-			files=new_buf;
-		}
-		
-		tmp_len = strlen(vd->dir_name) + strlen(dir_ent->d_name) + 2;
-		if(tmp_len > tmp_name_len) {
-			char *new_buf = realloc(tmp_name, tmp_len);
-			if(!new_buf) {
-				ret_code = errno;
-				closedir(dir);
-				free(tmp_name);
-				goto exit_thread;
-			}
-			tmp_name = new_buf;
-			tmp_name_len = tmp_len;
-		}
-		sprintf(tmp_name, "%s/%s", vd->dir_name, dir_ent->d_name);
+static void free_wide(struct viewer_data *vd)
+{
+	if(vd->wide){
+		free(vd->wide);
+		vd->wide=NULL;
+	}
+	vd->lv_dirty=False;
+}
 
-		if(!img_ident(tmp_name, NULL, NULL)){
-			files[nfiles] = strdup(dir_ent->d_name);
-		} else continue;
+/*
+ * Compute vd->lut from window width/center, gamma and invert settings
+ */
+static void build_lut(struct viewer_data *vd)
+{
+	float lo=vd->lv_level-vd->lv_window/2;
+	float gamma=1.0/vd->lv_gamma;
+	unsigned int i;
+	
+	for(i=0; i<LUT_SIZE; i++){
+		float v=((float)i-lo)/vd->lv_window;
 		
-		nfiles++;
+		if(v<0) v=0;
+		else if(v>1) v=1;
+		if(vd->lv_gamma!=1.0) v=pow(v,gamma);
+		if(vd->lv_invert) v=1.0-v;
+		vd->lut[i]=(uint8_t)(v*255+0.5);
 	}
-	free(tmp_name);
-	closedir(dir);
-	
-	if(nfiles){
-		/* sort file names and move file pointer to current */
-		qsort(files,nfiles,sizeof(char*),&fn_sort_compare);
+}
 
-		if(vd->file_name){
-			char *cur_file;
-			cur_file=strrchr(vd->file_name,'/');
-			if(cur_file)
-				cur_file++;
+/*
+ * Map a row of 16 bit samples to 8 bits. Alpha is scaled linearly.
+ */
+static void map_samples(const struct viewer_data *vd,
+	uint8_t *dest, const uint16_t *src)
+{
+	unsigned int nchan=vd->img_file.bpp/8;
+	unsigned int ialpha=(vd->img_file.alpha_mask)?(nchan-1):nchan;
+	unsigned long i;
+	unsigned int c;
+	
+	for(i=0; i<vd->img_file.width; i++){
+		for(c=0; c<nchan; c++, src++, dest++){
+			if(c==ialpha || !vd->lut)
+				*dest=(*src>>8);
 			else
-				cur_file=vd->file_name;
-
-			for(i=0; i<nfiles; i++){
-				if(vd->state&DSF_CANCEL) goto exit_thread;
-				if(!strcmp(files[i],cur_file))
-					icur_file=i;
-			}
+				*dest=vd->lut[*src];
 		}
 	}
+}
+
+/*
+ * Rebuild the LUT with current levels, and mark all rows of vd->image
+ * for remapping. Rows are remapped by map_level_rows as they're drawn,
+ * so that dragging levels costs about as much as the area in view.
+ * Called by render_frame, so that adjustments made in between
+ * frames are applied at once.
+ */
+static void apply_levels(struct viewer_data *vd)
+{
+	if(!vd->wide || !vd->lut || !(vd->state&ISF_READY)) return;
+	
+	vd->lv_dirty=False;
+	build_lut(vd);
+	vd->lv_top=vd->lv_bottom=0;
+	free_derived_images(vd);
+}
+
+/*
+ * Make sure rows 'top' to 'bottom' (exclusive) of vd->image are mapped
+ * with current levels. Mapped rows are kept as a single range, so any rows
+ * in between are mapped as well; these are few when scrolling.
+ */
+static void map_level_rows(struct viewer_data *vd,
+	unsigned long top, unsigned long bottom)
+{
+	if(!vd->wide || !vd->lut || !(vd->state&ISF_READY) ||
+		vd->image->width!=vd->img_file.width) return;
+	
+	if(bottom>vd->image->height) bottom=vd->image->height;
+	if(top>=bottom) return;
+	
+	if(vd->lv_top==vd->lv_bottom){
+		remap_rows(vd,top,bottom);
+		vd->lv_top=top;
+		vd->lv_bottom=bottom;
+		return;
+	}
+	if(top<vd->lv_top){
+		remap_rows(vd,top,vd->lv_top);
+		vd->lv_top=top;
+	}
+	if(bottom>vd->lv_bottom){
+		remap_rows(vd,vd->lv_bottom,bottom);
+		vd->lv_bottom=bottom;
+	}
+}
+
+/*
+ * Remap retained samples of rows 'top' to 'bottom' into vd->image
+ */
+static void remap_rows(struct viewer_data *vd,
+	unsigned long top, unsigned long bottom)
+{
+	unsigned long width=vd->img_file.width;
+	size_t row_len=width*vd->wide_nchan;
+	long y;
 	
-	/* cleanup and terminate */
-	exit_thread:
-	pthread_mutex_lock(&vd->rdr_cond_mutex);
-	if(ret_code || (vd->state&DSF_CANCEL)){
-		while(nfiles--) free(files[nfiles]);
-		free(files);
-		if(vd->state&DSF_CANCEL)
-			pthread_cond_signal(&vd->rdr_finished_cond);
-	}else{
-		vd->dir_files=files;
-		vd->dir_nfiles=nfiles;
-		vd->dir_cur_file=icur_file;
+	#ifdef ENABLE_OMP
+	#pragma omp parallel private(y)
+	#endif
+	{
+		uint8_t *row=malloc(row_len);
+		
+		#ifdef ENABLE_OMP
+		#pragma omp for
+		#endif
+		for(y=top; y<(long)bottom; y++){
+			uint8_t *ptr=(uint8_t*)&vd->image->data
+				[y*vd->image->bytes_per_line];
+
+			if(!row) continue;
+			map_samples(vd,row,&vd->wide[y*row_len]);
+			if(app_inst.visual_info.class==PseudoColor)
+				rgb_pixels_to_clut(ptr,row,&vd->wide_pf,width);
+			else
+				convert_rgb_pixels(ptr,&vd->display_pf,row,
+					&vd->wide_pf,width);
+		}
+		if(row) free(row);
 	}
-	tmsg.cancelled=(vd->state&DSF_CANCEL)?True:False;
-	vd->state&=(~(DSF_READING|DSF_CANCEL));
-	pthread_mutex_unlock(&vd->rdr_cond_mutex);
-	tmsg.proc=TP_DIR_READ;
-	tmsg.result=ret_code;
-	pthread_mutex_lock(&vd->thread_notify_mutex);
-	write(vd->tnfd[TNFD_OUT],&tmsg,sizeof(struct proc_thread_msg));
-	pthread_mutex_unlock(&vd->thread_notify_mutex);
+}
 
-	return NULL;
+/*
+ * Set window width and center, and have the view updated with
+ * these and current gamma and invert settings.
+ */
+static void set_levels(struct viewer_data *vd, float window, float level)
+{
+	if(window<1) window=1;
+	else if(window>LUT_SIZE*2) window=LUT_SIZE*2;
+	if(level<0) level=0;
+	else if(level>LUT_SIZE) level=LUT_SIZE;
+	
+	vd->lv_window=window;
+	vd->lv_level=level;
+	if(!vd->wide) return;
+	
+	/* applied by show_loaded_image if still loading */
+	vd->lv_dirty=True;
+	if(vd->state&ISF_READY) request_render(vd,RF_UPDATE);
 }
 
 /*
- * Free directory cache data, stop directory reader thread if any is running.
+ * Returns True if 'fname' with status 'st' is in a prefetch slot
+ * or the image cache.
  */
-static void clear_dir_cache(struct viewer_data *vd)
+static Boolean has_cached_image(struct viewer_data *vd,
+	const char *fname, const struct stat *st)
 {
-	if(!vd->dir_files) return;
-	pthread_mutex_lock(&vd->rdr_cond_mutex);
-	if(vd->state&DSF_READING){
-		vd->state|=DSF_CANCEL;
-		pthread_cond_wait(&vd->rdr_finished_cond,&vd->rdr_cond_mutex);
-		pthread_mutex_unlock(&vd->rdr_cond_mutex);
-		return;
+	const char *title;
+	char *path;
+	unsigned int i;
+	Boolean found=False;
+	
+	if(!vd->dir_name) return False;
+	
+	title=strrchr(fname,'/');
+	title=(title)?title+1:fname;
+	if(!(path=make_dir_path(vd,title))) return False;
+	
+	stop_prefetch(vd);
+	
+	for(i=0; i<vd->pf_nslots && !found; i++){
+		struct prefetch_slot *slot=&vd->pf_slots[i];
+		
+		found=(slot->image && !slot->page &&
+			!strcmp(slot->file_name,path) &&
+			slot->mod_time==st->st_mtime && slot->file_size==st->st_size);
 	}
-	pthread_mutex_unlock(&vd->rdr_cond_mutex);
-	while(vd->dir_nfiles--) free(vd->dir_files[vd->dir_nfiles]);
-	free(vd->dir_files);
-	free(vd->dir_name);
-	vd->dir_files=NULL;
-	vd->dir_nfiles=0;
-	vd->dir_name=NULL;
-	vd->dir_cur_file=0;
+	if(!found) found=ic_contains(path,st->st_mtime,st->st_size,0);
+	
+	free(path);
+	return found;
 }
 
 /*
- * Reset the viewer to the initial state.
+ * Draw the thumbnail cache entry for file_name (if there is one) scaled
+ * to fit the view, as a placeholder while navigation requests settle.
+ * It isn't kept in the back-buffer, so it's gone with the next expose.
  */
-static void reset_viewer(struct viewer_data *vd)
+static void show_preview(struct viewer_data *vd)
 {
-	/* if a loader thread is running set state to cancelled
-	 * and wait for it to exit */
-	pthread_mutex_lock(&vd->ldr_cond_mutex);
-	if(vd->state&ISF_LOADING){
-		vd->state|=ISF_CANCEL;
-		if(vd->prog_timer) XtRemoveTimeOut(vd->prog_timer);
-		if(vd->vprog_timer) XtRemoveTimeOut(vd->vprog_timer);
-		vd->prog_timer=None;
-		vd->vprog_timer=None;
-		pthread_cond_wait(&vd->ldr_finished_cond,&vd->ldr_cond_mutex);
+	struct stat st;
+	struct tc_entry ent;
+	struct pixel_format tc_pf;
+	XImage thumb, scaled;
+	Dimension view_width=0, view_height=0;
+	unsigned long xres, yres;
+	float xs, ys, scale;
+	unsigned int y, tform;
+	int width, height;
+	
+	if(app_inst.visual_info.depth<=8 || !tc_enabled()) return;
+	if(stat(vd->file_name,&st) || tc_lookup(vd->file_name,&st,&ent)) return;
+
+	XtVaGetValues(vd->wview,XmNwidth,&view_width,XmNheight,&view_height,NULL);
+
+	/* as view_tform, the image isn't open yet */
+	tform=img_combine_tform(ent.tform,vd->tform);
+	if(tform & IMGT_ROTATE){
+		xres=ent.yres;
+		yres=ent.xres;
+	}else{
+		xres=ent.xres;
+		yres=ent.yres;
 	}
-	pthread_mutex_unlock(&vd->ldr_cond_mutex);
 
-	if(vd->image){
-		free(vd->image->data);
-		vd->image->data=NULL;
-		XDestroyImage(vd->image);
-		vd->image=NULL;
+	/* fit the original image dimensions, as load_image would */
+	xs=(float)view_width/xres;
+	ys=(float)view_height/yres;
+	scale=(xs<ys)?xs:ys;
+	if(scale>1.0) scale=1.0;
+	scale=(scale*ent.xres)/ent.width;
+	
+	if(dec_init_image(&thumb,ent.width,ent.height,NULL)){
+		tc_free_entry(&ent);
+		return;
 	}
-	if(vd->file_name){
-		free(vd->file_name);
-		vd->file_name=NULL;
+	if(!(thumb.data=malloc(thumb.bytes_per_line*thumb.height))){
+		tc_free_entry(&ent);
+		return;
 	}
-	if(vd->state&ISF_OPENED){
-		img_close(&vd->img_file);
+	tc_init_pixel_format(&tc_pf);
+	for(y=0; y<thumb.height; y++){
+		convert_rgb_pixels(thumb.data+(y*thumb.bytes_per_line),
+			&vd->display_pf,ent.data+(y*ent.width*3),&tc_pf,ent.width);
 	}
+	tc_free_entry(&ent);
 	
-	#ifdef ENABLE_CDE
-	/* notify the requestor if the viewer was instantiated through ToolTalk */
-	if(vd->tt_disp_req){
-		ttmedia_load_reply(vd->tt_disp_req,NULL,0,True);
-		vd->tt_disp_req=NULL;
+	width=thumb.width*scale;
+	height=thumb.height*scale;
+	if(tform & IMGT_ROTATE){
+		int tmp=width;
+		width=height;
+		height=tmp;
 	}
-	#endif /* ENABLE_CDE */
+	if(width>view_width) width=view_width;
+	if(height>view_height) height=view_height;
+
+	/* drawn through a temporary image, the back-buffer is left alone */
+	if(width>0 && height>0 && !dec_init_image(&scaled,width,height,NULL) &&
+		(scaled.data=malloc(scaled.bytes_per_line*scaled.height))){
+		img_blt(&thumb,0,0,thumb.width,thumb.height,&scaled,
+			scale,tform,BLTF_INTERPOLATE);
+		XPutImage(app_inst.display,XtWindow(vd->wview),vd->blit_gc,
+			&scaled,0,0,(view_width-width)/2,(view_height-height)/2,
+			width,height);
+		free(scaled.data);
+	}
+	free(thumb.data);
+}
+
+/*
+ * Allocate an XImage according to img_file properties
+ * Must return an IMG_* status value.
+ */
+static int alloc_storage(struct viewer_data *vd)
+{
+	int depth=compact_depth(vd);
+	int res;
 	
-	/* reset properties to defaults */
-	vd->state&=(~(ISF_OPENED|ISF_READY));
-	vd->cur_page=0;
-	vd->zoom=1;
-	vd->xoff=0;
-	vd->yoff=0;
-	if(!vd->keep_tform) vd->tform=0;
+	/* indices or gray samples as they are, see img_init_compact */
+	if(depth){
+		if(!(vd->image=malloc(sizeof(XImage)))) return IMG_ENOMEM;
+		if(img_init_compact(vd->image,vd->img_file.width,
+			vd->img_file.height,depth)){
+			if(vd->image->obdata) free(vd->image->obdata);
+			free(vd->image);
+			vd->image=NULL;
+			return IMG_ENOMEM;
+		}
+		res=ims_alloc_data(vd->image)?IMG_ENOMEM:set_compact_clut(vd);
+		if(res){
+			XDestroyImage(vd->image);
+			vd->image=NULL;
+		}
+		return res;
+	}
 	
-	/* update the user interface */
-	XClearArea(app_inst.display,XtWindow(vd->wview),0,0,0,0,False);
-	update_shell_title(vd);
+	/* storage for a complete image */
+	vd->image=XCreateImage(app_inst.display,app_inst.visual_info.visual,
+		app_inst.visual_info.depth,ZPixmap,0,NULL,vd->img_file.width,
+		vd->img_file.height,app_inst.pixel_size,0);
+	if(!vd->image) return IMG_ENOMEM;
+	
+	vd->image->bitmap_bit_order=vd->image->byte_order=
+		(is_big_endian())?MSBFirst:LSBFirst;
+	_XInitImageFuncPtrs(vd->image);
+	
+	/* large images may be file backed, see imgstore.h */
+	if(ims_alloc_data(vd->image)){
+		XDestroyImage(vd->image);
+		vd->image=NULL;
+		return IMG_ENOMEM;
+	}
+	return 0;
+}
+
+/*
+ * Returns the depth of a compact image the current image can be kept in
+ * without loss, or zero if it must be expanded to the display format.
+ * Only 8 bit indexed and grayscale images qualify; 1 bit if that's what
+ * they were originally. Reduced resolution images aren't kept compact,
+ * since the full resolution image replacing them isn't.
+ */
+static int compact_depth(struct viewer_data *vd)
+{
+	struct img_file *img=&vd->img_file;
+	
+	if(app_inst.visual_info.class!=TrueColor || vd->reduced ||
+		img->bpp!=8 || (img->flags&IMGF_WIDE) || img->alpha_mask)
+		return 0;
+	
+	if(img->format==IMG_PSEUDO) return 8;
+	if(img->red_mask==0xFF && img->green_mask==0xFF &&
+		img->blue_mask==0xFF) return (img->orig_bpp==1)?1:8;
+	return 0;
+}
+
+/*
+ * Set up the color table of the compact vd->image for the current image.
+ * Must return an IMG_* status value.
+ */
+static int set_compact_clut(struct viewer_data *vd)
+{
+	unsigned long *clut=(unsigned long*)vd->image->obdata;
+	unsigned int i, n=(vd->image->depth==1)?2:IMG_COMPACT_CLUT_SIZE;
+	uint8_t rgb[IMG_CLUT_SIZE];
+	uint8_t index[IMG_COMPACT_CLUT_SIZE];
+	XImage row;
+	char *buf;
+	int res;
+	
+	if(vd->img_file.format==IMG_PSEUDO){
+		res=img_read_cmap(&vd->img_file,rgb);
+		if(res) return res;
+	}else{
+		for(i=0; i<IMG_COMPACT_CLUT_SIZE; i++)
+			rgb[i*3]=rgb[i*3+1]=rgb[i*3+2]=i;
+	}
+	/* 1 bit images are stored thresholded, see img_put_compact_row */
+	for(i=0; i<n; i++)
+		index[i]=(n==2)?(i?255:0):i;
+	
+	buf=malloc(n*(app_inst.pixel_size/8));
+	if(!buf) return IMG_ENOMEM;
+	clut_to_rgb_pixels(buf,&vd->display_pf,index,rgb,n);
+	if(dec_init_image(&row,n,1,buf)){
+		free(buf);
+		return IMG_ERROR;
+	}
+	for(i=0; i<n; i++) clut[i]=XGetPixel(&row,i,0);
+	free(buf);
+	return 0;
+}
+
+/* Returns the pixel value to fill vd->image with before it's loaded */
+static unsigned long image_bg_pixel(struct viewer_data *vd)
+{
+	if(IMG_IS_COMPACT(vd->image))
+		return img_nearest_index(vd->image,vd->bg_pixel);
+	return vd->bg_pixel;
+}
+
+/*
+ * The image loader thread entry point. Don't make any X/Motif calls here.
+ */
+static void* loader_thread(void *arg)
+{
+	struct proc_thread_msg tmsg;
+	struct loader_cb_data *cbd;
+	struct viewer_data *vd=(struct viewer_data*)arg;
+	int img_errno=0;
+
+	cbd=calloc(1,sizeof(struct loader_cb_data));
+	if(!cbd){
+		img_errno=IMG_ENOMEM;
+		free(cbd);
+		goto loader_thread_exit;
+	}
+	cbd->vd=vd;
+	cbd->nscl=vd->rows_read;
+	/* check if pseudo-color and read the lookup table if so,
+	 * compact images have theirs set up by alloc_storage */
+	if(vd->img_file.format==IMG_PSEUDO && !IMG_IS_COMPACT(vd->image)){
+		cbd->clut=malloc(IMG_CLUT_SIZE);
+		if(!cbd->clut){
+			img_errno=IMG_ENOMEM;
+			free(cbd);
+			goto loader_thread_exit;
+		}
+		img_errno=img_read_cmap(&vd->img_file,cbd->clut);
+		if(img_errno){
+			free(cbd->clut);
+			free(cbd);
+			goto loader_thread_exit;
+		}
+	}
+
+	img_errno=init_pixel_format(&cbd->image_pf,vd->img_file.bpp,
+		vd->img_file.red_mask,vd->img_file.green_mask,
+		vd->img_file.blue_mask,vd->img_file.alpha_mask,
+		vd->img_file.bg_pixel,vd->img_file.flags);
+	
+	/* 16 bit samples are mapped to 8 bits through vd->lut first */
+	if(!img_errno && (vd->img_file.flags&IMGF_WIDE)){
+		cbd->row8=malloc(vd->img_file.width*(vd->img_file.bpp/8));
+		if(!cbd->row8) img_errno=IMG_ENOMEM;
+	}
+
+	if(!img_errno){
+		img_errno=img_read_scanlines(&vd->img_file,
+			scanline_read_cb,(void*)cbd);
+	}
+	vd->rows_read=cbd->nscl;
+	if(cbd->row8) free(cbd->row8);
+	if(cbd->clut) free(cbd->clut);
+	free(cbd);
+	
+	/* always go there to exit the thread */
+	loader_thread_exit:
+	pthread_mutex_lock(&vd->ldr_cond_mutex);
+
+	tmsg.cancelled=(vd->state&ISF_CANCEL)?True:False;
+	vd->state&=(~(ISF_LOADING|ISF_CANCEL));
+	pthread_cond_signal(&vd->ldr_finished_cond);
+	pthread_mutex_unlock(&vd->ldr_cond_mutex);
+	tmsg.proc=TP_IMG_LOAD;
+	tmsg.result=img_errno;
+	pthread_mutex_lock(&vd->thread_notify_mutex);
+	writen(vd->tnfd[TNFD_OUT], &tmsg, sizeof(struct proc_thread_msg));
+	pthread_mutex_unlock(&vd->thread_notify_mutex);
+	return NULL;
+}
+
+/*
+ * The scaline reader callback proc
+ */
+static int scanline_read_cb(unsigned long iscl,
+	const uint8_t *data, void *client)
+{
+	struct loader_cb_data *cbd=(struct loader_cb_data*)client;
+	uint8_t *ptr=(uint8_t*)&cbd->vd->image->data
+		[iscl*cbd->vd->image->bytes_per_line];
+
+	dassert(iscl < cbd->vd->img_file.height);
+	
+	if(cbd->row8){
+		struct viewer_data *vd=cbd->vd;
+		size_t nsamples=vd->img_file.width*(vd->img_file.bpp/8);
+		
+		if(vd->wide){
+			memcpy(&vd->wide[iscl*nsamples],data,
+				nsamples*sizeof(uint16_t));
+		}
+		map_samples(vd,cbd->row8,(const uint16_t*)data);
+		data=cbd->row8;
+	}
+	
+	if(IMG_IS_COMPACT(cbd->vd->image)){
+		img_put_compact_row(cbd->vd->image,iscl,data);
+	}else if(app_inst.visual_info.class==PseudoColor){
+		if(cbd->vd->img_file.format==IMG_PSEUDO){
+			remap_pixels(ptr,data,cbd->clut,cbd->vd->img_file.width);
+		}else{
+			rgb_pixels_to_clut(ptr,data,&cbd->image_pf,
+				cbd->vd->img_file.width);
+		}
+	}else{
+		if(cbd->vd->img_file.format==IMG_PSEUDO){
+			clut_to_rgb_pixels(ptr,&cbd->vd->display_pf,data,
+				cbd->clut,cbd->vd->img_file.width);
+		}else{
+			convert_rgb_pixels(ptr,&cbd->vd->display_pf,data,
+				&cbd->image_pf,cbd->vd->img_file.width);
+		}
+	}
+	if(cbd->vd->state&ISF_CANCEL) return IMG_READ_CANCEL;
+	
+	/* let the visual progress updater know what's new */
+	if(cbd->vd->vprog){
+		struct viewer_data *vd=cbd->vd;
+		
+		pthread_mutex_lock(&vd->dmg_mutex);
+		if(vd->dmg_bottom<=vd->dmg_top){
+			vd->dmg_top=iscl;
+			vd->dmg_bottom=iscl+1;
+		}else if(iscl<vd->dmg_top){
+			vd->dmg_top=iscl;
+		}else if(iscl>=vd->dmg_bottom){
+			vd->dmg_bottom=iscl+1;
+		}
+		pthread_mutex_unlock(&vd->dmg_mutex);
+	}
+
+	cbd->nscl++;
+	cbd->vd->load_prog=ceil((float)cbd->nscl/
+		((float)cbd->vd->img_file.height*0.01));
+
+	return IMG_READ_CONT;
+}
+
+/*
+ * Receives notifications from work threads through XtInput
+ */
+static void thread_callback_proc(XtPointer client, int *pfd, XtInputId *iid)
+{
+	struct viewer_data *vd=(struct viewer_data*)client;
+	struct proc_thread_msg tmsg;
+	
+	if(readn(vd->tnfd[TNFD_IN], &tmsg, sizeof(struct proc_thread_msg))
+		< sizeof(struct proc_thread_msg)) return;
+
+	if(tmsg.proc==TP_IMG_LOAD){	
+		if(tmsg.result && vd->follow && !tmsg.cancelled &&
+			(tmsg.result==IMG_EDATA || tmsg.result==IMG_EFILE ||
+			tmsg.result==IMG_EIO)){
+			/* probably still being written, see follow_update */
+			vd->partial=True;
+			show_loaded_image(vd);
+		}else if(tmsg.result){
+			report_img_error(vd,tmsg.result);
+			reset_viewer(vd);
+			/* go on with the next one */
+			if(vd->ss_active){
+				vd->ss_pending=False;
+				schedule_slideshow(vd);
+			}
+		}else if(!tmsg.cancelled){
+			show_loaded_image(vd);
+			start_prefetch(vd);
+		}
+	}else if(tmsg.proc==TP_FULL_RES){
+		Boolean active;
+		
+		/* if still active, it's another decoder started since */
+		pthread_mutex_lock(&vd->fr_cond_mutex);
+		active=vd->fr_active;
+		pthread_mutex_unlock(&vd->fr_cond_mutex);
+		
+		if(!tmsg.cancelled && !active && vd->fr_image){
+			if(tmsg.result){
+				XDestroyImage(vd->fr_image);
+				vd->fr_image=NULL;
+				vd->fr_failed=True;
+				display_status_summary(vd);
+			}else{
+				show_full_resolution(vd);
+			}
+		}
+	}else if(tmsg.proc==TP_DIR_READ){
+		Boolean bkgnd=vd->dir_bkgnd;
+		
+		/* a cancelled reader may have been superseded already */
+		if(!tmsg.cancelled) vd->dir_bkgnd=False;
+		set_widget_cursor(vd->wshell,CUR_POINTER);
+		update_controls(vd);
+		display_status_summary(vd);
+		XmUpdateDisplay(vd->wshell);
+		if(tmsg.result){
+			if(!bkgnd){
+				errno_message_box(vd->wshell,tmsg.result,
+					nlstr(APP_MSGSET,SID_EREADDIR,
+					"Error reading directory."),False);
+			}
+		}else if(!tmsg.cancelled && vd->dir_nfiles){
+			if(bkgnd)
+				start_prefetch(vd);
+			else
+				load_next_file(vd,vd->dir_forward);
+		}
+	}
+}
+
+/*
+ * Display a completely loaded image
+ */
+static void show_loaded_image(struct viewer_data *vd)
+{
+	vd->state|=ISF_READY;
+	if(vd->lv_dirty) apply_levels(vd);
+	if(vd->ss_active) slideshow_shown(vd);
 	display_status_summary(vd);
-	update_props_msg(vd);
-	update_pointer_shape(vd);
 	update_controls(vd);
+	if(vd->zoom_fit)
+		vd->zoom=compute_fit_zoom(vd);
+	else
+		vd->zoom=1;
+	update_back_buffer(vd);
+	redraw_view(vd,False);
+	update_page_msg(vd);
+	update_pointer_shape(vd);
 	XmUpdateDisplay(vd->wshell);
 }
 
 /*
- * Compute the zoom value so that the image fits within view boundaries.
- * Returns 1 if the image is smaller than the view.
+ * Have the image read at the lowest resolution the loader provides that
+ * still fits the view without upscaling, in either orientation. The full
+ * resolution image is decoded in background once it's zoomed past that.
+ */
+static void reduce_resolution(struct viewer_data *vd)
+{
+	Dimension vw=0, vh=0;
+	unsigned long width=vd->img_file.width;
+	unsigned long height=vd->img_file.height;
+	float zoom, rzoom;
+	
+	vd->reduced=False;
+	if(!vd->zoom_fit || vd->img_file.npages>1 ||
+		app_inst.visual_info.class!=TrueColor) return;
+	
+	XtVaGetValues(vd->wview,XmNwidth,&vw,XmNheight,&vh,NULL);
+	zoom=fminf((float)vw/width,(float)vh/height);
+	rzoom=fminf((float)vw/height,(float)vh/width);
+	if(rzoom>zoom) zoom=rzoom;
+	if(zoom>=1.0 || !vw || !vh) return;
+	
+	if(img_reduce(&vd->img_file,ceilf(width*zoom),ceilf(height*zoom)))
+		return;
+	if(vd->img_file.width<width || vd->img_file.height<height){
+		vd->full_width=width;
+		vd->full_height=height;
+		vd->reduced=True;
+	}
+}
+
+/*
+ * Start decoding the full resolution image in background,
+ * unless it's already being decoded.
+ */
+static void start_full_resolution(struct viewer_data *vd)
+{
+	pthread_attr_t attr;
+	
+	if(vd->fr_image || vd->fr_failed) return;
+	
+	vd->fr_image=create_display_image(vd->full_width,vd->full_height);
+	if(!vd->fr_image) return;
+	
+	set_status_msg(vd,SID_LOADING,"Loading...");
+	vd->fr_cancel=0;
+	vd->fr_active=True;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr,PTHREAD_CREATE_DETACHED);
+	if(pthread_create(&vd->fr_thread,&attr,full_res_thread,(void*)vd)){
+		vd->fr_active=False;
+		XDestroyImage(vd->fr_image);
+		vd->fr_image=NULL;
+		display_status_summary(vd);
+	}
+	pthread_attr_destroy(&attr);
+}
+
+/*
+ * Stop the full resolution decoder thread if it's running, wait for it
+ * to exit, and discard whatever it has decoded.
+ */
+static void stop_full_resolution(struct viewer_data *vd)
+{
+	pthread_mutex_lock(&vd->fr_cond_mutex);
+	if(vd->fr_active){
+		vd->fr_cancel=1;
+		while(vd->fr_active)
+			pthread_cond_wait(&vd->fr_finished_cond,&vd->fr_cond_mutex);
+	}
+	pthread_mutex_unlock(&vd->fr_cond_mutex);
+	
+	if(vd->fr_image){
+		XDestroyImage(vd->fr_image);
+		vd->fr_image=NULL;
+	}
+}
+
+/*
+ * Replace the reduced resolution image with the full resolution one.
+ * Zoom and offsets are relative to the latter already.
+ */
+static void show_full_resolution(struct viewer_data *vd)
+{
+	free_derived_images(vd);
+	XDestroyImage(vd->image);
+	vd->image=vd->fr_image;
+	vd->fr_image=NULL;
+	vd->reduced=False;
+	display_status_summary(vd);
+	request_render(vd,RF_UPDATE);
+}
+
+/*
+ * Full resolution decoder thread entry point. Don't make any X/Motif
+ * calls here. It runs at normal priority, like the loader thread, since
+ * the view is waiting for it.
+ */
+static void* full_res_thread(void *arg)
+{
+	struct viewer_data *vd=(struct viewer_data*)arg;
+	struct proc_thread_msg tmsg;
+	struct full_res_data *frd;
+	int img_errno;
+	
+	frd=malloc(sizeof(struct full_res_data));
+	if(frd){
+		frd->vd=vd;
+		img_errno=img_open(vd->file_name,NULL,&frd->img_file,0);
+	}else{
+		img_errno=IMG_ENOMEM;
+	}
+	
+	if(!img_errno){
+		/* the file may have changed in the meantime */
+		if(frd->img_file.width!=vd->fr_image->width ||
+			frd->img_file.height!=vd->fr_image->height){
+			img_errno=IMG_EFILE;
+		}
+		if(!img_errno && frd->img_file.format==IMG_PSEUDO)
+			img_errno=img_read_cmap(&frd->img_file,frd->clut);
+		if(!img_errno){
+			img_errno=init_pixel_format(&frd->image_pf,
+				frd->img_file.bpp,frd->img_file.red_mask,
+				frd->img_file.green_mask,frd->img_file.blue_mask,
+				frd->img_file.alpha_mask,frd->img_file.bg_pixel,
+				frd->img_file.flags);
+		}
+		if(!img_errno){
+			img_errno=img_read_scanlines(&frd->img_file,
+				full_res_read_cb,(void*)frd);
+		}
+		img_close(&frd->img_file);
+	}
+	if(frd) free(frd);
+	
+	/* notify before signalling, so that the message can be told
+	 * from one sent by a previous thread (see thread_callback_proc) */
+	pthread_mutex_lock(&vd->fr_cond_mutex);
+	tmsg.proc=TP_FULL_RES;
+	tmsg.cancelled=vd->fr_cancel?True:False;
+	tmsg.result=img_errno;
+	pthread_mutex_lock(&vd->thread_notify_mutex);
+	writen(vd->tnfd[TNFD_OUT], &tmsg, sizeof(struct proc_thread_msg));
+	pthread_mutex_unlock(&vd->thread_notify_mutex);
+	vd->fr_active=False;
+	pthread_cond_signal(&vd->fr_finished_cond);
+	pthread_mutex_unlock(&vd->fr_cond_mutex);
+	return NULL;
+}
+
+/*
+ * Full resolution decoder scanline callback
+ */
+static int full_res_read_cb(unsigned long iscl,
+	const uint8_t *data, void *client)
+{
+	struct full_res_data *frd=(struct full_res_data*)client;
+	XImage *img=frd->vd->fr_image;
+	uint8_t *ptr=(uint8_t*)&img->data[iscl*img->bytes_per_line];
+	
+	if(frd->img_file.format==IMG_PSEUDO){
+		clut_to_rgb_pixels(ptr,&frd->vd->display_pf,data,
+			frd->clut,frd->img_file.width);
+	}else{
+		convert_rgb_pixels(ptr,&frd->vd->display_pf,data,
+			&frd->image_pf,frd->img_file.width);
+	}
+	return frd->vd->fr_cancel?IMG_READ_CANCEL:IMG_READ_CONT;
+}
+
+/*
+ * Fill the newly allocated vd->image with the preview passed to
+ * display_image_preview scaled up, so that it shows wherever the image
+ * hasn't been decoded yet. Returns False if there's no usable preview.
+ * The preview is oriented as displayed, vd->image is as stored.
+ */
+static Boolean seed_image(struct viewer_data *vd)
+{
+	XImage *preview=vd->preview;
+	XImage *image=vd->image;
+	unsigned long full_width, full_height;
+	unsigned int width, height;
+	unsigned int pv_width, pv_height;
+	unsigned int tform;
+	float scale;
+	
+	if(!preview || app_inst.visual_info.class!=TrueColor ||
+		IMG_IS_COMPACT(image) ||
+		preview->bits_per_pixel!=image->bits_per_pixel) return False;
+	
+	/* it must be of this very image, and not be too costly to draw */
+	get_image_size(vd,&full_width,&full_height);
+	if(vd->preview_xres!=full_width || vd->preview_yres!=full_height ||
+		ims_is_mapped(image)) return False;
+	
+	/* preview dimensions in image orientation */
+	tform=img_invert_tform(vd->img_file.tform);
+	if(tform&IMGT_ROTATE){
+		pv_width=preview->height;
+		pv_height=preview->width;
+	}else{
+		pv_width=preview->width;
+		pv_height=preview->height;
+	}
+	scale=(float)image->width/pv_width;
+	width=pv_width*scale;
+	height=pv_height*scale;
+	if(width>image->width) width=image->width;
+	if(height>image->height) height=image->height;
+	
+	if(tform&IMGT_ROTATE){
+		img_blt_scaled(preview,0,0,height,width,image,
+			scale,tform,BLTF_INT_UP);
+	}else{
+		img_blt_scaled(preview,0,0,width,height,image,
+			scale,tform,BLTF_INT_UP);
+	}
+	if(width<image->width){
+		img_fill_rect(image,width,0,image->width-width,
+			image->height,vd->bg_pixel);
+	}
+	if(height<image->height){
+		img_fill_rect(image,0,height,width,
+			image->height-height,vd->bg_pixel);
+	}
+	return True;
+}
+
+/*
+ * Timed framebuffer update handler
+ */
+static void load_fb_update_handler(XtPointer client, XtIntervalId *iid)
+{
+	struct viewer_data *vd=(struct viewer_data*)client;
+	
+	if(vd->state&ISF_LOADING && !(vd->state&ISF_CANCEL)){
+		update_loaded_rows(vd);
+		vd->vprog_timer=XtAppAddTimeOut(app_inst.context,LOADER_FB_UPDATE_INT,
+				load_fb_update_handler,(XtPointer)vd);
+	}else{
+		vd->vprog_timer=None;
+	}
+}
+
+/*
+ * Update the loading progress message.
+ * This function is called by a timed event.
+ */
+static void load_prog_handler(XtPointer client, XtIntervalId *iid)
+{
+	Arg arg[1];
+	XmString str;
+	char *msg_text;
+	char *prog_msg;
+	size_t len;
+	struct viewer_data *vd=(struct viewer_data*)client;
+	
+	if(vd->state&ISF_LOADING && !(vd->state&ISF_CANCEL)){
+		msg_text=nlstr(APP_MSGSET,SID_LOADING,"Loading...");
+		len=strlen(msg_text)+12;
+		prog_msg=alloca(len+1);
+		snprintf(prog_msg,len,"%s%d%%",msg_text,vd->load_prog);
+		str=XmStringCreateLocalized(prog_msg);
+		XtSetArg(arg[0],XmNlabelString,str);
+		XtSetValues(vd->wmsg,arg,1);
+		XmUpdateDisplay(vd->wmsg);
+		XmStringFree(str);
+		vd->prog_timer=XtAppAddTimeOut(app_inst.context,PROG_UPDATE_INT,
+				load_prog_handler,(XtPointer)vd);
+	}else{
+		vd->prog_timer=None;
+	}
+}
+
+/*
+ * qsort compare function for read_directory
+ */
+static int fn_sort_compare(const void *pa, const void *pb)
+{
+	const char **a=(const char**)pa;
+	const char **b=(const char**)pb;
+	return strcmp(*a,*b);
+}
+
+/*
+ * Directory reader thread entry point
+ */
+static void* dir_reader_thread(void *arg)
+{
+	struct viewer_data *vd=(struct viewer_data*)arg;
+	struct proc_thread_msg tmsg;
+	DIR *dir;
+	struct dirent *dir_ent;
+	size_t buf_size=0;
+	int i;
+	int icur_file=0;
+	int ret_code=0;
+	char **files=NULL;
+	unsigned long nfiles=0;
+	char *tmp_name = NULL;
+	size_t tmp_name_len = 0;
+
+	dassert(vd->dir_name);
+	
+	if(vd->dir_nfiles){
+		while(vd->dir_nfiles--)
+			free(vd->dir_files[vd->dir_nfiles]);
+		vd->dir_nfiles=0;
+	}
+	
+	if(vd->dir_files) {
+		free(vd->dir_files);
+		vd->dir_files=NULL;
+		vd->dir_cur_file=0;
+	}
+
+	dir=opendir(vd->dir_name);
+	if(!dir){
+		ret_code=errno;
+		goto exit_thread;
+	}
+	
+	while((dir_ent=readdir(dir))){
+		size_t tmp_len;
+		
+		if(vd->state & DSF_CANCEL) {
+			closedir(dir);
+			goto exit_thread;
+		}
+
+		if(!strcmp(dir_ent->d_name, "..") ||
+			!strcmp(dir_ent->d_name, ".")) continue;
+			
+		if(nfiles==buf_size){
+			char **new_buf;
+			buf_size+=DIR_CACHE_GROWBY;
+			new_buf=realloc(files,buf_size*sizeof(char*));
+			if(!new_buf){
+				ret_code=errno;
+				closedir(dir);
+				goto exit_thread;
+			}
+			files=new_buf;
+		}
+		
+		tmp_len = strlen(vd->dir_name) + strlen(dir_ent->d_name) + 2;
+		if(tmp_len > tmp_name_len) {
+			char *new_buf = realloc(tmp_name, tmp_len);
+			if(!new_buf) {
+				ret_code = errno;
+				closedir(dir);
+				free(tmp_name);
+				goto exit_thread;
+			}
+			tmp_name = new_buf;
+			tmp_name_len = tmp_len;
+		}
+		sprintf(tmp_name, "%s/%s", vd->dir_name, dir_ent->d_name);
+
+		if(!img_ident(tmp_name, NULL, NULL)){
+			files[nfiles] = strdup(dir_ent->d_name);
+		} else continue;
+		
+		nfiles++;
+	}
+	free(tmp_name);
+	closedir(dir);
+	
+	if(nfiles){
+		/* sort file names and move file pointer to current */
+		qsort(files,nfiles,sizeof(char*),&fn_sort_compare);
+
+		if(vd->file_name){
+			char *cur_file;
+			cur_file=strrchr(vd->file_name,'/');
+			if(cur_file)
+				cur_file++;
+			else
+				cur_file=vd->file_name;
+
+			for(i=0; i<nfiles; i++){
+				if(vd->state&DSF_CANCEL) goto exit_thread;
+				if(!strcmp(files[i],cur_file))
+					icur_file=i;
+			}
+		}
+	}
+	
+	/* cleanup and terminate */
+	exit_thread:
+	pthread_mutex_lock(&vd->rdr_cond_mutex);
+	if(ret_code || (vd->state&DSF_CANCEL)){
+		while(nfiles--) free(files[nfiles]);
+		free(files);
+		if(vd->state&DSF_CANCEL)
+			pthread_cond_signal(&vd->rdr_finished_cond);
+	}else{
+		vd->dir_files=files;
+		vd->dir_nfiles=nfiles;
+		vd->dir_cur_file=icur_file;
+	}
+	tmsg.cancelled=(vd->state&DSF_CANCEL)?True:False;
+	vd->state&=(~(DSF_READING|DSF_CANCEL));
+	pthread_mutex_unlock(&vd->rdr_cond_mutex);
+	tmsg.proc=TP_DIR_READ;
+	tmsg.result=ret_code;
+	pthread_mutex_lock(&vd->thread_notify_mutex);
+	write(vd->tnfd[TNFD_OUT],&tmsg,sizeof(struct proc_thread_msg));
+	pthread_mutex_unlock(&vd->thread_notify_mutex);
+
+	return NULL;
+}
+
+/*
+ * Free directory cache data, stop directory reader thread if any is running.
+ */
+static void clear_dir_cache(struct viewer_data *vd)
+{
+	pthread_mutex_lock(&vd->rdr_cond_mutex);
+	if(vd->state&DSF_READING){
+		vd->state|=DSF_CANCEL;
+		pthread_cond_wait(&vd->rdr_finished_cond,&vd->rdr_cond_mutex);
+	}
+	pthread_mutex_unlock(&vd->rdr_cond_mutex);
+	/* a cancelled reader leaves dir_files empty */
+	if(vd->dir_files){
+		while(vd->dir_nfiles--) free(vd->dir_files[vd->dir_nfiles]);
+		free(vd->dir_files);
+	}
+	if(vd->dir_name) free(vd->dir_name);
+	vd->dir_files=NULL;
+	vd->dir_nfiles=0;
+	vd->dir_name=NULL;
+	vd->dir_cur_file=0;
+}
+
+/*
+ * Returns the absolute name of file 'title' in the current directory.
+ * The caller is responsible for freeing the allocated memory.
+ */
+static char* make_dir_path(struct viewer_data *vd, const char *title)
+{
+	char *path;
+	
+	path=malloc(strlen(vd->dir_name)+strlen(title)+2);
+	if(path) sprintf(path,"%s/%s",vd->dir_name,title);
+	return path;
+}
+
+/*
+ * Set up decode-ahead slots for pages adjacent to the current one in
+ * multi-page files, and files adjacent to the current one, nearest first,
+ * and launch the prefetch thread to fill them.
+ * If the directory hasn't been read yet, it's read in background and
+ * this function is invoked again once done.
+ */
+static void start_prefetch(struct viewer_data *vd)
+{
+	struct prefetch_slot *slots;
+	unsigned int nslots=0;
+	unsigned long cur, n;
+	unsigned int i, j;
+	int dist, dir;
+	char *title;
+	struct stat st;
+	pthread_attr_t attr;
+	int depth=vd->pf_depth;
+	
+	/* slideshows keep a few files ahead, in slideshow order only */
+	if(vd->ss_active && depth<SLIDESHOW_DEPTH) depth=SLIDESHOW_DEPTH;
+	
+	if(!depth || !vd->pf_mem_max || !(vd->state&ISF_READY) ||
+		!vd->dir_name || app_inst.visual_info.class==PseudoColor ||
+		(vd->state&(DSF_READING|ISF_LOADING))) return;
+
+	stop_prefetch(vd);
+	
+	slots=calloc(depth*4,sizeof(struct prefetch_slot));
+	if(!slots) return;
+	
+	/* and have them scaled down to the view, if that's what's displayed */
+	vd->pf_fit_width=vd->pf_fit_height=0;
+	if(vd->ss_active && vd->zoom_fit &&
+		app_inst.visual_info.class==TrueColor){
+		Dimension vw=0, vh=0;
+		
+		XtVaGetValues(vd->wview,XmNwidth,&vw,XmNheight,&vh,NULL);
+		vd->pf_fit_width=vw;
+		vd->pf_fit_height=vh;
+	}
+	
+	title=strrchr(vd->file_name,'/');
+	title=(title)?title+1:vd->file_name;
+	
+	/* pages of the current file come first, they're decoded
+	 * from a separate handle, so vd->img_file isn't disturbed */
+	for(dist=1; dist<=vd->pf_depth && vd->img_file.npages>1; dist++){
+		for(dir=0; dir<2; dir++){
+			int page=(dir==0)?(vd->cur_page+dist):(vd->cur_page-dist);
+			
+			if(page<0 || page>=vd->img_file.npages) continue;
+			if(!(slots[nslots].file_name=make_dir_path(vd,title))) break;
+			slots[nslots].page=page;
+			nslots++;
+		}
+	}
+	
+	if(!stat(vd->dir_name,&st)){
+		if(!vd->dir_files){
+			memcpy(&vd->dir_stat,&st,sizeof(struct stat));
+			vd->dir_bkgnd=True;
+			vd->state|=DSF_READING;
+			if(pthread_create(&vd->rdr_thread,NULL,
+				dir_reader_thread,(void*)vd)){
+				vd->state&=(~DSF_READING);
+			}else{
+				pthread_detach(vd->rdr_thread);
+			}
+			n=0;
+		}else{
+			n=vd->dir_nfiles;
+		}
+		/* stale directory cache; it's rebuilt on next navigation */
+		if(vd->dir_stat.st_mtime!=st.st_mtime ||
+			vd->dir_stat.st_ino!=st.st_ino) n=0;
+	}else{
+		n=0;
+	}
+
+	/* the current file must be where load_next_file expects it */
+	cur=vd->dir_cur_file;
+	if(cur>=n || strcmp(vd->dir_files[cur],title)) n=0;
+
+	for(dist=1; dist<=depth && n; dist++){
+		for(dir=0; dir<2; dir++){
+			unsigned long k;
+			char *path;
+			
+			if(vd->ss_active){
+				if(dir) continue;
+				k=slideshow_step(vd,cur,
+					(vd->ss_order==SSO_REVERSE)?-dist:dist);
+			}else if(dir==0){
+				k=(cur+dist)%n;
+			}else{
+				k=(cur+n-(dist%n))%n;
+			}
+			if(k==cur) continue;
+			
+			if(!(path=make_dir_path(vd,vd->dir_files[k]))) break;
+			
+			/* small directories wrap around */
+			for(i=0; i<nslots; i++){
+				if(!strcmp(slots[i].file_name,path)) break;
+			}
+			if(i<nslots){
+				free(path);
+				continue;
+			}
+			slots[nslots].file_name=path;
+			nslots++;
+		}
+	}
+	
+	/* keep whatever has been decoded already */
+	for(i=0; i<nslots; i++){
+		for(j=0; j<vd->pf_nslots; j++){
+			struct prefetch_slot *old=&vd->pf_slots[j];
+			
+			if(old->image && old->page==slots[i].page &&
+				!strcmp(old->file_name,slots[i].file_name)){
+				slots[i].image=old->image;
+				slots[i].mod_time=old->mod_time;
+				slots[i].file_size=old->file_size;
+				old->image=NULL;
+				break;
+			}
+		}
+	}
+	
+	clear_prefetch(vd);
+	vd->pf_slots=slots;
+	vd->pf_nslots=nslots;
+
+	for(i=0; i<nslots; i++){
+		if(!slots[i].image) break;
+	}
+	if(i==nslots) return;
+	
+	vd->pf_cancel=0;
+	vd->pf_active=True;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr,PTHREAD_CREATE_DETACHED);
+	if(pthread_create(&vd->pf_thread,&attr,prefetch_thread,(void*)vd))
+		vd->pf_active=False;
+	pthread_attr_destroy(&attr);
+}
+
+/*
+ * Stop the prefetch thread if it's running and wait for it to exit.
+ */
+static void stop_prefetch(struct viewer_data *vd)
+{
+	pthread_mutex_lock(&vd->pf_cond_mutex);
+	if(vd->pf_active){
+		vd->pf_cancel=1;
+		while(vd->pf_active)
+			pthread_cond_wait(&vd->pf_finished_cond,&vd->pf_cond_mutex);
+	}
+	pthread_mutex_unlock(&vd->pf_cond_mutex);
+}
+
+/*
+ * Stop the prefetch thread and empty prefetch slots.
+ * Decoded images are moved into the image cache.
+ */
+static void clear_prefetch(struct viewer_data *vd)
+{
+	stop_prefetch(vd);
+	
+	while(vd->pf_nslots--){
+		struct prefetch_slot *slot=&vd->pf_slots[vd->pf_nslots];
+		
+		/* scaled down images don't belong in the cache */
+		if(slot->image && slot->full_width){
+			XDestroyImage(slot->image);
+		}else if(slot->image){
+			ic_put(slot->file_name,slot->mod_time,
+				slot->file_size,slot->page,slot->image);
+		}
+		free(slot->file_name);
+	}
+	if(vd->pf_slots) free(vd->pf_slots);
+	vd->pf_slots=NULL;
+	vd->pf_nslots=0;
+}
+
+/*
+ * Move the completely loaded current image into the image cache, so that
+ * it doesn't have to be decoded again when navigating back to it.
+ * Images the cache wouldn't keep are left in place.
+ */
+static void cache_current_image(struct viewer_data *vd)
+{
+	char *title;
+	char *path;
+	
+	if(!(vd->state&ISF_READY) || !vd->image ||
+		!vd->dir_name || vd->reduced || vd->partial || vd->wide) return;
+	
+	/* keep it for reuse by the next page if it wouldn't be cached */
+	if(!ic_fits(vd->image->bytes_per_line*vd->image->height)) return;
+	
+	title=strrchr(vd->file_name,'/');
+	title=(title)?title+1:vd->file_name;
+	if(!(path=make_dir_path(vd,title))) return;
+	
+	free_derived_images(vd);
+	ic_put(path,vd->mod_time,vd->file_size,vd->cur_page,vd->image);
+	vd->image=NULL;
+	free(path);
+}
+
+/*
+ * Returns the decoded image of 'page' of 'fname', if it's in a prefetch slot
+ * or the image cache, and up to date with 'st'. Returns NULL otherwise.
+ * The image is removed from wherever it was found. If 'info' isn't NULL,
+ * dimension and decode time fields of the prefetch slot are copied into it,
+ * which may indicate that the image was scaled down. Scaled down images are
+ * only returned if 'info' is given.
+ */
+static XImage* take_cached_image(struct viewer_data *vd,
+	const char *fname, const struct stat *st, int page,
+	struct prefetch_slot *info)
+{
+	XImage *image=NULL;
+	const char *title;
+	char *path;
+	unsigned int i;
+	
+	if(!vd->dir_name) return NULL;
+	
+	title=strrchr(fname,'/');
+	title=(title)?title+1:fname;
+	if(!(path=make_dir_path(vd,title))) return NULL;
+	
+	stop_prefetch(vd);
+	if(info) memset(info,0,sizeof(struct prefetch_slot));
+	
+	for(i=0; i<vd->pf_nslots; i++){
+		struct prefetch_slot *slot=&vd->pf_slots[i];
+		
+		if(slot->image && slot->page==page &&
+			!strcmp(slot->file_name,path)){
+			if(slot->mod_time==st->st_mtime &&
+				slot->file_size==st->st_size &&
+				(info || !slot->full_width)){
+				image=slot->image;
+				if(info){
+					info->full_width=slot->full_width;
+					info->full_height=slot->full_height;
+					info->decode_time=slot->decode_time;
+				}
+			}else{
+				XDestroyImage(slot->image);
+			}
+			slot->image=NULL;
+			break;
+		}
+	}
+	if(!image) image=ic_take(path,st->st_mtime,st->st_size,page);
+
+	free(path);
+	return image;
+}
+
+/*
+ * Prefetch thread entry point. Fills empty prefetch slots in order,
+ * until the memory cap is reached. Don't make any X/Motif calls here.
+ */
+static void* prefetch_thread(void *arg)
+{
+	struct viewer_data *vd=(struct viewer_data*)arg;
+	struct decoder dec;
+	struct tc_entry ent;
+	struct stat st;
+	struct timespec start, end;
+	size_t used=0;
+	unsigned int i;
+	
+	#ifdef SCHED_IDLE
+	{
+		struct sched_param sp;
+		
+		memset(&sp,0,sizeof(struct sched_param));
+		pthread_setschedparam(pthread_self(),SCHED_IDLE,&sp);
+	}
+	#endif
+	
+	for(i=0; i<vd->pf_nslots; i++){
+		XImage *img=vd->pf_slots[i].image;
+		if(img) used+=img->bytes_per_line*img->height;
+	}
+	
+	dec_init(&dec,&vd->pf_cancel);
+	
+	for(i=0; i<vd->pf_nslots && !vd->pf_cancel; i++){
+		struct prefetch_slot *slot=&vd->pf_slots[i];
+		size_t size;
+		
+		if(slot->image || stat(slot->file_name,&st)) continue;
+		
+		/* will be taken from the image cache */
+		if(ic_contains(slot->file_name,st.st_mtime,
+			st.st_size,slot->page)) continue;
+		
+		clock_gettime(CLOCK_MONOTONIC,&start);
+		if(dec_decode_page(&dec,slot->file_name,slot->page,&ent)) continue;
+		
+		/* pre-scaled for display, see start_prefetch */
+		if(vd->pf_fit_width && !slot->page &&
+			(slot->image=fit_image(&dec.image,
+			vd->pf_fit_width,vd->pf_fit_height))){
+			slot->full_width=dec.image.width;
+			slot->full_height=dec.image.height;
+		}
+		clock_gettime(CLOCK_MONOTONIC,&end);
+		slot->decode_time=(double)(end.tv_sec-start.tv_sec)+
+			(double)(end.tv_nsec-start.tv_nsec)/1.0e9;
+		
+		if(slot->image){
+			size=slot->image->bytes_per_line*slot->image->height;
+			if(used+size>vd->pf_mem_max){
+				XDestroyImage(slot->image);
+				slot->image=NULL;
+				break;
+			}
+		}else{
+			size=dec.image.bytes_per_line*dec.image.height;
+			if(used+size>vd->pf_mem_max) break;
+			if(!(slot->image=dec_detach_image(&dec))) break;
+		}
+		slot->mod_time=st.st_mtime;
+		slot->file_size=st.st_size;
+		used+=size;
+	}
+	dec_free(&dec);
+	
+	pthread_mutex_lock(&vd->pf_cond_mutex);
+	vd->pf_active=False;
+	pthread_cond_signal(&vd->pf_finished_cond);
+	pthread_mutex_unlock(&vd->pf_cond_mutex);
+	return NULL;
+}
+
+/*
+ * Returns a copy of 'img' scaled down to fit a 'width' x 'height' view in
+ * either orientation, as reduce_resolution would, or NULL if it fits
+ * already or there isn't enough memory. Called by the prefetch thread.
+ */
+static XImage* fit_image(XImage *img, unsigned int width, unsigned int height)
+{
+	XImage *fit;
+	float zoom, rzoom;
+	unsigned int fw, fh;
+	
+	zoom=fminf((float)width/img->width,(float)height/img->height);
+	rzoom=fminf((float)width/img->height,(float)height/img->width);
+	if(rzoom>zoom) zoom=rzoom;
+	if(zoom>=1.0) return NULL;
+	
+	fw=ceilf(img->width*zoom);
+	fh=ceilf(img->height*zoom);
+	if(!fw) fw=1;
+	if(!fh) fh=1;
+	
+	if(!(fit=malloc(sizeof(XImage)))) return NULL;
+	if(dec_init_image(fit,fw,fh,NULL) ||
+		!(fit->data=malloc(fit->bytes_per_line*fit->height))){
+		free(fit);
+		return NULL;
+	}
+	img_blt(img,0,0,img->width,img->height,fit,zoom,0,BLTF_INTERPOLATE);
+	return fit;
+}
+
+/*
+ * Start the slideshow. Files are displayed in the order set by the
+ * slideshowOrder resource, each for ss_interval after it's been displayed.
+ * Timing of each file is written to stdout, so that missed deadlines
+ * (files displayed more than SLIDESHOW_LATE_INT after they were due)
+ * can be told apart from slow decoding.
+ */
+static void start_slideshow(struct viewer_data *vd)
+{
+	vd->ss_active=True;
+	vd->ss_pending=False;
+	vd->ss_shown=vd->ss_missed=0;
+	vd->ss_decode_time=0;
+	
+	if(vd->state&ISF_READY){
+		start_prefetch(vd);
+		schedule_slideshow(vd);
+	}
+}
+
+static void stop_slideshow(struct viewer_data *vd)
+{
+	if(vd->ss_timer){
+		XtRemoveTimeOut(vd->ss_timer);
+		vd->ss_timer=None;
+	}
+	if(vd->ss_seq){
+		free(vd->ss_seq);
+		vd->ss_seq=NULL;
+		vd->ss_nseq=0;
+	}
+	if(!vd->ss_active) return;
+	vd->ss_active=False;
+	
+	if(!init_app_res.quiet && (vd->ss_shown+vd->ss_missed)){
+		printf("Slideshow: %lu files displayed, %lu late; "
+			"%.0f ms average decoding time\n",
+			vd->ss_shown+vd->ss_missed,vd->ss_missed,
+			vd->ss_decode_time*1000/(vd->ss_shown+vd->ss_missed));
+		fflush(stdout);
+	}
+	start_prefetch(vd);
+}
+
+/* (Re)start the slideshow interval */
+static void schedule_slideshow(struct viewer_data *vd)
+{
+	if(vd->ss_timer) XtRemoveTimeOut(vd->ss_timer);
+	vd->ss_timer=XtAppAddTimeOut(app_inst.context,vd->ss_interval,
+		slideshow_timer_cb,(XtPointer)vd);
+}
+
+static void slideshow_timer_cb(XtPointer client, XtIntervalId *iid)
+{
+	struct viewer_data *vd=(struct viewer_data*)client;
+	
+	vd->ss_timer=None;
+	if(!vd->ss_active) return;
+	
+	clock_gettime(CLOCK_MONOTONIC,&vd->ss_due);
+	vd->ss_pending=True;
+	load_next_file(vd,(vd->ss_order!=SSO_REVERSE));
+	
+	/* couldn't be opened; try the next one in time */
+	if(!(vd->state&(ISF_LOADING|ISF_READY|DSF_READING)) &&
+		!vd->nav_pending){
+		vd->ss_pending=False;
+		schedule_slideshow(vd);
+	}
+}
+
+/*
+ * Called whenever an image is displayed in slideshow mode. Reports timing
+ * of the file due, and restarts the interval.
+ */
+static void slideshow_shown(struct viewer_data *vd)
+{
+	struct timespec now;
+	double latency, decode_time;
+	const char *title;
+	
+	if(vd->ss_pending){
+		vd->ss_pending=False;
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		latency=(double)(now.tv_sec-vd->ss_due.tv_sec)+
+			(double)(now.tv_nsec-vd->ss_due.tv_nsec)/1.0e9;
+		
+		/* decoded ahead, or while it was due */
+		decode_time=vd->pf_decode_time?vd->pf_decode_time:latency;
+		vd->ss_decode_time+=decode_time;
+		if(latency*1000>SLIDESHOW_LATE_INT)
+			vd->ss_missed++;
+		else
+			vd->ss_shown++;
+		
+		if(!init_app_res.quiet){
+			title=strrchr(vd->file_name,'/');
+			title=(title)?title+1:vd->file_name;
+			printf("Slideshow: %s: displayed %.0f ms after due%s; "
+				"decoded %s in %.0f ms\n",title,latency*1000,
+				(latency*1000>SLIDESHOW_LATE_INT)?" (late)":"",
+				vd->pf_decode_time?"ahead":"on demand",decode_time*1000);
+			fflush(stdout);
+		}
+	}
+	schedule_slideshow(vd);
+}
+
+/*
+ * Returns the index of the file 'n' positions from 'cur' in slideshow
+ * order. Random order is a permutation of the directory, made up once
+ * for each directory listing, so that each file is shown once per cycle.
+ */
+static unsigned long slideshow_step(struct viewer_data *vd,
+	unsigned long cur, long n)
+{
+	unsigned long nfiles=vd->dir_nfiles;
+	unsigned long i;
+	
+	if(!nfiles) return 0;
+	if(vd->ss_order!=SSO_RANDOM){
+		long k=((long)cur+n)%(long)nfiles;
+		return (k<0)?(k+nfiles):k;
+	}
+	
+	if(!vd->ss_seq || vd->ss_nseq!=nfiles){
+		if(vd->ss_seq) free(vd->ss_seq);
+		vd->ss_nseq=0;
+		if(!(vd->ss_seq=malloc(sizeof(unsigned long)*nfiles)))
+			return (cur+nfiles+(n%(long)nfiles))%nfiles;
+		
+		for(i=0; i<nfiles; i++) vd->ss_seq[i]=i;
+		for(i=nfiles-1; i>0; i--){
+			unsigned long j=rand_r(&vd->ss_seed)%(i+1);
+			unsigned long tmp=vd->ss_seq[i];
+			
+			vd->ss_seq[i]=vd->ss_seq[j];
+			vd->ss_seq[j]=tmp;
+		}
+		vd->ss_nseq=nfiles;
+	}
+	
+	for(i=0; i<nfiles && vd->ss_seq[i]!=cur; i++);
+	if(i==nfiles) i=0;
+	n%=(long)nfiles;
+	return vd->ss_seq[(i+nfiles+n)%nfiles];
+}
+
+/*
+ * Reset the viewer to the initial state.
+ */
+static void reset_viewer(struct viewer_data *vd)
+{
+	/* if a loader thread is running set state to cancelled
+	 * and wait for it to exit */
+	pthread_mutex_lock(&vd->ldr_cond_mutex);
+	if(vd->state&ISF_LOADING){
+		vd->state|=ISF_CANCEL;
+		if(vd->prog_timer) XtRemoveTimeOut(vd->prog_timer);
+		if(vd->vprog_timer) XtRemoveTimeOut(vd->vprog_timer);
+		vd->prog_timer=None;
+		vd->vprog_timer=None;
+		pthread_cond_wait(&vd->ldr_finished_cond,&vd->ldr_cond_mutex);
+	}
+	pthread_mutex_unlock(&vd->ldr_cond_mutex);
+
+	/* drop any coalesced navigation request */
+	if(vd->nav_timer){
+		XtRemoveTimeOut(vd->nav_timer);
+		vd->nav_timer=None;
+	}
+	vd->nav_pending=False;
+	
+	/* nothing left to render */
+	if(vd->render_timer){
+		XtRemoveTimeOut(vd->render_timer);
+		vd->render_timer=None;
+	}
+	vd->render_flags=0;
+	cancel_refinement(vd);
+	stop_full_resolution(vd);
+	vd->reduced=False;
+	vd->fr_failed=False;
+	stop_follow(vd);
+	vd->partial=False;
+	free_wide(vd);
+	vd->leveling=False;
+
+	free_derived_images(vd);
+	if(vd->image){
+		XDestroyImage(vd->image);
+		vd->image=NULL;
+	}
+	if(vd->file_name){
+		free(vd->file_name);
+		vd->file_name=NULL;
+	}
+	if(vd->state&ISF_OPENED){
+		img_close(&vd->img_file);
+	}
+	
+	#ifdef ENABLE_CDE
+	/* notify the requestor if the viewer was instantiated through ToolTalk */
+	if(vd->tt_disp_req){
+		ttmedia_load_reply(vd->tt_disp_req,NULL,0,True);
+		vd->tt_disp_req=NULL;
+	}
+	#endif /* ENABLE_CDE */
+	
+	/* reset properties to defaults */
+	vd->state&=(~(ISF_OPENED|ISF_READY));
+	vd->cur_page=0;
+	vd->zoom=1;
+	vd->xoff=0;
+	vd->yoff=0;
+	if(!vd->keep_tform) vd->tform=0;
+	
+	/* update the user interface */
+	XClearArea(app_inst.display,XtWindow(vd->wview),0,0,0,0,False);
+	update_shell_title(vd);
+	display_status_summary(vd);
+	update_props_msg(vd);
+	update_pointer_shape(vd);
+	update_controls(vd);
+	XmUpdateDisplay(vd->wshell);
+}
+
+/*
+ * Compute the zoom value so that the image fits within view boundaries.
+ * Returns 1 if the image is smaller than the view.
+ */
+static float compute_fit_zoom(struct viewer_data *vd)
+{
+	Dimension vw=0, vh=0;
+	int img_width, img_height, img_min;
+	unsigned long full_width, full_height;
+	float xratio, yratio;
+	float zoom;
+	XtVaGetValues(vd->wview,XmNwidth,&vw,XmNheight,&vh,NULL);
+	
+	get_image_size(vd,&full_width,&full_height);
+	dassert(full_width && full_height);
+	
+	img_width=(view_tform(vd)&IMGT_ROTATE)?full_height:full_width;
+	img_height=(view_tform(vd)&IMGT_ROTATE)?full_width:full_height;
+	xratio=(float)vw/img_width;
+	yratio=(float)vh/img_height;
+	
+	if(xratio<1.0 || yratio<1.0){
+		zoom=(xratio<yratio?xratio:yratio);
+		compute_image_dimensions(vd,zoom,vd->tform,&img_width,&img_height);
+		img_min = ((img_width<img_height)?img_width:img_height);
+		zoom = img_min ? zoom : 1;
+	}else{
+		zoom=1;
+	}
+
+	return zoom;
+}
+
+/*
+ * Returns the transformation flags the image is displayed with; those
+ * set by the user applied to the image's own orientation.
+ */
+static unsigned int view_tform(struct viewer_data *vd)
+{
+	return img_combine_tform(vd->img_file.tform,vd->tform);
+}
+
+/*
+ * Compute image dimensions according to the specified zoom value
+ * and user transformations flags (see view_tform).
+ */
+static void compute_image_dimensions(struct viewer_data *vd,
+	float zoom, unsigned int tform, int *width, int *height)
+{
+	unsigned long full_width, full_height;
+	
+	get_image_size(vd,&full_width,&full_height);
+	if(img_combine_tform(vd->img_file.tform,tform)&IMGT_ROTATE){
+		*width=full_height*zoom;
+		*height=full_width*zoom;
+	}else{
+		*width=full_width*zoom;
+		*height=full_height*zoom;
+	}
+}
+
+/*
+ * Get full resolution dimensions of the current image
+ */
+static void get_image_size(struct viewer_data *vd,
+	unsigned long *width, unsigned long *height)
+{
+	if(vd->reduced){
+		*width=vd->full_width;
+		*height=vd->full_height;
+	}else{
+		*width=vd->image->width;
+		*height=vd->image->height;
+	}
+}
+
+/*
+ * Set shell and icon title to reflect the current state of the viewer instance.
+ */
+static void update_shell_title(struct viewer_data *vd)
+{
+	if((vd->state & ISF_OPENED) || vd->nav_pending){
+		char *buffer;
+		char *ftitle;
+		ftitle = strrchr(vd->file_name,'/');
+		
+		if(!ftitle)
+			ftitle = vd->file_name;
+		else
+			ftitle++;
+		
+		buffer = malloc(strlen(vd->title) + strlen(ftitle) + 4);
+		sprintf(buffer,"%s - %s", ftitle, vd->title);
+		
+		set_shell_title(vd->wshell, buffer, buffer);
+		
+		free(buffer);
+	}else{
+		set_shell_title(vd->wshell, vd->title, vd->title);
+	}
+}
+
+/*
+ * Display a message in the status area
+ */
+static void set_status_msg(struct viewer_data *vd,
+	int msg_id, const char *text)
+{
+	Arg arg[1];
+	XmString str;
+
+	str=XmStringCreateLocalized(nlstr(APP_MSGSET,msg_id,(char*)text));
+	XtSetArg(arg[0],XmNlabelString,str);
+	XtSetValues(vd->wmsg,arg,1);
+	XmStringFree(str);
+	XmUpdateDisplay(vd->wmsg);
+}
+
+/*
+ * Build file info summary and put it in the status area
+ */
+static void display_status_summary(struct viewer_data *vd)
+{
+	char *buffer;
+	size_t len;
+	struct tm *time;
+	char size_str[SIZE_CS_MAX];
+	const char fmt_string[]="%s, %s, %d-%.2d-%.2d %.2d:%.2d";
+	XmString xm_str;
+	Arg arg[1];
+	
+	if(vd->state&ISF_OPENED){
+		get_size_string(vd->file_size, size_str);
+
+		time=localtime(&vd->img_file.cr_time);
+		
+		len = snprintf(NULL, 0, fmt_string, vd->img_file.type_str,
+			size_str, time->tm_year + 1900, time->tm_mon + 1,
+			time->tm_mday + 1, time->tm_hour, time->tm_min) + 1;
+
+		buffer = malloc(len);
+	
+		snprintf(buffer, len, fmt_string, vd->img_file.type_str,
+			size_str, time->tm_year + 1900, time->tm_mon + 1,
+			time->tm_mday + 1, time->tm_hour, time->tm_min);
+			
+		xm_str=XmStringCreateLocalized(buffer);
+		XtSetArg(arg[0],XmNlabelString,xm_str);
+		XtSetValues(vd->wmsg,arg,1);
+		XmStringFree(xm_str);
+		free(buffer);
+		XmUpdateDisplay(vd->wprops);
+	}else{
+		update_page_msg(vd);
+		set_status_msg(vd,SID_READY,"Ready");
+	}
+}
+
+/*
+ * Update the properties status area
+ */
+static void update_props_msg(struct viewer_data *vd)
+{
+	/* NxN - N BPP*/
+	char props_str[32];
+	XmString xm_str;
+	Arg arg[1];
+
+	if(vd->state&ISF_OPENED){
+		snprintf(props_str,30,"%ldx%ld, %hd BPP",
+			vd->reduced?vd->full_width:vd->img_file.width,
+			vd->reduced?vd->full_height:vd->img_file.height,
+			vd->img_file.orig_bpp);
+	}else{
+		strncpy(props_str,nlstr(APP_MSGSET,SID_NOIMAGE,"No image"),30);
+	}
+	xm_str=XmStringCreateLocalized(props_str);
+	XtSetArg(arg[0],XmNlabelString,xm_str);
+	XtSetValues(vd->wprops,arg,1);
+	XmUpdateDisplay(vd->wprops);
+	XmStringFree(xm_str);
+}
+
+/*
+ * Show the current zoom value and the page number in the status area
+ */
+static void update_page_msg(struct viewer_data *vd)
+{
+	XmString xmstr;
+	Arg arg[1];
+	/* D.F% (N/N) */
+	char zoom_str[32];
+	
+	if(vd->img_file.npages>1){
+		snprintf(zoom_str,sizeof(zoom_str),"%.0f%% (%d/%d)",
+			(vd->zoom*100),vd->cur_page+1,vd->img_file.npages);
+	}else{
+		snprintf(zoom_str,sizeof(zoom_str),"%.0f%%",(vd->zoom*100));
+	}
+	xmstr=XmStringCreateLocalized(zoom_str);
+	XtSetArg(arg[0],XmNlabelString,xmstr);
+	XtSetValues(vd->wzoom,arg,1);
+	XmStringFree(xmstr);
+	XmUpdateDisplay(vd->wzoom);
+}
+
+/*
+ * Update input widgets to reflect the current viewer state
+ */
+static void update_controls(struct viewer_data *vd)
+{
+	Boolean ready=((vd->state&ISF_READY)!=0);
+	
+	if((vd->state&DSF_READING) && !vd->dir_bkgnd){
+		XtSetSensitive(vd->wmenubar,False);
+		if(vd->show_tbr) XtSetSensitive(vd->wtoolbar,False);
+		return;
+	}else{
+		XtSetSensitive(vd->wmenubar,True);
+		if(vd->show_tbr) XtSetSensitive(vd->wtoolbar,True);
+	}
+	
+	XtSetSensitive(get_menu_item(vd,"*zoomMenu"),ready);
+	XtSetSensitive(get_menu_item(vd,"*editMenu"),ready);
+	XtSetSensitive(get_menu_item(vd,"*refresh"),ready);
+	XtSetSensitive(get_menu_item(vd,"*editMenu"),ready);
+	XtSetSensitive(get_menu_item(vd,"*rotateMenu"),ready);
+	XtSetSensitive(get_menu_item(vd,"*levelsMenu"),(ready && vd->wide));
+
+	XtSetSensitive(get_menu_item(vd,"*browseHere"),(vd->file_name!=NULL));
+	
+	XtSetSensitive(get_menu_item(vd,"*nextFile"),
+		(vd->dir_name || vd->file_name));
+	XtSetSensitive(get_menu_item(vd,"*previousFile"),
+		(vd->dir_name || vd->file_name));
+
+	XtSetSensitive(get_menu_item(vd,"*nextPage"),
+		(ready && vd->img_file.npages &&
+		vd->cur_page+1<vd->img_file.npages));
+	XtSetSensitive(get_menu_item(vd,"*previousPage"),
+		(ready && vd->img_file.npages && vd->cur_page!=0));
+	
+	XtSetSensitive(get_menu_item(vd,"*zoomIn"),True);
+	XtSetSensitive(get_menu_item(vd,"*zoomOut"),True);
+	XtSetSensitive(get_menu_item(vd,"*edit"),(ready && init_app_res.edit_cmd));
+	XtSetSensitive(get_menu_item(vd,"*passTo"), ready);
+
+	XmUpdateDisplay(vd->wmenubar);
+
+	if(vd->show_tbr){
+		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*browseHere"),
+			(vd->file_name!=NULL));
+		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*zoomIn"),ready);
+		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*zoomOut"),ready);
+		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*zoomNone"),ready);
+		XtSetSensitive(get_toolbar_item(vd->wtoolbar,
+			"*flipHorizontally"),ready);
+		XtSetSensitive(get_toolbar_item(vd->wtoolbar,
+			"*flipVertically"),ready);
+		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*rotateLeft"),ready);
+		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*rotateRight"),ready);
+		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*nextFile"),
+			(vd->dir_name || vd->file_name));
+		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*previousFile"),
+			(vd->dir_name || vd->file_name));
+	
+		XmUpdateDisplay(vd->wtoolbar);
+	}
+}
+
+/*
+ * Set the pointer shape to indicate if panning is possible
+ */
+static void update_pointer_shape(struct viewer_data *vd)
+{
+	Dimension view_width,view_height;
+	int img_width,img_height;
+	Arg arg[]={{XmNwidth,(XtArgVal)&view_width},
+		{XmNheight,(XtArgVal)&view_height}};
+	
+	if(vd->state&ISF_READY){
+		XtGetValues(vd->wview,arg,2);
+		compute_image_dimensions(vd,vd->zoom,vd->tform,
+			&img_width,&img_height);
+		if(img_width>view_width || img_height>view_height)
+			set_widget_cursor(vd->wview,CUR_GRAB);
+		else
+			set_widget_cursor(vd->wview,CUR_POINTER);
+	}else{
+		set_widget_cursor(vd->wview,CUR_POINTER);
+	}
+}
+
+
+/*
+ * Update the zoom value, recompute offsets and redraw the view.
+ */
+static void zoom_view(struct viewer_data *vd, float zoom)
+{
+	Boolean erase;
+	int iw, ih, ipw, iph;
+	int xoff=vd->xoff, yoff=vd->yoff;
+	unsigned long full_width, full_height;
+	float min_zoom;
+	float nx, ny;
+
+	/* compute the minimum zoom value */
+	get_image_size(vd,&full_width,&full_height);
+	min_zoom = ((full_width > full_height) ?
+		((float)MIN_ZOOMED_SIZE / full_width) :
+		((float)MIN_ZOOMED_SIZE / full_height));
+	if(min_zoom > 1.0) min_zoom = 1.0;
+
+	/* reenable controls if we're out of the min/max zone */
+	if(vd->zoom==MAX_ZOOM){
+		XtSetSensitive(get_menu_item(vd,"*zoomIn"),True);
+		if(vd->show_tbr) XtSetSensitive(
+			get_toolbar_item(vd->wtoolbar,"*zoomIn"),True);
+	}else if(vd->zoom==min_zoom){
+		XtSetSensitive(get_menu_item(vd,"*zoomOut"),True);
+		if(vd->show_tbr) XtSetSensitive(
+			get_toolbar_item(vd->wtoolbar,"*zoomOut"),True);
+	}
+		
+	/* clamp the zoom value */
+	if(zoom<=min_zoom){
+		zoom=min_zoom;
+		XtSetSensitive(get_menu_item(vd,"*zoomOut"),False);
+		if(vd->show_tbr) XtSetSensitive(
+			get_toolbar_item(vd->wtoolbar,"*zoomOut"),False);
+	}else if(zoom>=MAX_ZOOM){
+		zoom=MAX_ZOOM;
+		XtSetSensitive(get_menu_item(vd,"*zoomIn"),False);
+		if(vd->show_tbr) XtSetSensitive(
+			get_toolbar_item(vd->wtoolbar,"*zoomIn"),False);
+	}
+	
+	/* figure out how to distribute offsets for the new image size */
+	compute_image_dimensions(vd,vd->zoom,vd->tform,&ipw,&iph);
+	compute_image_dimensions(vd,zoom,vd->tform,&iw,&ih);
+	nx=(float)(ipw-vd->bkbuf->width)/(xoff?xoff:1);
+	ny=(float)(iph-vd->bkbuf->height)/(yoff?yoff:1);
+
+	if(zoom>vd->zoom){
+		/* we want to zoom centered if the image was previously
+		 * smaller than the viewport */
+		if(ipw<=vd->bkbuf->width && iw>vd->bkbuf->width)
+			xoff-=(iw-vd->bkbuf->width)/2;
+		else if(xoff) xoff-=fabs((float)(ipw-iw)/nx);
+
+		if(iph<=vd->bkbuf->height && ih>vd->bkbuf->height)
+			yoff-=(ih-vd->bkbuf->height)/2;
+		else if(yoff) yoff-=fabs((float)(iph-ih)/ny);
+
+		erase=False;
+	}else{
+		if(xoff) xoff+=fabs((float)(ipw-iw)/nx);
+		if(yoff) yoff+=fabs((float)(iph-ih)/ny);
+		erase=True;
+	}
+
+	/* clamp and store offsets */
+	vd->xoff=(xoff<0)?xoff:0;
+	vd->yoff=(yoff<0)?yoff:0;
+
+	/* store the zoom value and update visuals */
+	vd->zoom=zoom;
+	update_page_msg(vd);
+	request_render(vd,RF_UPDATE|(erase?RF_CLEAR:0));
+	update_pointer_shape(vd);
+}
+
+/*
+ * Compute offsets according to new transform flags and redraw
+ */
+static void rotate_view(struct viewer_data *vd, Boolean cw)
+{
+	float xoff=vd->xoff;
+	float yoff=vd->yoff;
+	unsigned int tform=vd->tform;
+	unsigned int rotation=0;
+	
+	/* The blitter doesn't do per-pixel transforms, because this is not
+	 * really needed, instead it uses 90 deg cw rotation + flipping to
+	 * simulate transformations. This part figures out the flag combination. */
+	if(tform&IMGT_ROTATE){
+		if(tform&IMGT_VFLIP)
+			rotation=270;
+		else
+			rotation=90;
+	}else{
+		if(tform&IMGT_VFLIP) rotation=180;
+	}
+	if(cw) rotation+=90; else rotation-=90;
+
+	switch(rotation){
+		case 90: tform=IMGT_ROTATE; break;
+		case 180: tform=IMGT_VFLIP|IMGT_HFLIP; break;
+		case -90:
+		case 270: tform=IMGT_ROTATE|IMGT_VFLIP|IMGT_HFLIP; break;
+		case 0:
+		case 360: tform=0; break;
+	};
+	
+	/* adjust the offsets if image orientation has changed */
+	if((tform&IMGT_ROTATE && !(vd->tform&IMGT_ROTATE))||
+		(!(tform&IMGT_ROTATE) && vd->tform&IMGT_ROTATE))
+	{
+		Dimension vw, vh;
+		int iw, ih;
+		float vpc=0;
+		float hpc=0;
+		
+		XtVaGetValues(vd->wview,XmNwidth,&vw,XmNheight,&vh,NULL);
+		compute_image_dimensions(vd,vd->zoom,vd->tform,&iw,&ih);
+		
+		if(vw<iw) hpc=(float)fabs(xoff)/(iw-vw);
+		if(vh<ih) vpc=(float)fabs(yoff)/(ih-vh);
+	
+		compute_image_dimensions(vd,vd->zoom,tform,&iw,&ih);
+		
+		if(vw<iw) xoff= -((iw-vw)*hpc); else xoff=0;
+		if(vh<ih) yoff= -((ih-vh)*vpc); else yoff=0;
+	}
+
+	vd->tform=tform;
+	if(vd->zoom_fit){
+		zoom_view(vd,compute_fit_zoom(vd));
+	}else{
+		vd->xoff=(short)xoff;
+		vd->yoff=(short)yoff;
+	}
+	update_pointer_shape(vd);
+	request_render(vd,RF_UPDATE|RF_CLEAR);
+}
+
+/*
+ * Scroll image. x,y specify offsets relative to the current scroll position.
+ */
+static void scroll_view(struct viewer_data *vd, int x, int y)
+{
+	int iw,ih;
+	int xmax, ymax;
+	float xoff=vd->xoff, yoff=vd->yoff;
+	unsigned short tform=view_tform(vd);
+	
+	if(tform&IMGT_ROTATE){
+		if(!(tform&IMGT_VFLIP)) x=(-x);
+		if(tform&IMGT_HFLIP) y=(-y);
+	}else{
+		if(tform&IMGT_HFLIP) x=(-x);
+		if(tform&IMGT_VFLIP) y=(-y);
+	}	
+	/* compute and clamp scroll offsets */
+	compute_image_dimensions(vd,vd->zoom,vd->tform,&iw,&ih);
+	xmax= -(iw-vd->bkbuf->width);
+	ymax= -(ih-vd->bkbuf->height);
+	if(xmax<0){
+		if(xoff+x < xmax) x-=(xoff+x)-xmax;
+		else if(xoff+x > 0)	x-=xoff+x;
+	}else x=0;
+	if(ymax<0){
+		if(yoff+y < ymax) y-=(yoff+y)-ymax;
+		else if(yoff+y > 0)	y-=yoff+y;
+	}else y=0;
+	
+	if(!x && !y) return;
+
+	/* store the offsets and sync the image */
+	vd->xoff += x;
+	vd->yoff += y;
+	request_render(vd,RF_SCROLL);
+}
+
+/*
+ * Request the view to be rendered according to RF_* 'flags'. Requests are
+ * accumulated and rendered at most once per RENDER_FRAME_INT, so that
+ * intermediate states are dropped when they come in faster than that.
+ */
+static void request_render(struct viewer_data *vd, unsigned short flags)
+{
+	cancel_refinement(vd);
+	vd->render_flags|=flags;
+	if(!vd->render_timer) render_frame(vd);
+}
+
+/*
+ * Render pending requests and start the frame timer if there were any.
+ * If filtering applies, a nearest-neighbour draft is rendered and refined
+ * by refine_proc once the application is idle.
+ */
+static void render_frame(struct viewer_data *vd)
+{
+	unsigned short flags=vd->render_flags;
+	Boolean refine, server;
+	
+	vd->render_flags=0;
+	if(!flags || !(vd->state&(ISF_LOADING|ISF_READY))) return;
+	
+	/* zoomed past the resolution the image was read at */
+	if(vd->reduced && (vd->state&ISF_READY) &&
+		vd->zoom*vd->full_width>vd->image->width) start_full_resolution(vd);
+	
+	if(vd->lv_dirty) apply_levels(vd);
+	
+	/* the server scales directly into the view, see expose_cb */
+	server=use_server_scaling(vd);
+	if(vd->srv_drawn && !server) flags|=RF_UPDATE;
+	vd->srv_drawn=server;
+	
+	refine=server?False:needs_refinement(vd);
+	vd->draft=refine;
+	
+	/* redraw only the portion scrolled into view if possible */
+	if(!server && ((flags&RF_UPDATE) ||
+		!scroll_back_buffer(vd,vd->bkbuf_ox,vd->bkbuf_oy))){
+		update_back_buffer(vd);
+	}
+	redraw_view(vd,(flags&RF_CLEAR)?True:False);
+	vd->draft=False;
+	
+	/* fastPanning defers refinement until the button is released */
+	if(refine && !(init_app_res.fast_pan && vd->panning))
+		start_refinement(vd);
+	
+	vd->render_timer=XtAppAddTimeOut(app_inst.context,RENDER_FRAME_INT,
+		render_timer_cb,(XtPointer)vd);
+}
+
+static void render_timer_cb(XtPointer client, XtIntervalId *iid)
+{
+	struct viewer_data *vd=(struct viewer_data*)client;
+	
+	vd->render_timer=None;
+	render_frame(vd);
+}
+
+/*
+ * Returns True if the back-buffer would be drawn filtered at current zoom,
+ * and a nearest-neighbour draft would look any different.
  */
-static float compute_fit_zoom(struct viewer_data *vd)
+static Boolean needs_refinement(struct viewer_data *vd)
 {
-	Dimension vw=0, vh=0;
-	int img_width, img_height, img_min;
-	float xratio, yratio;
 	float zoom;
-	XtVaGetValues(vd->wview,XmNwidth,&vw,XmNheight,&vh,NULL);
+	int ox, oy;
 	
-	dassert(vd->image->width && vd->image->height);
-	
-	img_width=(vd->tform&IMGT_ROTATE)?vd->image->height:vd->image->width;
-	img_height=(vd->tform&IMGT_ROTATE)?vd->image->width:vd->image->height;
-	xratio=(float)vw/img_width;
-	yratio=(float)vh/img_height;
+	if(!(vd->state&ISF_READY)) return False;
 	
-	if(xratio<1.0 || yratio<1.0){
-		zoom=(xratio<yratio?xratio:yratio);
-		compute_image_dimensions(vd,zoom,vd->tform,&img_width,&img_height);
-		img_min = ((img_width<img_height)?img_width:img_height);
-		zoom = img_min ? zoom : 1;
-	}else{
-		zoom=1;
-	}
+	/* the zoom blitted at, which is relative to a reduced copy if any;
+	 * img_blt interpolates between 0.5 and 1.0 regardless of flags */
+	get_blit_source(vd,&zoom,&ox,&oy);
+	if(zoom>1.0) return init_app_res.int_up;
+	if(zoom<0.5) return init_app_res.int_down;
+	return False;
+}
 
-	return zoom;
+/*
+ * Start redrawing the back-buffer with filtering enabled, a band of
+ * REFINE_BAND_SIZE rows at a time, whenever there are no events pending.
+ */
+static void start_refinement(struct viewer_data *vd)
+{
+	cancel_refinement(vd);
+	vd->refine_row=0;
+	vd->refine_wp=XtAppAddWorkProc(app_inst.context,
+		refine_proc,(XtPointer)vd);
+}
+
+static void cancel_refinement(struct viewer_data *vd)
+{
+	if(vd->refine_wp){
+		XtRemoveWorkProc(vd->refine_wp);
+		vd->refine_wp=None;
+	}
 }
 
 /*
- * Compute image dimensions according to the specified zoom value
- * and transformations flags.
+ * Back-buffer refinement work procedure. The view is updated once
+ * all bands are drawn, since a view change in between cancels it.
  */
-static void compute_image_dimensions(struct viewer_data *vd,
-	float zoom, unsigned int tform, int *width, int *height)
+static Boolean refine_proc(XtPointer client)
 {
-	if(tform&IMGT_ROTATE){
-		*width=vd->image->height*zoom;
-		*height=vd->image->width*zoom;
-	}else{
-		*width=vd->image->width*zoom;
-		*height=vd->image->height*zoom;
+	struct viewer_data *vd=(struct viewer_data*)client;
+	XImage *src;
+	float zoom;
+	int ox, oy, width, height, band;
+	
+	src=get_blit_source(vd,&zoom,&ox,&oy);
+	width=(int)(src->width*zoom)-ox;
+	height=(int)(src->height*zoom)-oy;
+	clip_to_back_buffer(vd,&width,&height);
+	
+	if(vd->refine_row<height && width>0){
+		band=height-vd->refine_row;
+		if(band>REFINE_BAND_SIZE) band=REFINE_BAND_SIZE;
+
+		if(draw_back_buffer_rect(vd,src,zoom,ox,oy,width,height,
+			0,vd->refine_row,width,band,NULL)){
+			vd->refine_row+=band;
+			if(vd->refine_row<height) return False;
+		}
 	}
+	
+	vd->refine_wp=None;
+	redraw_view(vd,False);
+	return True;
 }
 
 /*
- * Set shell and icon title to reflect the current state of the viewer instance.
+ * Update the back-buffer
  */
-static void update_shell_title(struct viewer_data *vd)
+static void update_back_buffer(struct viewer_data *vd)
 {
-	if(vd->state & ISF_OPENED){
-		char *buffer;
-		char *ftitle;
-		ftitle = strrchr(vd->file_name,'/');
-		
-		if(!ftitle)
-			ftitle = vd->file_name;
-		else
-			ftitle++;
-		
-		buffer = malloc(strlen(vd->title) + strlen(ftitle) + 4);
-		sprintf(buffer,"%s - %s", ftitle, vd->title);
-		
-		set_shell_title(vd->wshell, buffer, buffer);
-		
-		free(buffer);
-	}else{
-		set_shell_title(vd->wshell, vd->title, vd->title);
+	XImage *src;
+	float zoom;
+	int ox, oy, width, height;
+	unsigned short tform = view_tform(vd);
+	
+	cancel_refinement(vd);
+	src = get_blit_source(vd, &zoom, &ox, &oy);
+	vd->bkbuf_ox = ox;
+	vd->bkbuf_oy = oy;
+	width = (int)(src->width * zoom) - ox;
+	height = (int)(src->height * zoom) - oy;
+	if(width <= 0 || height <= 0) return;
+	
+	if((vd->state & ISF_READY) && tlc_enabled(&vd->tiles)) {
+		clip_to_back_buffer(vd, &width, &height);
+		if(draw_tiles(vd, src, zoom, ox, oy, width, height,
+			0, 0, width, height)) return;
 	}
+	img_blt_scaled(src, ox, oy, width, height,
+		vd->bkbuf, zoom, tform, get_blit_flags(vd));
 }
 
 /*
- * Display a message in the status area
+ * Shift the back-buffer contents drawn with scaled origin at 'prev_ox',
+ * 'prev_oy' (as returned by get_blit_source) to match current offsets,
+ * and draw the uncovered area only. Returns False if the back-buffer
+ * has to be updated completely.
  */
-static void set_status_msg(struct viewer_data *vd,
-	int msg_id, const char *text)
+static Boolean scroll_back_buffer(struct viewer_data *vd,
+	int prev_ox, int prev_oy)
 {
-	Arg arg[1];
-	XmString str;
+	XImage *src;
+	float zoom;
+	int ox, oy, du, dv, su, sv;
+	int width, height, prev_width, prev_height;
+	unsigned short tform = view_tform(vd);
+	Boolean hflip = (tform & IMGT_HFLIP) ? True : False;
+	Boolean vflip = ((tform & IMGT_VFLIP) ? True : False) ^
+		((tform & IMGT_ROTATE) ? True : False);
+	
+	cancel_refinement(vd);
+	src = get_blit_source(vd, &zoom, &ox, &oy);
+	
+	/* extents of the drawn area before and after, in image orientation */
+	width = (int)(src->width * zoom) - ox;
+	height = (int)(src->height * zoom) - oy;
+	prev_width = (int)(src->width * zoom) - prev_ox;
+	prev_height = (int)(src->height * zoom) - prev_oy;
+	clip_to_back_buffer(vd, &width, &height);
+	clip_to_back_buffer(vd, &prev_width, &prev_height);
+	du = ox - prev_ox;
+	dv = oy - prev_oy;
+	if(width != prev_width || height != prev_height ||
+		abs(du) >= width || abs(dv) >= height) return False;
+	
+	/* move what remains visible */
+	su = hflip ? du : -du;
+	sv = vflip ? dv : -dv;
+	if(tform & IMGT_ROTATE)
+		img_scroll(vd->bkbuf, height, width, sv, su);
+	else
+		img_scroll(vd->bkbuf, width, height, su, sv);
+	
+	/* draw uncovered columns and rows */
+	if(du && !draw_back_buffer_rect(vd, src, zoom, ox, oy, width, height,
+		(du > 0) ? (width - du) : 0, 0, abs(du), height, NULL)) return False;
+	if(dv && !draw_back_buffer_rect(vd, src, zoom, ox, oy, width, height,
+		0, (dv > 0) ? (height - dv) : 0, width, abs(dv), NULL)) return False;
+	
+	vd->bkbuf_ox = ox;
+	vd->bkbuf_oy = oy;
+	return True;
+}
 
-	str=XmStringCreateLocalized(nlstr(APP_MSGSET,msg_id,(char*)text));
-	XtSetArg(arg[0],XmNlabelString,str);
-	XtSetValues(vd->wmsg,arg,1);
-	XmStringFree(str);
-	XmUpdateDisplay(vd->wmsg);
+/*
+ * Draw image rows decoded since the last call to the back-buffer,
+ * and put the affected portion of it to the view.
+ */
+static void update_loaded_rows(struct viewer_data *vd)
+{
+	XImage *src;
+	XRectangle area;
+	float zoom;
+	unsigned long top, bottom;
+	int ox, oy, width, height, y0, y1, margin;
+	
+	pthread_mutex_lock(&vd->dmg_mutex);
+	top = vd->dmg_top;
+	bottom = vd->dmg_bottom;
+	vd->dmg_top = vd->dmg_bottom = 0;
+	pthread_mutex_unlock(&vd->dmg_mutex);
+	if(bottom <= top) return;
+	
+	src = get_blit_source(vd, &zoom, &ox, &oy);
+	width = (int)(src->width * zoom) - ox;
+	height = (int)(src->height * zoom) - oy;
+	clip_to_back_buffer(vd, &width, &height);
+	
+	/* interpolation and sample averaging read rows below the one
+	 * sampled at, so rows just above the new ones need updating too */
+	margin = (zoom < 1.0) ? ((int)(1.0 / zoom) + 1) : 1;
+	y0 = floorf(((float)top - margin) * zoom) - oy;
+	y1 = ceilf((float)bottom * zoom) - oy + 1;
+	if(y0 < 0) y0 = 0;
+	if(y1 > height) y1 = height;
+	if(y1 <= y0 || width <= 0) return;
+	
+	if(draw_back_buffer_rect(vd, src, zoom, ox, oy, width, height,
+		0, y0, width, y1 - y0, &area)) {
+		put_back_buffer_rect(vd, &area);
+	} else {
+		update_back_buffer(vd);
+		redraw_view(vd, False);
+	}
 }
 
 /*
- * Build file info summary and put it in the status area
+ * Put 'area' of the back-buffer to the view
  */
-static void display_status_summary(struct viewer_data *vd)
+static void put_back_buffer_rect(struct viewer_data *vd,
+	const XRectangle *area)
 {
-	char *buffer;
-	size_t len;
-	struct tm *time;
-	char size_str[SIZE_CS_MAX];
-	const char fmt_string[]="%s, %s, %d-%.2d-%.2d %.2d:%.2d";
-	XmString xm_str;
-	Arg arg[1];
+	Dimension view_width, view_height;
+	int img_width, img_height;
+	int dest_x, dest_y;
 	
-	if(vd->state&ISF_OPENED){
-		get_size_string(vd->file_size, size_str);
+	XtVaGetValues(vd->wview, XmNwidth, &view_width,
+		XmNheight, &view_height, NULL);
+	compute_image_dimensions(vd, vd->zoom, vd->tform,
+		&img_width, &img_height);
+
+	/* centered as in expose_cb */
+	dest_x = (view_width > img_width) ? ((view_width - img_width) / 2) : 0;
+	dest_y = (view_height > img_height) ? ((view_height - img_height) / 2) : 0;
+
+	if(vd->bkpix) {
+		XPutImage(app_inst.display, vd->bkpix, vd->blit_gc, vd->bkbuf,
+			area->x, area->y, area->x, area->y, area->width, area->height);
+		XCopyArea(app_inst.display, vd->bkpix, XtWindow(vd->wview),
+			vd->blit_gc, area->x, area->y, area->width, area->height,
+			dest_x + area->x, dest_y + area->y);
+	} else {
+		XPutImage(app_inst.display, XtWindow(vd->wview), vd->blit_gc,
+			vd->bkbuf, area->x, area->y, dest_x + area->x,
+			dest_y + area->y, area->width, area->height);
+	}
+	XFlush(app_inst.display);
+}
 
-		time=localtime(&vd->img_file.cr_time);
-		
-		len = snprintf(NULL, 0, fmt_string, vd->img_file.type_str,
-			size_str, time->tm_year + 1900, time->tm_mon + 1,
-			time->tm_mday + 1, time->tm_hour, time->tm_min) + 1;
+/*
+ * (Re)create the back-buffer pixmap to match back-buffer dimensions.
+ * Exposures are served from the back-buffer XImage if that fails.
+ */
+static void alloc_back_pixmap(struct viewer_data *vd)
+{
+	int (*prev_handler)(Display*, XErrorEvent*);
 
-		buffer = malloc(len);
+	if(vd->srv_dest) {
+		xrb_free_dest(app_inst.display, vd->srv_dest);
+		vd->srv_dest = None;
+	}
+	if(vd->bkpix) XFreePixmap(app_inst.display, vd->bkpix);
 	
-		snprintf(buffer, len, fmt_string, vd->img_file.type_str,
-			size_str, time->tm_year + 1900, time->tm_mon + 1,
-			time->tm_mday + 1, time->tm_hour, time->tm_min);
-			
-		xm_str=XmStringCreateLocalized(buffer);
-		XtSetArg(arg[0],XmNlabelString,xm_str);
-		XtSetValues(vd->wmsg,arg,1);
-		XmStringFree(xm_str);
-		free(buffer);
-		XmUpdateDisplay(vd->wprops);
-	}else{
-		update_page_msg(vd);
-		set_status_msg(vd,SID_READY,"Ready");
+	/* BadAlloc would arrive asynchronously and be fatal otherwise */
+	XSync(app_inst.display, False);
+	pixmap_failed = False;
+	prev_handler = XSetErrorHandler(pixmap_error_handler);
+	vd->bkpix = XCreatePixmap(app_inst.display, XtWindow(vd->wview),
+		vd->bkbuf->width, vd->bkbuf->height, app_inst.visual_info.depth);
+	XSync(app_inst.display, False);
+	XSetErrorHandler(prev_handler);
+	if(pixmap_failed) vd->bkpix = None;
+	vd->bkpix_dirty = True;
+	
+	/* server side scaling draws into the pixmap */
+	if(vd->srv_enabled && vd->bkpix) {
+		vd->srv_dest = xrb_create_dest(app_inst.display,
+			vd->bkpix, app_inst.visual_info.visual);
 	}
+	if(!vd->srv_dest) vd->srv_enabled = False;
+}
+
+static int pixmap_error_handler(Display *dpy, XErrorEvent *evt)
+{
+	pixmap_failed = True;
+	return 0;
 }
 
 /*
- * Update the properties status area
+ * Bring the top-left 'width' x 'height' portion of the back-buffer
+ * pixmap up to date, if the view has changed since.
  */
-static void update_props_msg(struct viewer_data *vd)
+static void update_back_pixmap(struct viewer_data *vd,
+	int width, int height)
 {
-	/* NxN - N BPP*/
-	char props_str[32];
-	XmString xm_str;
-	Arg arg[1];
-
-	if(vd->state&ISF_OPENED){
-		snprintf(props_str,30,"%ldx%ld, %hd BPP",vd->img_file.width,
-			vd->img_file.height,vd->img_file.orig_bpp);
-	}else{
-		strncpy(props_str,nlstr(APP_MSGSET,SID_NOIMAGE,"No image"),30);
+	if(!vd->bkpix_dirty) return;
+	
+	if(use_server_scaling(vd)) {
+		draw_server_scaled(vd, 0, 0, width, height, 0, 0);
+	} else {
+		XPutImage(app_inst.display, vd->bkpix, vd->blit_gc, vd->bkbuf,
+			0, 0, 0, 0, width, height);
 	}
-	xm_str=XmStringCreateLocalized(props_str);
-	XtSetArg(arg[0],XmNlabelString,xm_str);
-	XtSetValues(vd->wprops,arg,1);
-	XmUpdateDisplay(vd->wprops);
-	XmStringFree(xm_str);
+	vd->bkpix_dirty = False;
 }
 
 /*
- * Show the current zoom value and the page number in the status area
+ * Clip 'width' and 'height' of an area in image orientation
+ * to the back-buffer.
  */
-static void update_page_msg(struct viewer_data *vd)
+static void clip_to_back_buffer(struct viewer_data *vd,
+	int *width, int *height)
 {
-	XmString xmstr;
-	Arg arg[1];
-	/* D.F% (N/N) */
-	char zoom_str[32];
+	unsigned short tform = view_tform(vd);
 	
-	if(vd->img_file.npages>1){
-		snprintf(zoom_str,sizeof(zoom_str),"%.0f%% (%d/%d)",
-			(vd->zoom*100),vd->cur_page+1,vd->img_file.npages);
-	}else{
-		snprintf(zoom_str,sizeof(zoom_str),"%.0f%%",(vd->zoom*100));
+	if(tform & IMGT_ROTATE) {
+		if(*width > vd->bkbuf->height) *width = vd->bkbuf->height;
+		if(*height > vd->bkbuf->width) *height = vd->bkbuf->width;
+	} else {
+		if(*width > vd->bkbuf->width) *width = vd->bkbuf->width;
+		if(*height > vd->bkbuf->height) *height = vd->bkbuf->height;
 	}
-	xmstr=XmStringCreateLocalized(zoom_str);
-	XtSetArg(arg[0],XmNlabelString,xmstr);
-	XtSetValues(vd->wzoom,arg,1);
-	XmStringFree(xmstr);
-	XmUpdateDisplay(vd->wzoom);
 }
 
 /*
- * Update input widgets to reflect the current viewer state
+ * Draw a rectangle of the back-buffer given in image orientation, relative
+ * to the scaled origin 'ox', 'oy' of a 'width' x 'height' drawn area.
+ * If 'area' isn't NULL, it's set to the back-buffer rectangle drawn.
+ * Returns False if there's not enough memory for it.
  */
-static void update_controls(struct viewer_data *vd)
+static Boolean draw_back_buffer_rect(struct viewer_data *vd,
+	XImage *src, float zoom, int ox, int oy, int width, int height,
+	int x, int y, int rect_width, int rect_height, XRectangle *area)
 {
-	Boolean ready=((vd->state&ISF_READY)!=0);
+	XImage rect;
+	char *data;
+	unsigned short tform = view_tform(vd);
+	Boolean rotate = (tform & IMGT_ROTATE) ? True : False;
+	Boolean vflip = ((tform & IMGT_VFLIP) ? True : False) ^ rotate;
+	int dx, dy;
 	
-	if(vd->state&DSF_READING){
-		XtSetSensitive(vd->wmenubar,False);
-		if(vd->show_tbr) XtSetSensitive(vd->wtoolbar,False);
-		return;
-	}else{
-		XtSetSensitive(vd->wmenubar,True);
-		if(vd->show_tbr) XtSetSensitive(vd->wtoolbar,True);
+	/* position in the back-buffer */
+	dx = (tform & IMGT_HFLIP) ? (width - x - rect_width) : x;
+	dy = vflip ? (height - y - rect_height) : y;
+	if(area) {
+		area->x = rotate ? dy : dx;
+		area->y = rotate ? dx : dy;
+		area->width = rotate ? rect_height : rect_width;
+		area->height = rotate ? rect_width : rect_height;
+	}
+
+	if((vd->state & ISF_READY) && tlc_enabled(&vd->tiles)) {
+		return draw_tiles(vd, src, zoom, ox, oy, width, height,
+			x, y, rect_width, rect_height);
 	}
 	
-	XtSetSensitive(get_menu_item(vd,"*zoomMenu"),ready);
-	XtSetSensitive(get_menu_item(vd,"*editMenu"),ready);
-	XtSetSensitive(get_menu_item(vd,"*refresh"),ready);
-	XtSetSensitive(get_menu_item(vd,"*editMenu"),ready);
-	XtSetSensitive(get_menu_item(vd,"*rotateMenu"),ready);
+	data = malloc(rect_width * rect_height * (app_inst.pixel_size / 8));
+	if(!data) return False;
+	if(dec_init_image(&rect, rotate ? rect_height : rect_width,
+		rotate ? rect_width : rect_height, data)) {
+		free(data);
+		return False;
+	}
+	img_blt_scaled(src, ox + x, oy + y, rect_width, rect_height,
+		&rect, zoom, tform, get_blit_flags(vd));
+	
+	if(rotate) {
+		img_copy_rect(&rect, 0, 0, rect.width, rect.height,
+			vd->bkbuf, dy, dx);
+	} else {
+		img_copy_rect(&rect, 0, 0, rect.width, rect.height,
+			vd->bkbuf, dx, dy);
+	}
+	free(data);
+	return True;
+}
 
-	XtSetSensitive(get_menu_item(vd,"*browseHere"),(vd->file_name!=NULL));
+/*
+ * Compose a rectangle of the back-buffer, specified as for
+ * draw_back_buffer_rect, from cached tiles, rendering missing ones.
+ * Returns False if there's not enough memory for a tile.
+ */
+static Boolean draw_tiles(struct viewer_data *vd,
+	XImage *src, float zoom, int ox, int oy, int width, int height,
+	int x, int y, int rect_width, int rect_height)
+{
+	struct tlc_key key;
+	unsigned short tform = view_tform(vd);
+	Boolean rotate = (tform & IMGT_ROTATE) ? True : False;
+	Boolean hflip = (tform & IMGT_HFLIP) ? True : False;
+	Boolean vflip = ((tform & IMGT_VFLIP) ? True : False) ^ rotate;
+	int src_width = src->width * zoom;
+	int src_height = src->height * zoom;
+	int x0 = ox + x, y0 = oy + y; /* in scaled source coordinates */
+	int x1 = x0 + rect_width, y1 = y0 + rect_height;
+	unsigned int tx, ty;
 	
-	XtSetSensitive(get_menu_item(vd,"*nextFile"),
-		(vd->dir_name || vd->file_name));
-	XtSetSensitive(get_menu_item(vd,"*previousFile"),
-		(vd->dir_name || vd->file_name));
+	key.src = src;
+	key.zoom = zoom;
+	key.tform = tform;
+	key.flags = get_blit_flags(vd);
+
+	for(ty = y0 / TLC_TILE_SIZE; ty * TLC_TILE_SIZE < y1; ty++) {
+		for(tx = x0 / TLC_TILE_SIZE; tx * TLC_TILE_SIZE < x1; tx++) {
+			XImage *tile;
+			Boolean cached;
+			int tile_x = tx * TLC_TILE_SIZE;
+			int tile_y = ty * TLC_TILE_SIZE;
+			int tw = src_width - tile_x;
+			int th = src_height - tile_y;
+			int ix, iy, iw, ih; /* intersection with the rectangle */
+			int tu, tv, bu, bv;
+			
+			if(tw > TLC_TILE_SIZE) tw = TLC_TILE_SIZE;
+			if(th > TLC_TILE_SIZE) th = TLC_TILE_SIZE;
+			ix = (x0 > tile_x) ? x0 : tile_x;
+			iy = (y0 > tile_y) ? y0 : tile_y;
+			iw = ((x1 < tile_x + tw) ? x1 : (tile_x + tw)) - ix;
+			ih = ((y1 < tile_y + th) ? y1 : (tile_y + th)) - iy;
+			if(iw <= 0 || ih <= 0) continue;
+			
+			key.x = tx;
+			key.y = ty;
+			tile = NULL;
+			if(vd->draft) {
+				/* use refined tiles if there are any */
+				key.flags |= BLTF_INTERPOLATE;
+				tile = tlc_get(&vd->tiles, &key);
+				key.flags &= ~BLTF_INTERPOLATE;
+			}
+			if(!tile) tile = tlc_get(&vd->tiles, &key);
+			cached = (tile != NULL);
+			if(!tile) {
+				tile = create_display_image(rotate ? th : tw,
+					rotate ? tw : th);
+				if(!tile) return False;
+				/* tiles may reach past the back-buffer */
+				if(src == vd->image) {
+					map_level_rows(vd, tile_y / zoom,
+						ceilf((tile_y + th) / zoom) + 2);
+				}
+				img_blt_scaled(src, tile_x, tile_y, tw, th,
+					tile, zoom, tform, key.flags);
+			}
+			
+			/* flipped within the tile and the drawn area alike */
+			tu = hflip ? (tile_x + tw - ix - iw) : (ix - tile_x);
+			tv = vflip ? (tile_y + th - iy - ih) : (iy - tile_y);
+			bu = hflip ? (width - (ix - ox) - iw) : (ix - ox);
+			bv = vflip ? (height - (iy - oy) - ih) : (iy - oy);
+			if(rotate)
+				img_copy_rect(tile, tv, tu, ih, iw, vd->bkbuf, bv, bu);
+			else
+				img_copy_rect(tile, tu, tv, iw, ih, vd->bkbuf, bu, bv);
+			
+			if(!cached) tlc_put(&vd->tiles, &key, tile);
+		}
+	}
+	return True;
+}
 
-	XtSetSensitive(get_menu_item(vd,"*nextPage"),
-		(ready && vd->img_file.npages &&
-		vd->cur_page+1<vd->img_file.npages));
-	XtSetSensitive(get_menu_item(vd,"*previousPage"),
-		(ready && vd->img_file.npages && vd->cur_page!=0));
+/*
+ * Returns the image (or a reduced copy of it) to draw the back-buffer from,
+ * and sets 'zoom' to the scale it's drawn at, and 'ox', 'oy' to the scaled
+ * source coordinates (in image orientation) of the back-buffer's origin.
+ */
+static XImage* get_blit_source(struct viewer_data *vd,
+	float *zoom, int *ox, int *oy)
+{
+	XImage *src = vd->image;
+	unsigned short tform = view_tform(vd);
+	int sx, sy;
 	
-	XtSetSensitive(get_menu_item(vd,"*zoomIn"),True);
-	XtSetSensitive(get_menu_item(vd,"*zoomOut"),True);
-	XtSetSensitive(get_menu_item(vd,"*edit"),(ready && init_app_res.edit_cmd));
-	XtSetSensitive(get_menu_item(vd,"*passTo"), ready);
+	*zoom = vd->zoom;
+	if(vd->reduced) *zoom *= (float)src->width / vd->full_width;
+
+	/* Sample averaging reads 1/zoom^2 source pixels per pixel drawn,
+	 * so decimate from the nearest reduced copy instead. */
+	if(init_app_res.int_down && *zoom < 0.5 &&
+		app_inst.visual_info.class == TrueColor) {
+		src = get_mip_level(vd, zoom);
+	}
 
-	XmUpdateDisplay(vd->wmenubar);
+	/* Offsets are screen/window coordinates, so we need to flip them
+	 * according to the image rotation flag for blitting. */
+	if(tform & IMGT_ROTATE) {
+		sx = fabs((float)vd->yoff / *zoom);
+		sy = fabs((float)vd->xoff / *zoom);
+	} else {
+		sx = fabs((float)vd->xoff / *zoom);
+		sy = fabs((float)vd->yoff / *zoom);
+	}
+	if(sx > src->width) sx = src->width;
+	if(sy > src->height) sy = src->height;
 
-	if(vd->show_tbr){
-		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*browseHere"),
-			(vd->file_name!=NULL));
-		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*zoomIn"),ready);
-		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*zoomOut"),ready);
-		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*zoomNone"),ready);
-		XtSetSensitive(get_toolbar_item(vd->wtoolbar,
-			"*flipHorizontally"),ready);
-		XtSetSensitive(get_toolbar_item(vd->wtoolbar,
-			"*flipVertically"),ready);
-		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*rotateLeft"),ready);
-		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*rotateRight"),ready);
-		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*nextFile"),
-			(vd->dir_name || vd->file_name));
-		XtSetSensitive(get_toolbar_item(vd->wtoolbar,"*previousFile"),
-			(vd->dir_name || vd->file_name));
+	*ox = ceilf((float)sx * *zoom);
+	*oy = ceilf((float)sy * *zoom);
 	
-		XmUpdateDisplay(vd->wtoolbar);
+	/* rows the back-buffer is drawn from, and the one below them
+	 * interpolation reads; reduced copies are made of the whole image */
+	if(src == vd->image) {
+		unsigned int rows = (tform & IMGT_ROTATE) ?
+			vd->bkbuf->width : vd->bkbuf->height;
+		
+		map_level_rows(vd, sy, sy + ceilf((float)rows / *zoom) + 2);
 	}
+	return src;
 }
 
 /*
- * Set the pointer shape to indicate if panning is possible
+ * Returns BLTF_* flags for drawing the back-buffer
  */
-static void update_pointer_shape(struct viewer_data *vd)
+static short get_blit_flags(struct viewer_data *vd)
 {
-	Dimension view_width,view_height;
-	int img_width,img_height;
-	Arg arg[]={{XmNwidth,(XtArgVal)&view_width},
-		{XmNheight,(XtArgVal)&view_height}};
+	short flags = (init_app_res.int_up ? BLTF_INT_UP : 0) |
+		(init_app_res.int_down ? BLTF_INT_DOWN : 0);
 	
-	if(vd->state&ISF_READY){
-		XtGetValues(vd->wview,arg,2);
-		compute_image_dimensions(vd,vd->zoom,vd->tform,
-			&img_width,&img_height);
-		if(img_width>view_width || img_height>view_height)
-			set_widget_cursor(vd->wview,CUR_GRAB);
-		else
-			set_widget_cursor(vd->wview,CUR_POINTER);
-	}else{
-		set_widget_cursor(vd->wview,CUR_POINTER);
+	if(vd->draft || (init_app_res.fast_pan && vd->panning)) {
+		flags &= ~(BLTF_INT_UP|BLTF_INT_DOWN);
 	}
+	return flags;
 }
 
-
 /*
- * Update the zoom value, recompute offsets and redraw the view.
+ * Returns the reduced copy of the image nearest to (not smaller than)
+ * 'zoom', building missing levels as necessary, and adjusts 'zoom'
+ * accordingly. Returns vd->image if the image isn't completely loaded,
+ * or the memory for a level couldn't be allocated.
  */
-static void zoom_view(struct viewer_data *vd, float zoom)
+static XImage* get_mip_level(struct viewer_data *vd, float *zoom)
 {
-	Boolean erase;
-	int iw, ih, ipw, iph;
-	int xoff=vd->xoff, yoff=vd->yoff;
-	float min_zoom;
-	float nx, ny;
-
-	/* compute the minimum zoom value */
-	min_zoom = ((vd->image->width > vd->image->height) ?
-		((float)MIN_ZOOMED_SIZE / vd->image->width) :
-		((float)MIN_ZOOMED_SIZE / vd->image->height));
-	if(min_zoom > 1.0) min_zoom = 1.0;
-
-	/* reenable controls if we're out of the min/max zone */
-	if(vd->zoom==MAX_ZOOM){
-		XtSetSensitive(get_menu_item(vd,"*zoomIn"),True);
-		if(vd->show_tbr) XtSetSensitive(
-			get_toolbar_item(vd->wtoolbar,"*zoomIn"),True);
-	}else if(vd->zoom==min_zoom){
-		XtSetSensitive(get_menu_item(vd,"*zoomOut"),True);
-		if(vd->show_tbr) XtSetSensitive(
-			get_toolbar_item(vd->wtoolbar,"*zoomOut"),True);
-	}
-		
-	/* clamp the zoom value */
-	if(zoom<=min_zoom){
-		zoom=min_zoom;
-		XtSetSensitive(get_menu_item(vd,"*zoomOut"),False);
-		if(vd->show_tbr) XtSetSensitive(
-			get_toolbar_item(vd->wtoolbar,"*zoomOut"),False);
-	}else if(zoom>=MAX_ZOOM){
-		zoom=MAX_ZOOM;
-		XtSetSensitive(get_menu_item(vd,"*zoomIn"),False);
-		if(vd->show_tbr) XtSetSensitive(
-			get_toolbar_item(vd->wtoolbar,"*zoomIn"),False);
-	}
+	XImage *src = vd->image;
+	unsigned int i;
 	
-	/* figure out how to distribute offsets for the new image size */
-	compute_image_dimensions(vd,vd->zoom,vd->tform,&ipw,&iph);
-	compute_image_dimensions(vd,zoom,vd->tform,&iw,&ih);
-	nx=(float)(ipw-vd->bkbuf->width)/(xoff?xoff:1);
-	ny=(float)(iph-vd->bkbuf->height)/(yoff?yoff:1);
-
-	if(zoom>vd->zoom){
-		/* we want to zoom centered if the image was previously
-		 * smaller than the viewport */
-		if(ipw<=vd->bkbuf->width && iw>vd->bkbuf->width)
-			xoff-=(iw-vd->bkbuf->width)/2;
-		else if(xoff) xoff-=fabs((float)(ipw-iw)/nx);
-
-		if(iph<=vd->bkbuf->height && ih>vd->bkbuf->height)
-			yoff-=(ih-vd->bkbuf->height)/2;
-		else if(yoff) yoff-=fabs((float)(iph-ih)/ny);
+	if(!(vd->state & ISF_READY)) return src;
+	
+	for(i = 0; i < MAX_MIP_LEVELS && *zoom < 0.5; i++) {
+		if(src->width < 2 || src->height < 2) break;
 
-		erase=False;
-	}else{
-		if(xoff) xoff+=fabs((float)(ipw-iw)/nx);
-		if(yoff) yoff+=fabs((float)(iph-ih)/ny);
-		erase=True;
+		if(i == vd->mip_nlevels) {
+			XImage *level;
+			
+			if(!i) map_level_rows(vd, 0, vd->image->height);
+			level = create_display_image((src->width + 1) / 2,
+				(src->height + 1) / 2);
+			if(!level) break;
+			img_halve(src, level);
+			vd->mip_levels[vd->mip_nlevels++] = level;
+		}
+		src = vd->mip_levels[i];
+		*zoom *= 2;
 	}
+	return src;
+}
 
-	/* clamp and store offsets */
-	vd->xoff=(xoff<0)?xoff:0;
-	vd->yoff=(yoff<0)?yoff:0;
-
-	/* store the zoom value and update visuals */
-	vd->zoom=zoom;
-	update_page_msg(vd);
-	update_back_buffer(vd);
-	redraw_view(vd,erase);
-	update_pointer_shape(vd);
+/*
+ * Free reduced copies of the image and tiles rendered from it.
+ * Must be called whenever vd->image is replaced or released.
+ */
+static void free_derived_images(struct viewer_data *vd)
+{
+	tlc_purge(&vd->tiles);
+	for( ; vd->mip_nlevels; vd->mip_nlevels--)
+		XDestroyImage(vd->mip_levels[vd->mip_nlevels-1]);
+	xrb_free(app_inst.display, &vd->srv_src);
+	vd->srv_failed = False;
 }
 
 /*
- * Compute offsets according to new transform flags and redraw
+ * Returns True if the view is to be drawn by the server. The image is
+ * uploaded once it's completely loaded; if that fails, drawing falls
+ * back to the back-buffer until the image is replaced. Images with
+ * adjustable levels are always drawn through the back-buffer, since
+ * each adjustment would otherwise remap and upload the whole image.
  */
-static void rotate_view(struct viewer_data *vd, Boolean cw)
+static Boolean use_server_scaling(struct viewer_data *vd)
 {
-	float xoff=vd->xoff;
-	float yoff=vd->yoff;
-	unsigned int tform=vd->tform;
-	unsigned int rotation=0;
+	XImage *image = vd->image;
+	int res;
 	
-	/* The blitter doesn't do per-pixel transforms, because this is not
-	 * really needed, instead it uses 90 deg cw rotation + flipping to
-	 * simulate transformations. This part figures out the flag combination. */
-	if(tform&IMGT_ROTATE){
-		if(tform&IMGT_VFLIP)
-			rotation=270;
-		else
-			rotation=90;
-	}else{
-		if(tform&IMGT_VFLIP) rotation=180;
+	if(!vd->srv_enabled || vd->srv_failed || vd->wide ||
+		!(vd->state & ISF_READY)) return False;
+	if(vd->srv_src.picture) return True;
+
+	/* the server needs it in display format */
+	if(IMG_IS_COMPACT(vd->image)) {
+		image = create_display_image(vd->image->width, vd->image->height);
+		if(!image) {
+			vd->srv_failed = True;
+			return False;
+		}
+		img_blt(vd->image, 0, 0, image->width, image->height,
+			image, 1.0, 0, 0);
 	}
-	if(cw) rotation+=90; else rotation-=90;
-
-	switch(rotation){
-		case 90: tform=IMGT_ROTATE; break;
-		case 180: tform=IMGT_VFLIP|IMGT_HFLIP; break;
-		case -90:
-		case 270: tform=IMGT_ROTATE|IMGT_VFLIP|IMGT_HFLIP; break;
-		case 0:
-		case 360: tform=0; break;
-	};
-	
-	/* adjust the offsets if image orientation has changed */
-	if((tform&IMGT_ROTATE && !(vd->tform&IMGT_ROTATE))||
-		(!(tform&IMGT_ROTATE) && vd->tform&IMGT_ROTATE))
-	{
-		Dimension vw, vh;
-		int iw, ih;
-		float vpc=0;
-		float hpc=0;
-		
-		XtVaGetValues(vd->wview,XmNwidth,&vw,XmNheight,&vh,NULL);
-		compute_image_dimensions(vd,vd->zoom,vd->tform,&iw,&ih);
-		
-		if(vw<iw) hpc=(float)fabs(xoff)/(iw-vw);
-		if(vh<ih) vpc=(float)fabs(yoff)/(ih-vh);
+	res = xrb_upload(app_inst.display, XtWindow(vd->wview), vd->blit_gc,
+		app_inst.visual_info.visual, image, &vd->srv_src);
+	if(image != vd->image) XDestroyImage(image);
 	
-		compute_image_dimensions(vd,vd->zoom,tform,&iw,&ih);
-		
-		if(vw<iw) xoff= -((iw-vw)*hpc); else xoff=0;
-		if(vh<ih) yoff= -((ih-vh)*vpc); else yoff=0;
-	}
-
-	vd->tform=tform;
-	if(vd->zoom_fit){
-		zoom_view(vd,compute_fit_zoom(vd));
-	}else{
-		vd->xoff=(short)xoff;
-		vd->yoff=(short)yoff;
+	if(res) {
+		vd->srv_failed = True;
+		return False;
 	}
-	update_pointer_shape(vd);
-	update_back_buffer(vd);
-	redraw_view(vd,True);
+	return True;
 }
 
 /*
- * Scroll image. x,y specify offsets relative to the current scroll position.
+ * Draw a 'width' x 'height' rectangle at 'x', 'y' of the image, as
+ * displayed in the view, to the view window at 'dest_x', 'dest_y'.
+ * Filters apply as for the back-buffer, except that drafts are not
+ * necessary, since the server is fast enough to filter all the time.
  */
-static void scroll_view(struct viewer_data *vd, int x, int y)
+static void draw_server_scaled(struct viewer_data *vd, int x, int y,
+	int width, int height, int dest_x, int dest_y)
 {
-	int iw,ih;
-	int xmax, ymax;
-	float xoff=vd->xoff, yoff=vd->yoff;
-	unsigned short tform=vd->tform^vd->img_file.tform;
+	float zoom = vd->zoom;
+	short flags = (init_app_res.int_up ? BLTF_INT_UP : 0) |
+		(init_app_res.int_down ? BLTF_INT_DOWN : 0);
 	
-	if(tform&IMGT_ROTATE){
-		if(!(tform&IMGT_VFLIP)) x=(-x);
-		if(tform&IMGT_HFLIP) y=(-y);
-	}else{
-		if(tform&IMGT_HFLIP) x=(-x);
-		if(tform&IMGT_VFLIP) y=(-y);
-	}	
-	/* compute and clamp scroll offsets */
-	compute_image_dimensions(vd,vd->zoom,vd->tform,&iw,&ih);
-	xmax= -(iw-vd->bkbuf->width);
-	ymax= -(ih-vd->bkbuf->height);
-	if(xmax<0){
-		if(xoff+x < xmax) x-=(xoff+x)-xmax;
-		else if(xoff+x > 0)	x-=xoff+x;
-	}else x=0;
-	if(ymax<0){
-		if(yoff+y < ymax) y-=(yoff+y)-ymax;
-		else if(yoff+y > 0)	y-=yoff+y;
-	}else y=0;
+	if(vd->reduced) zoom *= (float)vd->image->width / vd->full_width;
 	
-	if(!x && !y) return;
-
-	/* store the offsets and sync the image */
-	vd->xoff += x;
-	vd->yoff += y;
-
-	update_back_buffer(vd);
-	redraw_view(vd,False);
+	/* offsets are negative, in view coordinates */
+	xrb_blt_scaled(app_inst.display, &vd->srv_src, x - vd->xoff,
+		y - vd->yoff, width, height, vd->srv_dest, dest_x, dest_y,
+		zoom, view_tform(vd), flags);
 }
 
 /*
- * Update the back-buffer
+ * Create a zero filled XImage in display format.
+ * Returns NULL on failure.
  */
-static void update_back_buffer(struct viewer_data *vd)
+static XImage* create_display_image(unsigned int width, unsigned int height)
 {
-	int sx, sy, sw, sh;
-	unsigned short tform = vd->tform ^ vd->img_file.tform;
-	unsigned short intp = (init_app_res.int_up ? BLTF_INT_UP : 0) |
-		(init_app_res.int_down ? BLTF_INT_DOWN : 0);
+	XImage *img;
 	
-	if(init_app_res.fast_pan && vd->panning) {
-		intp &= ~(BLTF_INT_UP|BLTF_INT_DOWN);
-	}
-
-	/* Offsets are screen/window coordinates, so we need to flip them
-	 * according to the image rotation flag for blitting. */
-	if(tform & IMGT_ROTATE) {
-		sx = fabs((float)vd->yoff / vd->zoom);
-		sy = fabs((float)vd->xoff / vd->zoom);
-	} else {
-		sx = fabs((float)vd->xoff / vd->zoom);
-		sy = fabs((float)vd->yoff / vd->zoom);
+	img = XCreateImage(app_inst.display, app_inst.visual_info.visual,
+		app_inst.visual_info.depth, ZPixmap, 0, NULL, width, height,
+		app_inst.pixel_size, 0);
+	if(!img) return NULL;
+	img->bitmap_bit_order = img->byte_order =
+		(is_big_endian()) ? MSBFirst : LSBFirst;
+	_XInitImageFuncPtrs(img);
+	if(ims_alloc_data(img)) {
+		XDestroyImage(img);
+		return NULL;
 	}
-
-	sw = vd->image->width - sx;
-	sh = vd->image->height - sy;
-	if(sw && sh) img_blt(vd->image, sx, sy, sw, sh,
-		vd->bkbuf, vd->zoom, tform, intp);
+	return img;
 }
 
 
@@ -1617,6 +4128,7 @@ static void redraw_view(struct viewer_data *vd, Boolean clear)
 	int iw, ih;
 	
 	compute_image_dimensions(vd,vd->zoom,vd->tform,&iw,&ih);
+	vd->bkpix_dirty=True;
 
 	/* only clear it if the image is smaller than the view area */
 	if((vd->bkbuf->width>iw || vd->bkbuf->height>ih) && clear){
@@ -1677,11 +4189,15 @@ static void resize_cb(Widget w, XtPointer client_data, XtPointer call_data)
 	}
 	
 	/* update and re-initialize the back-buffer XImage parameters */
-	vd->bkbuf->width = vw;
-	vd->bkbuf->height = vh;
-	vd->bkbuf->bytes_per_line = 0;
-	XInitImage(vd->bkbuf);
+	if(vd->bkbuf->width != vw || vd->bkbuf->height != vh) {
+		vd->bkbuf->width = vw;
+		vd->bkbuf->height = vh;
+		vd->bkbuf->bytes_per_line = 0;
+		XInitImage(vd->bkbuf);
+		alloc_back_pixmap(vd);
+	}
 	img_fill_rect(vd->bkbuf, 0, 0, vw, vh, vd->bg_pixel);
+	vd->bkpix_dirty = True;
 
 	if( !(vd->state & (ISF_LOADING|ISF_READY)) ) return;
 
@@ -1702,8 +4218,7 @@ static void resize_cb(Widget w, XtPointer client_data, XtPointer call_data)
 
 	update_page_msg(vd);
 	update_pointer_shape(vd);
-	update_back_buffer(vd);
-	redraw_view(vd,True);
+	request_render(vd,RF_UPDATE|RF_CLEAR);
 }
 
 /*
@@ -1717,6 +4232,7 @@ static void expose_cb(Widget w, XtPointer client_data, XtPointer call_data)
 	Dimension view_width,view_height;
 	int dest_x,dest_y;
 	int src_x,src_y,img_width,img_height;
+	int full_width,full_height;
 	Arg arg[]={{XmNwidth,(XtArgVal)&view_width},
 		{XmNheight,(XtArgVal)&view_height}};
 	
@@ -1724,6 +4240,8 @@ static void expose_cb(Widget w, XtPointer client_data, XtPointer call_data)
 	
 	XtGetValues(vd->wview,arg,2);
 	compute_image_dimensions(vd,vd->zoom,vd->tform,&img_width,&img_height);
+	full_width=img_width;
+	full_height=img_height;
 
 	/* if the displayed image is smaller than the view, and therefore only
 	 * occupies a portion of the back-buffer, it is drawn centered within
@@ -1742,9 +4260,18 @@ static void expose_cb(Widget w, XtPointer client_data, XtPointer call_data)
 	img_width=(src_x+evt->width>img_width)?img_width-src_x:evt->width;
 	img_height=(src_y+evt->height>img_height)?img_height-src_y:evt->height;
 
-	/* redraw damaged portion of the image */
-	XPutImage(app_inst.display,evt->window,vd->blit_gc,vd->bkbuf,
-		src_x,src_y,dest_x+src_x,dest_y+src_y,img_width,img_height);
+	/* redraw damaged portion of the image; the pixmap only needs
+	 * updating if the view has changed, not on plain re-exposures */
+	if(vd->bkpix){
+		update_back_pixmap(vd,
+			(view_width<full_width)?view_width:full_width,
+			(view_height<full_height)?view_height:full_height);
+		XCopyArea(app_inst.display,vd->bkpix,evt->window,vd->blit_gc,
+			src_x,src_y,img_width,img_height,dest_x+src_x,dest_y+src_y);
+	}else{
+		XPutImage(app_inst.display,evt->window,vd->blit_gc,vd->bkbuf,
+			src_x,src_y,dest_x+src_x,dest_y+src_y,img_width,img_height);
+	}
 	XFlush(app_inst.display);
 }
 
@@ -1782,7 +4309,11 @@ static void input_cb(Widget w, XtPointer client_data, XtPointer call_data)
 		cx=cbs->event->xbutton.x;
 		cy=cbs->event->xbutton.y;
 		
+		/* Ctrl+MB1 adjusts levels of high bit depth images */
 		if((cbs->event->xbutton.button == Button1) &&
+			(cbs->event->xbutton.state & ControlMask) && vd->wide) {
+				vd->leveling = True;
+		} else if((cbs->event->xbutton.button == Button1) &&
 			(img_width > view_width || img_height > view_height)) {
 				set_widget_cursor(w,CUR_DRAG);
 				vd->panning = True;
@@ -1801,15 +4332,22 @@ static void input_cb(Widget w, XtPointer client_data, XtPointer call_data)
 			set_widget_cursor(w,CUR_POINTER);
 		
 		vd->panning = False;
-		if(init_app_res.fast_pan) {
-			update_back_buffer(vd);
-			redraw_view(vd,False);
-		}
+		vd->leveling = False;
+		if(init_app_res.fast_pan && needs_refinement(vd))
+			start_refinement(vd);
 		break; /* ButtonRelease */
 		
 		/* Pan on MB1 */
 		case MotionNotify:
-		if(cbs->event->xbutton.state&Button1Mask){
+		if(vd->leveling){
+			/* horizontally for window width, vertically for center */
+			set_levels(vd,vd->lv_window+
+				((signed)cbs->event->xbutton.x-cx)*LEVELS_DRAG_STEP,
+				vd->lv_level+
+				((signed)cbs->event->xbutton.y-cy)*LEVELS_DRAG_STEP);
+			cx=cbs->event->xbutton.x;
+			cy=cbs->event->xbutton.y;
+		}else if(cbs->event->xbutton.state&Button1Mask){
 			static int dx=0, dy=0;
 			/* compute pan offset deltas */
 			if(img_width>view_width)
@@ -2000,21 +4538,78 @@ static void refresh_cb(Widget w, XtPointer client, XtPointer call)
 	free(fname);
 }
 
+static void follow_cb(Widget w, XtPointer client, XtPointer call)
+{
+	struct viewer_data *vd=(struct viewer_data*)client;
+	
+	vd->follow=((XmToggleButtonCallbackStruct*)call)->set;
+	if(vd->follow && (vd->state&ISF_OPENED)){
+		start_follow(vd);
+		follow_update(vd);
+	}else{
+		stop_follow(vd);
+	}
+}
+
+static void slideshow_cb(Widget w, XtPointer client, XtPointer call)
+{
+	struct viewer_data *vd=(struct viewer_data*)client;
+	
+	if(((XmToggleButtonCallbackStruct*)call)->set)
+		start_slideshow(vd);
+	else
+		stop_slideshow(vd);
+}
+
+static void invert_levels_cb(Widget w, XtPointer client, XtPointer call)
+{
+	struct viewer_data *vd=(struct viewer_data*)client;
+	
+	vd->lv_invert=((XmToggleButtonCallbackStruct*)call)->set;
+	set_levels(vd,vd->lv_window,vd->lv_level);
+}
+
+static void gamma_up_cb(Widget w, XtPointer client, XtPointer call)
+{
+	struct viewer_data *vd=(struct viewer_data*)client;
+	
+	vd->lv_gamma*=GAMMA_STEP;
+	if(vd->lv_gamma>MAX_GAMMA) vd->lv_gamma=MAX_GAMMA;
+	set_levels(vd,vd->lv_window,vd->lv_level);
+}
+
+static void gamma_down_cb(Widget w, XtPointer client, XtPointer call)
+{
+	struct viewer_data *vd=(struct viewer_data*)client;
+	
+	vd->lv_gamma/=GAMMA_STEP;
+	if(vd->lv_gamma<MIN_GAMMA) vd->lv_gamma=MIN_GAMMA;
+	set_levels(vd,vd->lv_window,vd->lv_level);
+}
+
+static void reset_levels_cb(Widget w, XtPointer client, XtPointer call)
+{
+	struct viewer_data *vd=(struct viewer_data*)client;
+	
+	vd->lv_gamma=1.0;
+	vd->lv_invert=False;
+	XmToggleButtonGadgetSetState(
+		get_menu_item(vd,"*invertLevels"),False,False);
+	set_levels(vd,LUT_SIZE,LUT_SIZE/2);
+}
+
 static void vflip_cb(Widget w, XtPointer client, XtPointer call)
 {
 	struct viewer_data *vd=(struct viewer_data*)client;
 	vd->tform^=IMGT_VFLIP;
-	update_back_buffer(vd);
-	redraw_view(vd,False);
+	request_render(vd,RF_UPDATE);
 }
 
 static void hflip_cb(Widget w, XtPointer client, XtPointer call)
 {
 	struct viewer_data *vd=(struct viewer_data*)client;
 	vd->tform^=IMGT_HFLIP;
-	update_back_buffer(vd);
-	redraw_view(vd,False);
-	
+	request_render(vd,RF_UPDATE);
 }
 
 static void rotate_right_cb(Widget w, XtPointer client, XtPointer call)
@@ -2052,8 +4647,7 @@ static void rotate_reset_cb(Widget w, XtPointer client, XtPointer call)
 	}
 	
 	vd->tform = 0;
-	update_back_buffer(vd);
-	redraw_view(vd,True);
+	request_render(vd,RF_UPDATE|RF_CLEAR);
 }
 
 static void rotate_lock_cb(Widget w, XtPointer client, XtPointer call)
@@ -2503,6 +5097,8 @@ static void create_viewer_menubar(struct viewer_data *vd)
 	const struct menu_item view_menu[]={
 		{IT_PUSH,"viewMenu","_View",SID_VMVIEW},
 		{IT_PUSH,"refresh","_Refresh",SID_VMREFRESH,refresh_cb},
+		{IT_TOGGLE,"follow","_Follow Changes",SID_VMFOLLOW,follow_cb},
+		{IT_TOGGLE,"slideshow","_Slideshow",SID_VMSLIDESHOW,slideshow_cb},
 		{IT_SEP},
 		{IT_PUSH,"nextPage","_Next Page",SID_VMNEXTPAGE,next_page_cb},
 		{IT_PUSH,"previousPage","Pr_evious Page",SID_VMPREVPAGE,prev_page_cb},
@@ -2531,6 +5127,15 @@ static void create_viewer_menubar(struct viewer_data *vd)
 		{IT_PUSH,"rotateReset","R_eset",SID_VMRESET,rotate_reset_cb}
 	};
 
+	const struct menu_item levels_menu[]={
+		{IT_PUSH,"levelsMenu","_Levels",SID_VMLEVELS},
+		{IT_TOGGLE,"invertLevels","_Invert",SID_VMINVERT,invert_levels_cb},
+		{IT_PUSH,"gammaUp","Increase _Gamma",SID_VMGAMMAUP,gamma_up_cb},
+		{IT_PUSH,"gammaDown","Decrease G_amma",SID_VMGAMMADN,gamma_down_cb},
+		{IT_SEP},
+		{IT_PUSH,"resetLevels","_Reset",SID_VMLVRESET,reset_levels_cb}
+	};
+
 	const struct menu_item window_menu[]={
 		{IT_PUSH,"windowMenu","_Window",SID_VMWINDOW},
 		{IT_TOGGLE,"pinThis","_Pin This",SID_VMPIN,pin_window_cb},
@@ -2564,6 +5169,9 @@ static void create_viewer_menubar(struct viewer_data *vd)
 	create_pulldown(vd->wmenubar,rotate_menu,
 		(sizeof(rotate_menu)/sizeof(struct menu_item)),
 		vd,VIEWER_MENU_MSGSET,False);
+	create_pulldown(vd->wmenubar,levels_menu,
+		(sizeof(levels_menu)/sizeof(struct menu_item)),
+		vd,VIEWER_MENU_MSGSET,False);
 	create_pulldown(vd->wmenubar,window_menu,
 		(sizeof(window_menu)/sizeof(struct menu_item)),
 		vd,VIEWER_MENU_MSGSET,False);
@@ -2714,6 +5322,27 @@ Boolean display_image(Widget wshell, const char *fname,
 	return res;
 }
 
+/*
+ * Public interface to load_image, with a placeholder image
+ */
+Boolean display_image_preview(Widget wshell, const char *fname,
+	XImage *preview, unsigned long xres, unsigned long yres)
+{
+	struct viewer_data *vd;
+	Boolean res;
+
+	dassert(fname && preview);
+
+	vd=get_viewer_inst_data(wshell);
+	dassert(vd);
+	vd->preview=preview;
+	vd->preview_xres=xres;
+	vd->preview_yres=yres;
+	res = load_image(vd, fname, NULL);
+	vd->preview=NULL;
+	return res;
+}
+
 /*
  * Destroy viewer by a ToolTalk Quit request.
  */
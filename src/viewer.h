@@ -33,6 +33,14 @@ Widget get_viewer(const struct app_resources*, Tt_message req_msg);
 Boolean display_image(Widget, const char *file_name,
 	const char *force_suffix, Tt_message req_msg);
 
+/*
+ * Same as display_image, but 'preview', a downscaled copy of the image
+ * of 'xres' x 'yres' pixels in display format, is shown in its place
+ * until it's decoded. 'preview' is only used until the function returns.
+ */
+Boolean display_image_preview(Widget, const char *file_name,
+	XImage *preview, unsigned long xres, unsigned long yres);
+
 #ifdef ENABLE_CDE
 /*
  * Handle the ttmedia Quit message.
@@ -13,6 +13,7 @@
 
 #include <inttypes.h>
 #include <time.h>
+#include <signal.h>
 #include <pthread.h>
 #include <sys/stat.h>
 #include <X11/Xlib.h>
@@ -21,6 +22,23 @@
 #endif /* ENABLE_CDE */
 #include "imgfile.h"
 #include "pixconv.h"
+#include "tilecache.h"
+#include "xrblt.h"
+
+/* Decoded-ahead image */
+struct prefetch_slot {
+	char *file_name;	/* absolute file name */
+	int page;			/* page of a multi-page file */
+	time_t mod_time;	/* file status at the time it was decoded */
+	off_t file_size;
+	XImage *image;		/* NULL if not (yet) decoded */
+	unsigned long full_width;	/* image dimensions, if 'image' */
+	unsigned long full_height;	/* was scaled down, zero otherwise */
+	double decode_time;	/* seconds it took to decode */
+};
+
+/* Maximum number of reduced resolution copies kept for an image */
+#define MAX_MIP_LEVELS	12
 
 /* 
  * Viewer instance data 
@@ -50,6 +68,12 @@ struct viewer_data {
 	pthread_cond_t ldr_finished_cond;
 	pthread_mutex_t ldr_cond_mutex;
 	
+	/* rows decoded since the last visual progress update,
+	 * none if dmg_bottom <= dmg_top */
+	unsigned long dmg_top;
+	unsigned long dmg_bottom;
+	pthread_mutex_t dmg_mutex;
+	
 	/* viewer state */
 	unsigned short state; /* current state of the viewer */
 	time_t mod_time; /* file's last modified time */
@@ -57,6 +81,11 @@ struct viewer_data {
 	short load_prog;	/* progress 0-100% */
 	XtIntervalId prog_timer;
 	XtIntervalId vprog_timer;
+	XtIntervalId render_timer; /* running for RENDER_FRAME_INT after render */
+	unsigned short render_flags; /* pending RF_* requests */
+	Boolean draft; /* rendering without filtering, to be refined */
+	XtWorkProcId refine_wp; /* back-buffer refinement in progress */
+	int refine_row; /* next row to be refined, in image orientation */
 	
 	/* view properties */
 	float zoom;		/* current zoom */
@@ -74,6 +103,20 @@ struct viewer_data {
 	XImage *image;	/* the X visual compatible data of complete image */
 	XImage *bkbuf;	/* a view sized back-buffer for transformed image data */
 	size_t bkbuf_size;	/* current back-buffer memory block size */
+	XImage *mip_levels[MAX_MIP_LEVELS]; /* image reduced by 2, 4, 8... */
+	unsigned int mip_nlevels;	/* levels built so far (on demand) */
+	struct tile_cache tiles; /* rendered portions of image and its levels */
+	int bkbuf_ox; /* scaled image coordinates the back-buffer was */
+	int bkbuf_oy; /* last drawn at, see get_blit_source */
+	Pixmap bkpix; /* server side copy of the back-buffer, or None */
+	Boolean bkpix_dirty; /* back-buffer changed since it was copied */
+	
+	/* server side scaling (see use_server_scaling) */
+	Boolean srv_enabled; /* RENDER is available and the resource set */
+	Boolean srv_failed; /* the image couldn't be uploaded */
+	Boolean srv_drawn; /* the last frame bypassed the back-buffer */
+	struct xrb_source srv_src; /* the image on the server, if uploaded */
+	Picture srv_dest; /* the back-buffer pixmap */
 	
 	/* file data */
 	struct img_file img_file;	/* handle to the image loader */
@@ -91,8 +134,83 @@ struct viewer_data {
 	unsigned long dir_nfiles; /* dir_files size */
 	unsigned long dir_cur_file;
 	Boolean dir_forward;
+	Boolean dir_bkgnd; /* read for decode-ahead, not navigation */
 	struct stat dir_stat; /* current directory stat */
 	
+	/* decode-ahead (prefetch) thread data */
+	int pf_depth;	/* files to decode ahead in each direction */
+	size_t pf_mem_max; /* memory available for prefetched images */
+	struct prefetch_slot *pf_slots; /* nearest files first */
+	unsigned int pf_nslots;
+	Boolean pf_active; /* the prefetch thread is running */
+	unsigned int pf_fit_width; /* view size to scale images down to, */
+	unsigned int pf_fit_height; /* if non-zero (see fit_image) */
+	double pf_decode_time; /* that of the prefetched image displayed */
+	volatile sig_atomic_t pf_cancel;
+	pthread_t pf_thread;
+	pthread_cond_t pf_finished_cond;
+	pthread_mutex_t pf_cond_mutex;
+	
+	/* reduced resolution decoding (see reduce_resolution) */
+	Boolean reduced; /* the image was read at reduced resolution */
+	unsigned long full_width; /* full resolution image dimensions */
+	unsigned long full_height;
+	XImage *fr_image; /* full resolution image being decoded */
+	Boolean fr_active; /* the full resolution decoder thread is running */
+	Boolean fr_failed; /* and it failed, so stick to reduced resolution */
+	volatile sig_atomic_t fr_cancel;
+	pthread_t fr_thread;
+	pthread_cond_t fr_finished_cond;
+	pthread_mutex_t fr_cond_mutex;
+	
+	/* set by display_image_preview for load_image */
+	XImage *preview;
+	unsigned long preview_xres;
+	unsigned long preview_yres;
+	
+	/* high bit depth samples and levels applied to them (see apply_levels) */
+	Boolean keep_wide; /* open files with IMG_OPEN_WIDE */
+	uint16_t *wide; /* retained samples, NULL if none */
+	unsigned int wide_nchan; /* samples per pixel */
+	struct pixel_format wide_pf; /* format of samples mapped to 8 bits */
+	uint8_t *lut; /* maps sample values to 8 bits */
+	float lv_window; /* window width and center, in sample values */
+	float lv_level;
+	float lv_gamma;
+	Boolean lv_invert;
+	Boolean lv_dirty; /* levels changed since vd->lut was built */
+	unsigned long lv_top; /* rows of vd->image mapped with vd->lut */
+	unsigned long lv_bottom;
+	Boolean leveling; /* levels are being adjusted with the pointer */
+	
+	/* slideshow (see start_slideshow) */
+	Boolean ss_active;
+	unsigned long ss_interval; /* in milliseconds */
+	int ss_order; /* SSO_* */
+	XtIntervalId ss_timer;
+	unsigned long *ss_seq; /* directory indices in random order */
+	unsigned long ss_nseq;
+	unsigned int ss_seed; /* rand_r state for random order */
+	Boolean ss_pending; /* the file due hasn't been displayed yet */
+	struct timespec ss_due; /* when it was due */
+	unsigned long ss_shown; /* files displayed in time, and late */
+	unsigned long ss_missed;
+	double ss_decode_time; /* total time files displayed took to decode */
+	
+	/* live-follow mode (see start_follow) */
+	Boolean follow; /* reload the file as it's being written */
+	Boolean partial; /* the file was incomplete when it was read */
+	unsigned long rows_read; /* scanlines the last loader run got through */
+	XtIntervalId follow_timer; /* settle timer, or poll timer w/o inotify */
+	int follow_fd; /* inotify instance, -1 if none */
+	XtInputId follow_input;
+	time_t follow_mtime; /* file status at the last poll */
+	off_t follow_size;
+	
+	/* navigation coalescing */
+	XtIntervalId nav_timer; /* set while navigation requests repeat */
+	Boolean nav_pending; /* file_name is to be loaded once nav_timer expires */
+	
 	/* dialog data cache */
 	char *last_dest_dir;
 	Widget wfile_dlg;
@@ -127,6 +245,50 @@ struct viewer_data {
 /* Frame buffer update interval in ms when visual progress is enabled */
 #define LOADER_FB_UPDATE_INT 120
 
+/* Minimum interval in ms between view renders (about 60 per second) */
+#define RENDER_FRAME_INT 16
+
+/* Number of rows refined at a time while the application is idle */
+#define REFINE_BAND_SIZE 64
+
+/* viewer_data.render_flags */
+#define RF_UPDATE	0x01	/* the back-buffer needs to be drawn completely */
+#define RF_SCROLL	0x02	/* offsets changed */
+#define RF_CLEAR	0x04	/* clear the view before redrawing */
+
+/* Time in ms without further navigation requests after which
+ * the file navigated to is actually loaded */
+#define NAV_SETTLE_INT 150
+
+/* Time in ms without further writes to a followed file
+ * after which it's read again */
+#define FOLLOW_SETTLE_INT 300
+
+/* Followed file status polling interval in ms, if there's no inotify */
+#define FOLLOW_POLL_INT 1000
+
+/* Slideshow orders */
+#define SSO_NAME	0
+#define SSO_REVERSE	1
+#define SSO_RANDOM	2
+
+/* Number of files decoded ahead in slideshow order */
+#define SLIDESHOW_DEPTH 2
+
+/* Time in ms after which a slideshow file is considered late */
+#define SLIDESHOW_LATE_INT 100
+
+/* Number of distinct 16 bit sample values */
+#define LUT_SIZE 65536
+
+/* Window width/center change per pixel of pointer movement */
+#define LEVELS_DRAG_STEP 128
+
+/* Gamma factor per Increase/Decrease Gamma, and its limits */
+#define GAMMA_STEP 1.1
+#define MIN_GAMMA 0.1
+#define MAX_GAMMA 10
+
 /* Maximum scroll amount per key press (in pixels) */
 #define MAX_KEY_PAN_AMOUNT	100
 
@@ -138,12 +300,21 @@ struct loader_cb_data {
 	struct viewer_data *vd; /* the viewer */
 	struct pixel_format image_pf; /* image file pixel format */
 	unsigned char *clut; /* color lookup table (for 8 bpp images) */
+	uint8_t *row8; /* wide samples mapped to 8 bits */
 	unsigned long nscl; /* number of scanlines read */
 };
 
+/* Full resolution decoder thread data */
+struct full_res_data {
+	struct viewer_data *vd;
+	struct img_file img_file;
+	struct pixel_format image_pf;
+	unsigned char clut[IMG_CLUT_SIZE];
+};
+
 /* Thread message data */
 enum tnfd_io { TNFD_IN, TNFD_OUT };
-enum thread_proc { TP_IMG_LOAD, TP_DIR_READ };
+enum thread_proc { TP_IMG_LOAD, TP_DIR_READ, TP_FULL_RES };
 
 struct proc_thread_msg {
 	enum thread_proc proc;
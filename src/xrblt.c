@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Server side scaling. Images are uploaded once into a pixmap, and drawn
+ * with XRender picture transforms and filters, so that zooming and panning
+ * don't require scaling and transferring pixels on the client.
+ * Transforms map destination coordinates to the source, so all the
+ * geometry here is inverse of that in imgblt.c.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <X11/Xlib.h>
+#include "xrblt.h"
+#include "imgfile.h"
+#include "imgblt.h"
+#include "debug.h"
+
+#ifdef ENABLE_XRENDER
+
+/* Maximum width/height of the box filter used when decimating */
+#define MAX_KERNEL_SIZE	9
+
+/* Maximum pixmap dimensions the protocol allows */
+#define MAX_PIXMAP_SIZE	32767
+
+/* Local prototypes */
+static int alloc_error_handler(Display *dpy, XErrorEvent *evt);
+static void set_filter(Display *dpy, Picture pict, float scale, short flags);
+
+/* Set by alloc_error_handler; only accessed from the main thread */
+static Bool alloc_failed;
+
+Bool xrb_available(Display *dpy, Visual *visual)
+{
+	int event_base, error_base;
+
+	if(!XRenderQueryExtension(dpy, &event_base, &error_base))
+		return False;
+
+	return (XRenderFindVisualFormat(dpy, visual) != NULL);
+}
+
+int xrb_upload(Display *dpy, Drawable drawable, GC gc,
+	Visual *visual, XImage *img, struct xrb_source *src)
+{
+	XRenderPictFormat *fmt;
+	XRenderPictureAttributes pa;
+	int (*prev_handler)(Display*, XErrorEvent*);
+
+	if(img->width > MAX_PIXMAP_SIZE || img->height > MAX_PIXMAP_SIZE)
+		return EINVAL;
+	if(!(fmt = XRenderFindVisualFormat(dpy, visual))) return EINVAL;
+
+	/* the server may not have the memory for it, which we
+	 * wouldn't learn about until the error arrives */
+	XSync(dpy, False);
+	alloc_failed = False;
+	prev_handler = XSetErrorHandler(alloc_error_handler);
+
+	src->pixmap = XCreatePixmap(dpy, drawable,
+		img->width, img->height, img->depth);
+	XPutImage(dpy, src->pixmap, gc, img, 0, 0, 0, 0,
+		img->width, img->height);
+
+	/* pad edges, so that filtering doesn't blend them with black */
+	pa.repeat = RepeatPad;
+	src->picture = XRenderCreatePicture(dpy, src->pixmap, fmt, CPRepeat, &pa);
+	XSync(dpy, False);
+
+	if(alloc_failed) {
+		/* errors for resources never created are ignored too */
+		XRenderFreePicture(dpy, src->picture);
+		XFreePixmap(dpy, src->pixmap);
+		XSync(dpy, False);
+		XSetErrorHandler(prev_handler);
+		src->pixmap = None;
+		src->picture = None;
+		return ENOMEM;
+	}
+	XSetErrorHandler(prev_handler);
+	src->width = img->width;
+	src->height = img->height;
+	return 0;
+}
+
+void xrb_free(Display *dpy, struct xrb_source *src)
+{
+	if(src->picture) XRenderFreePicture(dpy, src->picture);
+	if(src->pixmap) XFreePixmap(dpy, src->pixmap);
+	src->picture = None;
+	src->pixmap = None;
+}
+
+Picture xrb_create_dest(Display *dpy, Drawable drawable, Visual *visual)
+{
+	XRenderPictFormat *fmt;
+
+	if(!(fmt = XRenderFindVisualFormat(dpy, visual))) return None;
+	return XRenderCreatePicture(dpy, drawable, fmt, 0, NULL);
+}
+
+void xrb_free_dest(Display *dpy, Picture pict)
+{
+	XRenderFreePicture(dpy, pict);
+}
+
+void xrb_blt_scaled(Display *dpy, struct xrb_source *src,
+	int x, int y, unsigned int width, unsigned int height,
+	Picture dest, int dx, int dy, float scale, short transfm, short flags)
+{
+	XTransform xf = {{{0}}};
+	XFixed inv = XDoubleToFixed(1.0 / scale);
+	XFixed ux, uy, tx, ty;
+	Bool vflip = (transfm & IMGT_VFLIP) ? True : False;
+
+	/* rotation swaps axes and mirrors the vertical one, see img_blt */
+	if(transfm & IMGT_ROTATE) vflip = !vflip;
+
+	ux = (transfm & IMGT_HFLIP) ? -inv : inv;
+	uy = vflip ? -inv : inv;
+	tx = (transfm & IMGT_HFLIP) ? XDoubleToFixed(src->width) : 0;
+	ty = vflip ? XDoubleToFixed(src->height) : 0;
+
+	if(transfm & IMGT_ROTATE) {
+		xf.matrix[0][1] = ux;
+		xf.matrix[1][0] = uy;
+	} else {
+		xf.matrix[0][0] = ux;
+		xf.matrix[1][1] = uy;
+	}
+	xf.matrix[0][2] = tx;
+	xf.matrix[1][2] = ty;
+	xf.matrix[2][2] = XDoubleToFixed(1.0);
+
+	XRenderSetPictureTransform(dpy, src->picture, &xf);
+	set_filter(dpy, src->picture, scale, flags);
+	XRenderComposite(dpy, PictOpSrc, src->picture, None, dest,
+		x, y, 0, 0, dx, dy, width, height);
+}
+
+/*
+ * Set the filter matching BLTF_* 'flags' at 'scale'. Decimation uses
+ * a box filter approximating sample averaging of img_blt.
+ */
+static void set_filter(Display *dpy, Picture pict, float scale, short flags)
+{
+	if(scale > 1.0 && (flags & BLTF_INT_UP)) {
+		XRenderSetPictureFilter(dpy, pict, FilterBilinear, NULL, 0);
+	} else if(scale < 1.0 && (flags & BLTF_INT_DOWN)) {
+		XFixed params[2 + MAX_KERNEL_SIZE * MAX_KERNEL_SIZE];
+		int size = (int)(1.0 / scale);
+		int i;
+
+		/* odd sized, so that it's centered on the sample */
+		if(!(size % 2)) size++;
+		if(size > MAX_KERNEL_SIZE) size = MAX_KERNEL_SIZE;
+		if(size < 3) {
+			XRenderSetPictureFilter(dpy, pict, FilterBilinear, NULL, 0);
+			return;
+		}
+		params[0] = params[1] = XDoubleToFixed(size);
+		for(i = 0; i < size * size; i++)
+			params[2 + i] = XDoubleToFixed(1.0 / (size * size));
+		XRenderSetPictureFilter(dpy, pict, FilterConvolution,
+			params, 2 + size * size);
+	} else {
+		XRenderSetPictureFilter(dpy, pict, FilterNearest, NULL, 0);
+	}
+}
+
+static int alloc_error_handler(Display *dpy, XErrorEvent *evt)
+{
+	alloc_failed = True;
+	return 0;
+}
+
+#else /* ENABLE_XRENDER */
+
+Bool xrb_available(Display *dpy, Visual *visual)
+{
+	return False;
+}
+
+int xrb_upload(Display *dpy, Drawable drawable, GC gc,
+	Visual *visual, XImage *img, struct xrb_source *src)
+{
+	return EINVAL;
+}
+
+void xrb_free(Display *dpy, struct xrb_source *src)
+{
+}
+
+Picture xrb_create_dest(Display *dpy, Drawable drawable, Visual *visual)
+{
+	return None;
+}
+
+void xrb_free_dest(Display *dpy, Picture pict)
+{
+}
+
+void xrb_blt_scaled(Display *dpy, struct xrb_source *src,
+	int x, int y, unsigned int width, unsigned int height,
+	Picture dest, int dx, int dy, float scale, short transfm, short flags)
+{
+}
+
+#endif /* ENABLE_XRENDER */
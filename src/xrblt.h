@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2012-2026 alx@fastestcode.org
+ * This software is distributed under the terms of the MIT license.
+ * See the included LICENSE file for further information.
+ */
+
+/*
+ * Prototypes for server side (XRender) scaling routines.
+ */
+
+#ifndef XRBLT_H
+#define XRBLT_H
+
+#include <X11/Xlib.h>
+#ifdef ENABLE_XRENDER
+#include <X11/extensions/Xrender.h>
+#else
+typedef XID Picture;
+#endif /* ENABLE_XRENDER */
+
+/* Server side copy of an image */
+struct xrb_source {
+	Pixmap pixmap;
+	Picture picture;
+	unsigned int width;
+	unsigned int height;
+};
+
+/*
+ * Returns True if the RENDER extension is available and supports 'visual'.
+ * Other xrb_* functions must not be used otherwise.
+ */
+Bool xrb_available(Display *dpy, Visual *visual);
+
+/*
+ * Upload 'img' into a new pixmap on the server. 'gc' must be usable
+ * with 'drawable', which determines the screen.
+ * Returns zero on success, ENOMEM if the server couldn't allocate it,
+ * or EINVAL if it's too large for a pixmap.
+ */
+int xrb_upload(Display *dpy, Drawable drawable, GC gc,
+	Visual *visual, XImage *img, struct xrb_source *src);
+
+/* Free server resources allocated by xrb_upload */
+void xrb_free(Display *dpy, struct xrb_source *src);
+
+/*
+ * Create a picture for drawing into 'drawable'. Returns None on failure.
+ */
+Picture xrb_create_dest(Display *dpy, Drawable drawable, Visual *visual);
+
+/* Free a picture created by xrb_create_dest */
+void xrb_free_dest(Display *dpy, Picture pict);
+
+/*
+ * Scale and transform 'src' and draw a 'width' x 'height' rectangle at
+ * 'x', 'y' of it, given in coordinates of the transformed and scaled image,
+ * to 'dest' at 'dx', 'dy'. 'transfm' and 'flags' are IMGT_* and BLTF_*
+ * values, as for img_blt_scaled.
+ */
+void xrb_blt_scaled(Display *dpy, struct xrb_source *src,
+	int x, int y, unsigned int width, unsigned int height,
+	Picture dest, int dx, int dy, float scale, short transfm, short flags);
+
+#endif /* XRBLT_H */